@@ -0,0 +1,111 @@
+// -*- C++ -*-
+// alias_table.cpp
+#include "benchmark.hpp"
+
+#include <sampling/alias_table.hpp>
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+using namespace lucid;
+using namespace argparse;
+
+struct to_unsigned
+{
+    unsigned
+    operator()(const std::string_view word) const noexcept
+    {
+        return std::atoi(word.data());
+    }
+};
+
+constexpr std::tuple options{
+    option<'N'>(to_unsigned{}, 1u << 20u, "size", "Maximal number of weights", "N"),
+    option<'n'>(to_unsigned{}, 10000000, "samples", "Number of samples", "N"),
+    option<'l'>(identity, "/dev/null", "log", "File to log to", "FILE")};
+
+// binary search in cumulative distribution
+class CDF
+{
+    std::vector<real> cdf;
+
+  public:
+    explicit CDF(const std::vector<real>& weights) : cdf(weights.size())
+    {
+        real sum = 0_r;
+        for(std::size_t i = 0ul; i < weights.size(); ++i) cdf[i] = sum += weights[i];
+        for(real& c: cdf) c /= sum;
+    }
+
+    std::size_t
+    sample(const real u) const noexcept
+    {
+        const auto it = std::upper_bound(cdf.begin(), cdf.end(), u);
+        return std::min(static_cast<std::size_t>(it - cdf.begin()), cdf.size() - 1ul);
+    }
+};
+
+int
+main(int argc, char* argv[])
+{
+    ArgsRange      args(argc, argv);
+    const auto     parse_results = parse(options, args, StandardErrorHandler(args, options));
+    const unsigned max_size      = parse_results.get_opt<'N'>();
+    const unsigned num_samples   = parse_results.get_opt<'n'>();
+    LogFile        log(parse_results.get_opt<'l'>());
+
+    std::random_device                   rd;
+    std::default_random_engine           g(rd());
+    std::uniform_real_distribution<real> weight_dist(0_r, 1_r);
+
+    std::vector<real> us(num_samples);
+    for(real& u: us) u = weight_dist(g);
+
+    for(unsigned size = 16u; size <= max_size; size *= 16u)
+    {
+        std::vector<real> weights(size);
+        for(real& w: weights) w = weight_dist(g);
+
+        auto bench = [&](const auto& sampler) noexcept {
+            // sum of indices keeps sampling from being optimized out
+            std::size_t    sum = 0ul;
+            ElapsedTimer<> timer;
+            for(const real u: us) sum += sampler.sample(u);
+            const auto t = timer.elapsed();
+            return std::pair{std::chrono::duration<double, std::nano>(t).count() / num_samples,
+                             sum};
+        };
+
+        ElapsedTimer<>   alias_timer;
+        const AliasTable alias(weights);
+        const auto       alias_build = alias_timer.elapsed();
+        ElapsedTimer<>   cdf_timer;
+        const CDF        cdf(weights);
+        const auto       cdf_build = cdf_timer.elapsed();
+
+        const auto [alias_ns, alias_sum] = bench(alias);
+        const auto [cdf_ns, cdf_sum]     = bench(cdf);
+
+        fmt::print("{} weights: alias table build {}, {:.1f} ns/sample; "
+                   "CDF build {}, {:.1f} ns/sample ({})\n",
+                   size,
+                   std::chrono::duration_cast<std::chrono::microseconds>(alias_build),
+                   alias_ns,
+                   std::chrono::duration_cast<std::chrono::microseconds>(cdf_build),
+                   cdf_ns,
+                   (alias_sum + cdf_sum) % 10ul);
+        log.append("{},{:%Y%m%d},{},{},{},{},{}\n",
+                   repo_hash,
+                   fmt::localtime(std::time(nullptr)),
+                   size,
+                   alias_build,
+                   alias_ns,
+                   cdf_build,
+                   cdf_ns);
+    }
+
+    return 0;
+}
@@ -4,7 +4,13 @@
 
 #pragma once
 
+#include <image_reconstruction/film.hpp>
+#include <image_reconstruction/filtering.hpp>
+#include <sampling/film.hpp>
+#include <sampling/light_bvh.hpp>
+#include <scene/cornell_box.hpp>
 #include <utils/argparse.hpp>
+#include <utils/dispatcher.hpp>
 #include <utils/timer.hpp>
 
 #include <range/v3/algorithm/for_each.hpp>
@@ -18,7 +24,11 @@
 
 #include <cstdio>
 #include <cstdlib>
+#include <functional>
+#include <random>
 #include <string_view>
+#include <tuple>
+#include <type_traits>
 #include <vector>
 
 #ifdef REPO_HASH
@@ -212,4 +222,85 @@ microbench(LogFile& log, const std::size_t n, std::string_view name, G&& g, R&&
     log.append(
         "{},{:%Y%m%d},{},{},{}\n", repo_hash, fmt::localtime(std::time(nullptr)), name, ns, n);
 }
+
+/// @brief Cornell box rendered by the benchmarks of integrators.
+namespace cornell
+{
+inline constexpr auto room_geo   = CornellBox::geometry();
+inline constexpr auto mat_getter = CornellBox::mat_getter();
+
+// engine of the tasks that don't bring their own
+inline thread_local std::random_device         rd;
+inline thread_local std::default_random_engine g(rd());
+
+using Scene          = std::decay_t<decltype(room_geo)>;
+using MaterialGetter = std::decay_t<decltype(mat_getter)>;
+} // namespace cornell
+
+/// @brief Relative mean squared error of @p img compared to the reference @p ref.
+inline double
+rel_mse(const ScanlineImage<float, 4>& img, const ScanlineImage<float, 4>& ref) noexcept
+{
+    double sum = 0.;
+    for(auto it = ref.begin(); it != ref.end(); ++it)
+    {
+        const RGB val(img[it.pos()]);
+        const RGB ref_val(*it);
+        sum += avg((val - ref_val) * (val - ref_val) / (ref_val * ref_val + 1e-2f));
+    }
+    return sum / static_cast<double>(ref.num_pixels());
+}
+
+/// @brief Run a task made by @p make_task for every pixel of @p film
+/// and accumulate the samples they return.
+/// @param make_task Takes the index of the pixel.
+/// Tasks that return only the number of traced rays add no samples.
+template <typename Dispatcher, typename Image, typename MakeTask>
+void
+render_pass(Dispatcher&       dispatcher,
+            Film<Image>&      film,
+            const std::size_t batch_size,
+            MakeTask&&        make_task) noexcept
+{
+    using Batch = TaskBatch<std::decay_t<std::invoke_result_t<MakeTask&, const Vec2u&>>>;
+    const PixelUpdate updater{TriangleFilter(film._pixel_radius)};
+    std::size_t       issued   = 0ul;
+    std::size_t       received = 0ul;
+
+    auto fetch = [&]() noexcept {
+        while(const auto batch = dispatcher.template fetch_result<Batch>())
+            for(const auto& result: batch.value())
+            {
+                if constexpr(!std::is_same_v<typename Batch::Result, std::size_t>)
+                    film = sample_based_singular_update(film, updater, std::get<1>(result));
+                ++received;
+            }
+    };
+
+    Batch batch;
+    auto  submit = [&]() noexcept {
+        const std::size_t num_tasks = batch.tasks.size();
+        while(!dispatcher.try_submit(batch)) fetch();
+        issued += num_tasks;
+        batch.tasks.clear();
+    };
+
+    const auto [w, h] = film.img.res();
+    for(unsigned j = 0u; j < h; ++j)
+        for(unsigned i = 0u; i < w; ++i)
+        {
+            batch.tasks.push_back(make_task(Vec2u(i, j)));
+            if(batch.tasks.size() == batch_size) submit();
+        }
+    if(!batch.tasks.empty()) submit();
+    while(received < issued) fetch();
+}
+
+/// @brief Position of a sample of the pixel @p pidx of @p film, jittered uniformly.
+template <typename Image>
+Vec2
+jittered(const Film<Image>& film, const Vec2u& pidx) noexcept
+{
+    return sample_pixel(cornell::g, film, pidx);
+}
 } // namespace lucid
@@ -0,0 +1,157 @@
+// -*- C++ -*-
+// light_bvh.cpp
+#include "benchmark.hpp"
+
+#include <sampling/light_bvh.hpp>
+#include <utils/tuple.hpp>
+
+#include <fmt/format.h>
+
+#include <random>
+#include <vector>
+
+using namespace lucid;
+using namespace argparse;
+
+struct to_unsigned
+{
+    unsigned
+    operator()(const std::string_view word) const noexcept
+    {
+        return std::atoi(word.data());
+    }
+};
+
+constexpr std::tuple options{
+    option<'N'>(to_unsigned{}, 65536, "lights", "Maximal number of lights", "N"),
+    option<'p'>(to_unsigned{}, 256, "points", "Number of shading points", "N"),
+    option<'s'>(to_unsigned{}, 1000, "samples", "Number of samples per shading point", "N"),
+    option<'l'>(identity, "/dev/null", "log", "File to log to", "FILE")};
+
+struct Estimate
+{
+    double rel_variance = 0.;
+    double seconds      = 0.;
+};
+
+int
+main(int argc, char* argv[])
+{
+    ArgsRange      args(argc, argv);
+    const auto     parse_results = parse(options, args, StandardErrorHandler(args, options));
+    const unsigned max_lights    = parse_results.get_opt<'N'>();
+    const unsigned num_points    = parse_results.get_opt<'p'>();
+    const unsigned num_samples   = std::max(parse_results.get_opt<'s'>(), 2u);
+    LogFile        log(parse_results.get_opt<'l'>());
+
+    std::random_device                    rd;
+    std::default_random_engine            g(rd());
+    std::uniform_real_distribution<real>  pos_dist(-10_r, 10_r);
+    std::uniform_real_distribution<real>  size_dist(0.05_r, 0.5_r);
+    std::uniform_real_distribution<real>  u_dist(0_r, 1_r);
+    std::uniform_real_distribution<float> val_dist(0.1f, 10.f);
+
+    auto normgen = [&]() noexcept { return make_normal(generate<3>(pos_dist, g)); };
+
+    for(unsigned num_lights = 16u; num_lights <= max_lights; num_lights *= 16u)
+    {
+        // emissive quads scattered in a cube
+        std::vector<Quad>        quads(num_lights);
+        std::vector<RGB>         emission(num_lights);
+        std::vector<LightBounds> bounds(num_lights);
+        for(unsigned i = 0u; i < num_lights; ++i)
+        {
+            const Vec3 p      = Vec3(generate<3>(pos_dist, g));
+            const auto [x, y] = basis(normgen());
+            const real s      = size_dist(g);
+            quads[i]          = Quad{p, p + y * s, p + (x + y) * s, p + x * s};
+            emission[i]       = RGB(generate<3>(val_dist, g));
+            bounds[i]         = light_bounds(quads[i], emission[i]);
+        }
+
+        ElapsedTimer<> build_timer;
+        const LightBVH bvh(bounds);
+        const auto     build_time = build_timer.elapsed();
+
+        std::vector<std::pair<Vec3, Vec3>> points(num_points);
+        for(auto& [p, n]: points)
+        {
+            p = Vec3(generate<3>(pos_dist, g));
+            n = normgen();
+        }
+
+        // unoccluded direct lighting from a light sampled by the selector
+        auto estimate = [&](auto&& select) noexcept {
+            Estimate       ret;
+            double         var_sum = 0., mean2_sum = 0.;
+            ElapsedTimer<> timer;
+            for(const auto& [p, n]: points)
+            {
+                double sum = 0., sum2 = 0.;
+                for(unsigned i = 0u; i < num_samples; ++i)
+                {
+                    real val = 0_r;
+                    if(const auto selected = select(p, n, u_dist(g)))
+                    {
+                        const auto& [light, pmf] = selected.value();
+                        const Quad& quad         = quads[light];
+                        const Vec3  pl    = lucid::sample(Vec2(u_dist(g), u_dist(g)), quad);
+                        const Vec3  wi    = pl - p;
+                        const real  d     = std::sqrt(length2(wi));
+                        const real  cos_i = std::max(dot(n, wi), 0_r) / d;
+                        const real  cos_o = lucid::abs(dot(normal(pl, quad), wi)) / d;
+                        val = avg(emission[light]) * cos_i * cos_o * area(quad) / (d * d * pmf);
+                    }
+                    sum += val;
+                    sum2 += val * val;
+                }
+                const double mean = sum / num_samples;
+                var_sum += (sum2 - sum * mean) / (num_samples - 1u);
+                mean2_sum += mean * mean;
+            }
+            // dark points are not weighted up, as they are in per-point relative variance
+            ret.rel_variance = var_sum / mean2_sum;
+            ret.seconds =
+                std::chrono::duration<double>(timer.elapsed()).count() / num_points / num_samples;
+            return ret;
+        };
+
+        const Estimate uniform = estimate([&](const Vec3&, const Vec3&, const real u) noexcept {
+            const auto light = std::min(static_cast<std::size_t>(u * num_lights), num_lights - 1ul);
+            return std::optional{std::pair{light, 1_r / static_cast<real>(num_lights)}};
+        });
+        const Estimate hierarchy =
+            estimate([&](const Vec3& p, const Vec3& n, const real u) noexcept {
+                return bvh.sample(p, n, u);
+            });
+
+        // time per shading point to reach 1% relative error
+        auto time_to_noise = [](const Estimate& e) noexcept {
+            return e.seconds * e.rel_variance / 1e-4;
+        };
+
+        fmt::print("{} lights: build {}\n",
+                   num_lights,
+                   std::chrono::duration_cast<std::chrono::microseconds>(build_time));
+        fmt::print("    uniform: {:.0f} ns/sample, relVar {:.3f}, {:.2f} ms/point to 1% error\n",
+                   uniform.seconds * 1e9,
+                   uniform.rel_variance,
+                   time_to_noise(uniform) * 1e3);
+        fmt::print("    BVH:     {:.0f} ns/sample, relVar {:.3f}, {:.2f} ms/point to 1% error\n",
+                   hierarchy.seconds * 1e9,
+                   hierarchy.rel_variance,
+                   time_to_noise(hierarchy) * 1e3);
+        log.append("{},{:%Y%m%d},{},{},{},{},{},{},{}\n",
+                   repo_hash,
+                   fmt::localtime(std::time(nullptr)),
+                   num_lights,
+                   build_time,
+                   uniform.seconds,
+                   uniform.rel_variance,
+                   hierarchy.seconds,
+                   hierarchy.rel_variance,
+                   num_samples);
+    }
+
+    return 0;
+}
@@ -0,0 +1,140 @@
+// -*- C++ -*-
+// bdpt.cpp
+#include "benchmark.hpp"
+
+#include <image/io.hpp>
+#include <image_reconstruction/adaptive.hpp>
+#include <image_reconstruction/film.hpp>
+#include <integrators/basic.hpp>
+#include <integrators/bdpt.hpp>
+#include <sampling/film.hpp>
+#include <scene/cornell_box.hpp>
+#include <utils/argparse.hpp>
+#include <utils/dispatcher.hpp>
+#include <utils/logging.hpp>
+
+#include <fmt/format.h>
+
+using namespace lucid;
+using namespace argparse;
+using namespace std::literals;
+using namespace cornell;
+
+using PathTracer      = PathTracer_<std::default_random_engine, Scene, MaterialGetter>;
+using PathTracerBatch = TaskBatch<PathTracer>;
+using BDPT = BidirectionalPathTracer_<std::default_random_engine, Scene, MaterialGetter>;
+using BDPTBatch       = TaskBatch<BDPT>;
+using Image           = ScanlineImage<float, 4>;
+using FilmRGBA        = Film<Image>;
+
+struct to_unsigned
+{
+    unsigned
+    operator()(const std::string_view word) const noexcept
+    {
+        return std::atoi(word.data());
+    }
+};
+
+constexpr std::tuple options{
+    option<'r', 2>(to_unsigned{}, {256, 256}, "resolution", "Image resolution.", {"W", "H"}),
+    option<'t'>(to_unsigned{}, 8, "threads", "Number of threads", "T"),
+    option<'n'>(to_unsigned{}, 16, "samples", "Samples per pixel", "N"),
+    option<'d'>(to_unsigned{}, 8, "depth", "Maximum number of bounces", "N"),
+    option<'S'>(to_unsigned{}, 256, "reference", "Samples per pixel of the reference image", "N"),
+    option<'l'>(identity, "/dev/null", "log", "File to log to", "FILE")};
+
+int
+main(int argc, char* argv[])
+{
+    ArgsRange  args(argc, argv);
+    const auto parse_results = parse(options, args, StandardErrorHandler(args, options));
+    const constexpr unsigned batch_size = 64;
+    const Vec2u              res(parse_results.get_opt<'r'>());
+    const unsigned           threads   = parse_results.get_opt<'t'>();
+    const unsigned           spp       = parse_results.get_opt<'n'>();
+    const auto               max_depth = static_cast<std::uint8_t>(parse_results.get_opt<'d'>());
+    const unsigned           ref_spp   = parse_results.get_opt<'S'>();
+    LogFile                  log(parse_results.get_opt<'l'>());
+    Logger                   logger(Logger::DEBUG);
+
+    const perspective::shoot cam  = CornellBox::camera();
+    const real               bias = 0.001_r;
+
+    const SceneLights lights      = collect_lights(room_geo, mat_getter);
+    const AliasTable  light_table = power_table(lights);
+
+    Dispatcher<PathTracerBatch, BDPTBatch> dispatcher(1000, threads);
+
+    auto path_trace = [&](FilmRGBA& film, const unsigned n) noexcept {
+        for(unsigned s = 0u; s < n; ++s)
+            render_pass(dispatcher, film, batch_size, [&](const Vec2u& pidx) noexcept {
+                const Vec2 sample_pos = jittered(film, pidx);
+                return PathTracer{
+                    &g, &room_geo, &mat_getter, cam(sample_pos), max_depth, bias, sample_pos};
+            });
+    };
+
+    auto bidirectional_trace = [&](FilmRGBA& film, const unsigned n) noexcept {
+        for(unsigned s = 0u; s < n; ++s)
+            render_pass(dispatcher, film, batch_size, [&](const Vec2u& pidx) noexcept {
+                const Vec2 sample_pos = jittered(film, pidx);
+                return BDPT{&g,
+                            &room_geo,
+                            &mat_getter,
+                            &lights,
+                            &light_table,
+                            cam(sample_pos),
+                            max_depth,
+                            bias,
+                            sample_pos};
+            });
+    };
+
+    logger.info("Rendering {} spp reference", ref_spp);
+    FilmRGBA reference{res};
+    path_trace(reference, ref_spp);
+
+    ElapsedTimer<> timer;
+    FilmRGBA       pt{res};
+    path_trace(pt, spp);
+    const auto   pt_time  = timer.restart();
+    const double pt_error = rel_mse(pt.img, reference.img);
+
+    FilmRGBA bdpt{res};
+    bidirectional_trace(bdpt, spp);
+    const auto   bdpt_time  = timer.elapsed();
+    const double bdpt_error = rel_mse(bdpt.img, reference.img);
+
+    write_ppm(bdpt.img, "bdpt.ppm");
+
+    // inverse of the time needed to reach unit error
+    auto efficiency = [](const double error, const auto time) noexcept {
+        return 1. / (error * std::chrono::duration<double>(time).count());
+    };
+    fmt::print("Path tracing: {} spp, {} threads: {}, relMSE {:.5f}, efficiency {:.2f}\n",
+               spp,
+               threads,
+               std::chrono::duration_cast<std::chrono::milliseconds>(pt_time),
+               pt_error,
+               efficiency(pt_error, pt_time));
+    fmt::print("Bidirectional path tracing: {} spp, {} threads: {}, relMSE {:.5f}, "
+               "efficiency {:.2f}\n",
+               spp,
+               threads,
+               std::chrono::duration_cast<std::chrono::milliseconds>(bdpt_time),
+               bdpt_error,
+               efficiency(bdpt_error, bdpt_time));
+    log.append("{},{:%Y%m%d},{},{},{},{},{},{},{}\n",
+               repo_hash,
+               fmt::localtime(std::time(nullptr)),
+               threads,
+               spp,
+               max_depth,
+               pt_time,
+               pt_error,
+               bdpt_time,
+               bdpt_error);
+
+    return 0;
+}
@@ -0,0 +1,183 @@
+// -*- C++ -*-
+// blue_noise.cpp
+#include "benchmark.hpp"
+
+#include <image/io.hpp>
+#include <image_reconstruction/film.hpp>
+#include <image_reconstruction/filtering.hpp>
+#include <integrators/basic.hpp>
+#include <sampling/blue_noise.hpp>
+#include <sampling/film.hpp>
+#include <sampling/seeding.hpp>
+#include <scene/cornell_box.hpp>
+#include <utils/argparse.hpp>
+#include <utils/dispatcher.hpp>
+#include <utils/logging.hpp>
+
+#include <fmt/format.h>
+
+#include <cmath>
+
+using namespace lucid;
+using namespace argparse;
+using namespace std::literals;
+using namespace cornell;
+
+using RandomEngine    = DitheredEngine<std::default_random_engine>;
+using PathTracer      = PathTracer_<RandomEngine, Scene, MaterialGetter>;
+using PathTracerBatch = TaskBatch<Seeded<PathTracer, RandomEngine>>;
+using Image           = ScanlineImage<float, 4>;
+using FilmRGBA        = Film<Image>;
+
+struct to_unsigned
+{
+    unsigned
+    operator()(const std::string_view word) const noexcept
+    {
+        return std::atoi(word.data());
+    }
+};
+
+constexpr std::tuple options{
+    option<'r', 2>(to_unsigned{}, {256, 256}, "resolution", "Image resolution.", {"W", "H"}),
+    option<'t'>(to_unsigned{}, 8, "threads", "Number of threads", "T"),
+    option<'n'>(to_unsigned{}, 8, "samples", "Maximum samples per pixel", "N"),
+    option<'d'>(to_unsigned{}, 4, "depth", "Maximum number of bounces", "N"),
+    option<'S'>(to_unsigned{}, 1024, "reference", "Samples per pixel of the reference image", "N"),
+    option<'l'>(identity, "/dev/null", "log", "File to log to", "FILE")};
+
+// image seen from afar, blurred with a gaussian of sigma pixels
+Image
+low_pass(const Image& img, const real sigma)
+{
+    const int         r = static_cast<int>(std::ceil(3_r * sigma));
+    std::vector<real> kernel;
+    real              sum = 0_r;
+    for(int i = -r; i <= r; ++i)
+    {
+        kernel.push_back(std::exp(-static_cast<real>(i * i) / (2_r * sigma * sigma)));
+        sum += kernel.back();
+    }
+
+    const auto [w, h] = img.res();
+    auto blur         = [&](const Image& src, const bool vertical) {
+        Image dst(img.res());
+        for(auto it = dst.begin(); it != dst.end(); ++it)
+        {
+            const auto [i, j] = it.pos();
+            RGB val(0_r);
+            for(int k = -r; k <= r; ++k)
+            {
+                // edges are mirrored
+                const int c = static_cast<int>(vertical ? j : i) + k;
+                const int n = static_cast<int>(vertical ? h : w);
+                const int m = c < 0 ? -c : c >= n ? 2 * n - c - 2 : c;
+                const auto q = vertical ? Vec2u(i, static_cast<unsigned>(m))
+                                        : Vec2u(static_cast<unsigned>(m), j);
+                val += RGB(src[q]) * static_cast<float>(kernel[static_cast<std::size_t>(k + r)]);
+            }
+            *it = RGBA(val / static_cast<float>(sum), 1_r);
+        }
+        return dst;
+    };
+    return blur(blur(img, false), true);
+}
+
+// relative mean squared error as perceived at a distance,
+// where high frequency noise is averaged out by the eye @cite Georgiev2016
+double
+perceptual_error(const Image& img, const Image& ref) noexcept
+{
+    return rel_mse(low_pass(img, 1_r), low_pass(ref, 1_r));
+}
+
+int
+main(int argc, char* argv[])
+{
+    ArgsRange  args(argc, argv);
+    const auto parse_results = parse(options, args, StandardErrorHandler(args, options));
+    const constexpr unsigned batch_size = 64;
+    const Vec2u              res(parse_results.get_opt<'r'>());
+    const unsigned           threads   = parse_results.get_opt<'t'>();
+    const unsigned           max_spp   = parse_results.get_opt<'n'>();
+    const auto               max_depth = static_cast<std::uint8_t>(parse_results.get_opt<'d'>());
+    const unsigned           ref_spp   = parse_results.get_opt<'S'>();
+    LogFile                  log(parse_results.get_opt<'l'>());
+    Logger                   logger(Logger::DEBUG);
+
+    const perspective::shoot cam  = CornellBox::camera();
+    const real               bias = 0.001_r;
+
+    ElapsedTimer<>      mask_timer;
+    const BlueNoiseMask mask;
+    logger.info("{0}x{0} blue noise mask made in {1}",
+                mask.size(),
+                std::chrono::duration_cast<std::chrono::milliseconds>(mask_timer.elapsed()));
+
+    Dispatcher<PathTracerBatch> dispatcher(1000, threads);
+
+    // Render n samples per pixel.
+    // Dithered pixels of a mask tile share random numbers, which the mask rotates.
+    auto render = [&](const unsigned n, BlueNoiseMask const* dither) noexcept {
+        FilmRGBA            film{res};
+        const std::uint64_t seed = (static_cast<std::uint64_t>(rd()) << 32u) | rd();
+        const unsigned      tile = dither ? dither->size() : 1u;
+        for(unsigned s = 0u; s < n; ++s)
+            render_pass(dispatcher, film, batch_size, [&](const Vec2u& pidx) noexcept {
+                const std::uint64_t stream = get_y(pidx) / tile * get_x(res) + get_x(pidx) / tile;
+                RandomEngine        engine(
+                    seeded_engine<std::default_random_engine>(stream_seed(seed, stream, s)),
+                    dither,
+                    pidx);
+                const Vec2 sample_pos = sample_pixel(engine, film, pidx);
+                return Seeded<PathTracer, RandomEngine>{PathTracer{nullptr,
+                                                                   &room_geo,
+                                                                   &mat_getter,
+                                                                   cam(sample_pos),
+                                                                   max_depth,
+                                                                   bias,
+                                                                   sample_pos},
+                                                        engine};
+            });
+        return film;
+    };
+
+    logger.info("Rendering {} spp reference", ref_spp);
+    const FilmRGBA reference = render(ref_spp, nullptr);
+
+    for(unsigned spp = 1u; spp <= max_spp; spp *= 2u)
+    {
+        const FilmRGBA white      = render(spp, nullptr);
+        const FilmRGBA blue       = render(spp, &mask);
+        const double   white_err  = rel_mse(white.img, reference.img);
+        const double   blue_err   = rel_mse(blue.img, reference.img);
+        const double   white_perc = perceptual_error(white.img, reference.img);
+        const double   blue_perc  = perceptual_error(blue.img, reference.img);
+        if(spp == 1u)
+        {
+            write_ppm(white.img, "white_noise.ppm");
+            write_ppm(blue.img, "blue_noise.ppm");
+        }
+
+        // error is inversely proportional to the sample count
+        fmt::print("{} spp: relMSE white {:.5f}, blue {:.5f}; "
+                   "perceptual white {:.5f}, blue {:.5f}, effective spp gain {:.2f}\n",
+                   spp,
+                   white_err,
+                   blue_err,
+                   white_perc,
+                   blue_perc,
+                   white_perc / blue_perc);
+        log.append("{},{:%Y%m%d},{},{},{},{},{},{}\n",
+                   repo_hash,
+                   fmt::localtime(std::time(nullptr)),
+                   threads,
+                   spp,
+                   white_err,
+                   blue_err,
+                   white_perc,
+                   blue_perc);
+    }
+
+    return 0;
+}
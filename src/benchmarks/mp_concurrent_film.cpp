@@ -0,0 +1,110 @@
+// -*- C++ -*-
+// concurrent_film.cpp
+#include "benchmark.hpp"
+
+#include <image_reconstruction/concurrent_film.hpp>
+#include <utils/argparse.hpp>
+#include <utils/tuple.hpp>
+
+#include <fmt/format.h>
+
+#include <chrono>
+#include <random>
+#include <thread>
+#include <vector>
+
+using namespace lucid;
+using namespace argparse;
+
+using Image    = ScanlineImage<float, 4>;
+using FilmRGBA = Film<Image>;
+
+struct to_unsigned
+{
+    unsigned
+    operator()(const std::string_view word) const noexcept
+    {
+        return std::atoi(word.data());
+    }
+};
+
+constexpr std::tuple options{
+    option<'r', 2>(to_unsigned{}, {640, 640}, "resolution", "Image resolution.", {"W", "H"}),
+    option<'t'>(to_unsigned{}, 8, "threads", "Maximum number of threads", "T"),
+    option<'n'>(to_unsigned{}, 1u << 21u, "samples", "Number of samples", "N"),
+    option<'f'>(to_unsigned{}, 4, "filter", "Maximum filter radius in pixels", "R"),
+    option<'l'>(identity, "/dev/null", "log", "File to log to", "FILE")};
+
+int
+main(int argc, char* argv[])
+{
+    ArgsRange  args(argc, argv);
+    const auto parse_results = parse(options, args, StandardErrorHandler(args, options));
+    const Vec2u    res(parse_results.get_opt<'r'>());
+    const unsigned max_threads = std::max(parse_results.get_opt<'t'>(), 1u);
+    const unsigned num_samples = parse_results.get_opt<'n'>();
+    const unsigned max_radius  = std::max(parse_results.get_opt<'f'>(), 1u);
+    LogFile        log(parse_results.get_opt<'l'>());
+
+    std::random_device                   rd;
+    std::default_random_engine           g(rd());
+    std::uniform_real_distribution<real> val_dist(0_r, 1_r);
+
+    // samples in random order, as they come from workers
+    std::vector<Sample> samples;
+    samples.reserve(num_samples);
+    {
+        const FilmRGBA film{res};
+        for(unsigned k = 0u; k < num_samples; ++k)
+            samples.push_back({Vec2((val_dist(g) - 0.5_r) * film._ratio, val_dist(g) - 0.5_r),
+                               RGB(generate<3>(val_dist, g))});
+    }
+
+    auto rate = [&](const std::chrono::nanoseconds elapsed) {
+        return static_cast<double>(num_samples) / std::chrono::duration<double>(elapsed).count();
+    };
+
+    for(unsigned radius = 1u; radius <= max_radius; radius *= 2u)
+    {
+        FilmRGBA          film{res};
+        const PixelUpdate updater{TriangleFilter(static_cast<real>(radius) * film._pixel_width)};
+
+        // all samples splatted by a single thread, like the main thread does
+        const double serial_rate = rate(time_it([&]() noexcept {
+            for(const auto& sample: samples) sample_based_region_update(film, updater, sample);
+        }));
+        fmt::print("radius {}, serial: {:.3g} samples/s\n", radius, serial_rate);
+        log.append("{},{:%Y%m%d},{},0,{}\n",
+                   repo_hash,
+                   fmt::localtime(std::time(nullptr)),
+                   radius,
+                   serial_rate);
+
+        for(unsigned threads = 1u; threads <= max_threads; threads *= 2u)
+        {
+            ConcurrentFilm concurrent{res};
+            const double   concurrent_rate = rate(time_it([&]() {
+                std::vector<std::thread> workers;
+                for(unsigned t = 0u; t < threads; ++t)
+                    workers.emplace_back([&, t]() noexcept {
+                        for(std::size_t k = t; k < samples.size(); k += threads)
+                            sample_based_region_update(concurrent, updater, samples[k]);
+                    });
+                for(auto& worker: workers) worker.join();
+            }));
+            fmt::print("radius {}, {} threads: {:.3g} samples/s, {:.2f}x\n",
+                       radius,
+                       threads,
+                       concurrent_rate,
+                       concurrent_rate / serial_rate);
+            log.append("{},{:%Y%m%d},{},{},{}\n",
+                       repo_hash,
+                       fmt::localtime(std::time(nullptr)),
+                       radius,
+                       threads,
+                       concurrent_rate);
+        }
+    }
+
+    return 0;
+}
@@ -3,31 +3,89 @@
 #include "benchmark.hpp"
 
 #include <image/io.hpp>
+#include <image_reconstruction/adaptive.hpp>
 #include <image_reconstruction/film.hpp>
+#include <image_reconstruction/film_pool.hpp>
+#include <image_reconstruction/tiles.hpp>
 #include <integrators/basic.hpp>
 #include <sampling/film.hpp>
 #include <scene/cornell_box.hpp>
+#include <utils/affinity.hpp>
 #include <utils/argparse.hpp>
 #include <utils/dispatcher.hpp>
 #include <utils/logging.hpp>
 
 #include <fmt/format.h>
 
+#include <atomic>
+
 using namespace lucid;
 using namespace argparse;
 using namespace std::literals;
 using namespace fmt::literals;
 
-static constexpr auto                          room_geo   = CornellBox::geometry();
+// replicas of the scene must not share vertices
+static constexpr auto                          room_geo   = CornellBox::owned_geometry();
 static constexpr auto                          mat_getter = CornellBox::mat_getter();
 static thread_local std::random_device         rd;
 static thread_local std::default_random_engine g(rd());
 
-using PathTracer = PathTracer_<std::default_random_engine,
-                               std::decay_t<decltype(room_geo)>,
-                               std::decay_t<decltype(mat_getter)>>;
-using Image      = ScanlineImage<float, 4>;
-using FilmRGBA   = Film<Image>;
+using Scene           = std::decay_t<decltype(room_geo)>;
+using SceneReplicas   = NodeLocal<Scene>;
+using PathTracer      = PathTracer_<std::default_random_engine,
+                                    Scene,
+                                    std::decay_t<decltype(mat_getter)>>;
+using PathTracerBatch = TaskBatch<PathTracer>;
+using Image           = ScanlineImage<float, 4>;
+using FilmRGBA        = Film<Image>;
+
+// point tracers to the copy of the scene on the NUMA node of the calling thread
+void
+localize(PathTracerBatch& batch, SceneReplicas const* scenes) noexcept
+{
+    if(!scenes) return;
+    Scene const* scene = &scenes->local();
+    for(PathTracer& tracer: batch.tasks) tracer.scene = scene;
+}
+
+// traces a batch with the local copy of the scene
+struct ReplicatedBatch
+{
+    PathTracerBatch      batch;
+    SceneReplicas const* scenes = nullptr;
+
+    std::vector<PathTracerBatch::Result>
+    operator()() noexcept
+    {
+        localize(batch, scenes);
+        return batch();
+    }
+};
+
+// traces a batch into a private film, returns numbers of rays and samples
+struct SplattingBatch
+{
+    PathTracerBatch                    batch;
+    FilmPool<Image>*                   pool    = nullptr;
+    PixelUpdate<TriangleFilter> const* updater = nullptr;
+    SceneReplicas const*               scenes  = nullptr;
+
+    std::pair<std::size_t, std::size_t>
+    operator()() noexcept
+    {
+        localize(batch, scenes);
+        const auto  results   = batch();
+        std::size_t ray_count = 0ul;
+        pool->with_film([&](FilmRGBA& film) noexcept {
+            for(const auto& [depth, sample]: results)
+            {
+                sample_based_singular_update(film, *updater, sample);
+                ray_count += depth;
+            }
+        });
+        return {ray_count, results.size()};
+    }
+};
 
 struct to_unsigned
 {
@@ -39,8 +97,28 @@ struct to_unsigned
 };
 
 constexpr std::tuple options{
-    option<'q'>(to_unsigned{}, 100000, "queue-size", "Task dispatcher queue size.", "Q"),
+    option<'q'>(to_unsigned{}, 100000, "queue-size", "Task dispatcher queue size in samples.", "Q"),
+    option<'b'>(to_unsigned{}, 64, "batch-size", "Number of samples traced by a single task.", "B"),
     option<'t'>(to_unsigned{}, 8, "threads", "Number of threads", "T"),
+    option<'s'>(to_unsigned{}, 64, "samples", "Maximum samples per pixel", "N"),
+    option<'e'>([](const std::string_view word) noexcept { return std::atof(word.data()); },
+                0_r,
+                "error",
+                "Adaptive sampling error threshold. Zero disables adaptive sampling.",
+                "E"),
+    option<'p'>(to_unsigned{}, 256, "tile-size", "Maximum number of pixels of a tile.", "P"),
+    flag<'f'>(false,
+              "private-films",
+              "Accumulate samples into films of worker threads merged at the end "
+              "instead of on the main thread. Disables adaptive sampling."),
+    flag<'a'>(false,
+              "affinity",
+              "Pin workers to CPUs spread over NUMA nodes and trace a copy of the scene "
+              "on the node of the worker."),
+    flag<'w'>(false,
+              "work-stealing",
+              "Render tiles on worker threads stealing from each other instead of dispatching "
+              "samples from the main thread."),
     option<'l'>(identity, "/dev/null", "log", "File to log to", "FILE")};
 
 int
@@ -48,12 +126,18 @@ main(int argc, char* argv[])
 {
     ArgsRange  args(argc, argv);
     const auto parse_results = parse(options, args, StandardErrorHandler(args, options));
-    const constexpr unsigned     nsamples     = 64;
     const constexpr std::uint8_t max_depth    = 4;
     const constexpr real         filter_width = 2;
     const constexpr Vec2u        res(640, 640);
-    const unsigned               qsize   = parse_results.get_opt<'q'>();
-    const unsigned               threads = parse_results.get_opt<'t'>();
+    const unsigned               qsize         = parse_results.get_opt<'q'>();
+    const unsigned               batch_size    = std::max(parse_results.get_opt<'b'>(), 1u);
+    const unsigned               threads       = parse_results.get_opt<'t'>();
+    const unsigned               nsamples      = parse_results.get_opt<'s'>();
+    const real                   threshold     = parse_results.get_opt<'e'>();
+    const unsigned               tile_size     = parse_results.get_opt<'p'>();
+    const bool                   private_films = parse_results.get_opt<'f'>();
+    const bool                   stealing      = parse_results.get_opt<'w'>();
+    const bool                   affinity      = parse_results.get_opt<'a'>();
     LogFile                      log(parse_results.get_opt<'l'>());
     Logger                       logger(Logger::DEBUG);
 
@@ -63,45 +147,147 @@ main(int argc, char* argv[])
 
     FilmRGBA          film{res};
     const PixelUpdate updater{TriangleFilter(filter_width)};
+    PixelStatistics   stats{res};
+    AdaptiveScheduler scheduler(res, threshold, 16ul, nsamples);
 
-    Dispatcher<PathTracer> dispatcher(qsize, threads);
+    FilmPool<Image>      pool(res, private_films ? threads : 1u);
+    const SceneReplicas  scenes(room_geo);
+    SceneReplicas const* replicas = affinity ? &scenes : nullptr;
 
-    constexpr float num_pix = product(res);
+    Dispatcher<PathTracerBatch, ReplicatedBatch, SplattingBatch> dispatcher(
+        std::max(qsize / batch_size, 1u), threads, 1ul, affinity);
+
+    std::size_t issued   = 0ul;
+    std::size_t received = 0ul;
+
+    auto splat = [&](const std::vector<PathTracerBatch::Result>& results) noexcept {
+        for(const auto& [depth, sample]: results)
+        {
+            film = sample_based_singular_update(film, updater, sample);
+            stats.update(film.pixel_index(sample.first), sample.second);
+            ray_count += depth;
+            ++received;
+        }
+    };
+
+    auto fetch = [&]() noexcept {
+        while(const auto ret = dispatcher.fetch_result<PathTracerBatch>()) splat(ret.value());
+        while(const auto ret = dispatcher.fetch_result<ReplicatedBatch>()) splat(ret.value());
+        while(const auto ret = dispatcher.fetch_result<SplattingBatch>())
+        {
+            ray_count += ret->first;
+            received += ret->second;
+        }
+    };
 
     auto render = [&]() noexcept {
-        std::size_t pos = 1ul;
-        for(auto it = film.img.begin(); it != film.img.end(); ++it, ++pos)
+        std::size_t     pass = 0ul;
+        PathTracerBatch batch;
+        batch.tasks.reserve(batch_size);
+
+        auto submit = [&]() noexcept {
+            const std::size_t num_tasks = batch.tasks.size();
+            if(private_films)
+                while(!dispatcher.try_submit(SplattingBatch{batch, &pool, &updater, replicas}))
+                    fetch();
+            else if(affinity)
+                while(!dispatcher.try_submit(ReplicatedBatch{batch, replicas})) fetch();
+            else
+                while(!dispatcher.try_submit(batch)) fetch();
+            issued += num_tasks;
+            batch.tasks.clear();
+            batch.tasks.reserve(batch_size);
+        };
+
+        while(const auto pidx = scheduler.next(stats))
         {
-            for(unsigned i = 0u; i < nsamples; ++i)
+            const Vec2 sample_pos = sample_pixel(g, film, pidx.value());
+            batch.tasks.push_back(PathTracer{
+                &g, &room_geo, &mat_getter, cam(sample_pos), max_depth, bias, sample_pos});
+            if(batch.tasks.size() == batch_size) submit();
+
+            if(pass != scheduler.passes())
             {
-                const Vec2 sample_pos =
-                    sample_pixel(g, film._pixel_width, film.sample_space(it.pos()));
-                if(!dispatcher.try_submit(PathTracer{
-                       &g, &room_geo, &mat_getter, cam(sample_pos), max_depth, bias, sample_pos}))
-                    while(const auto ret = dispatcher.fetch_result<PathTracer>())
-                    {
-                        const auto& [depth, sample] = ret.value();
-                        film = sample_based_singular_update(film, updater, sample);
-                        ray_count += depth;
-                    }
+                pass = scheduler.passes();
+                logger.info(Logger::flush,
+                            "pass {}/{}: {} active pixels",
+                            pass,
+                            nsamples,
+                            scheduler.num_active());
             }
-            logger.info(Logger::flush, "{:05.1f}%", (static_cast<float>(pos) / num_pix) * 100.f);
         }
+
+        if(!batch.tasks.empty()) submit();
+        while(received < issued) fetch();
+        if(private_films) pool.reduce(film, threads);
     };
 
-    auto       ns   = time_it(render);
+    // Every worker traces the pixels of its tiles itself, so there is no producer to wait for.
+    // Pixels are sampled until their own error is below the threshold,
+    // as statistics of neighbouring pixels may be written by other threads.
+    auto trace_pixel = [&](const Vec2u& pidx, std::size_t& pixel_issued, std::size_t& pixel_rays) {
+        const Vec2 pixel_pos = film.sample_space(pidx);
+        for(unsigned s = 0u; s < nsamples; ++s)
+        {
+            if(threshold > 0_r && s >= 16u && stats.error(pidx) < threshold) break;
+
+            const Vec2 sample_pos = sample_pixel(g, film, pidx);
+            PathTracer tracer{&g,
+                              affinity ? &scenes.local() : &room_geo,
+                              &mat_getter,
+                              cam(sample_pos),
+                              max_depth,
+                              bias,
+                              sample_pos};
+            const auto [depth, sample] = tracer();
+            decltype(auto) pixel_val   = film.img[pidx];
+            pixel_val                  = updater(pixel_val, pixel_pos, sample);
+            stats.update(pidx, sample.second);
+            pixel_rays += depth;
+            ++pixel_issued;
+        }
+    };
+
+    auto render_tiled = [&]() noexcept {
+        std::atomic_size_t tiled_issued{0ul};
+        std::atomic_size_t tiled_ray_count{0ul};
+        render_tiles(res, tile_size, threads, [&](const Tile& tile, const unsigned) noexcept {
+            std::size_t tile_issued    = 0ul;
+            std::size_t tile_ray_count = 0ul;
+            for(unsigned j = get_y(tile.min); j < get_y(tile.max); ++j)
+                for(unsigned i = get_x(tile.min); i < get_x(tile.max); ++i)
+                    trace_pixel(Vec2u(i, j), tile_issued, tile_ray_count);
+            tiled_issued.fetch_add(tile_issued);
+            tiled_ray_count.fetch_add(tile_ray_count);
+        });
+        issued    = tiled_issued.load();
+        ray_count = tiled_ray_count.load();
+    };
+
+    auto       ns   = stealing ? time_it(render_tiled) : time_it(render);
     const auto ms   = std::chrono::duration_cast<std::chrono::milliseconds>(ns);
     const auto ss   = std::chrono::duration_cast<std::chrono::seconds>(ns);
     const auto mrps = ray_count / ms.count();
 
+    const real avg_spp = static_cast<real>(issued) / static_cast<real>(product(res));
+
     write_ppm(film.img, "cornell_box_mc_{}spp.ppm"_format(nsamples));
     fmt::print("Cornell Box Monte-Carlo: {} samples: time {}, {} MRay/s\n", nsamples, ss, mrps);
-    log.append("{},{:%Y%m%d},{},{},{}\n",
+    fmt::print("Average {:.2f} spp, {} samples\n", avg_spp, issued);
+    // private films don't collect statistics
+    if(!private_films) fmt::print("Mean error {:.4f}\n", stats.mean_error());
+    log.append("{},{:%Y%m%d},{},{},{},{},{},{},{},{},{}\n",
                repo_hash,
                fmt::localtime(std::time(nullptr)),
                threads,
                qsize,
-               mrps);
+               mrps,
+               batch_size,
+               threshold,
+               avg_spp,
+               stealing ? tile_size : 0u,
+               private_films,
+               affinity);
 
     return 0;
 }
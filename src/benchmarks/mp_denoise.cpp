@@ -0,0 +1,157 @@
+// -*- C++ -*-
+// denoise.cpp
+#include "benchmark.hpp"
+
+#include <image/io.hpp>
+#include <image_reconstruction/adaptive.hpp>
+#include <image_reconstruction/aov.hpp>
+#include <image_reconstruction/denoise.hpp>
+#include <image_reconstruction/film.hpp>
+#include <integrators/basic.hpp>
+#include <sampling/film.hpp>
+#include <scene/cornell_box.hpp>
+#include <utils/argparse.hpp>
+#include <utils/dispatcher.hpp>
+#include <utils/logging.hpp>
+
+#include <fmt/format.h>
+
+using namespace lucid;
+using namespace argparse;
+using namespace std::literals;
+using namespace cornell;
+
+using PathTracer      = PathTracer_<std::default_random_engine, Scene, MaterialGetter, true>;
+using PathTracerBatch = TaskBatch<PathTracer>;
+using Image           = ScanlineImage<float, 4>;
+using FilmRGBA        = Film<Image>;
+
+struct to_unsigned
+{
+    unsigned
+    operator()(const std::string_view word) const noexcept
+    {
+        return std::atoi(word.data());
+    }
+};
+
+constexpr std::tuple options{
+    option<'r', 2>(to_unsigned{}, {640, 640}, "resolution", "Image resolution.", {"W", "H"}),
+    option<'t'>(to_unsigned{}, 8, "threads", "Number of threads", "T"),
+    option<'s'>(to_unsigned{}, 4, "samples", "Samples per pixel of the denoised image", "N"),
+    option<'S'>(to_unsigned{}, 256, "reference", "Samples per pixel of the reference image", "N"),
+    option<'i'>(to_unsigned{}, 5, "iterations", "Number of filter iterations", "N"),
+    option<'n'>(to_unsigned{}, 100, "runs", "Number of denoiser runs", "N"),
+    option<'l'>(identity, "/dev/null", "log", "File to log to", "FILE")};
+
+struct Render
+{
+    FilmRGBA        film;
+    PixelStatistics stats;
+    AOVBuffers      aovs;
+};
+
+int
+main(int argc, char* argv[])
+{
+    ArgsRange  args(argc, argv);
+    const auto parse_results = parse(options, args, StandardErrorHandler(args, options));
+    const constexpr std::uint8_t max_depth  = 4;
+    const constexpr unsigned     batch_size = 64;
+    const Vec2u                  res(parse_results.get_opt<'r'>());
+    const unsigned               threads    = parse_results.get_opt<'t'>();
+    const unsigned               nsamples   = parse_results.get_opt<'s'>();
+    const unsigned               ref_spp    = parse_results.get_opt<'S'>();
+    const unsigned               iterations = parse_results.get_opt<'i'>();
+    const unsigned               runs       = std::max(parse_results.get_opt<'n'>(), 1u);
+    LogFile                      log(parse_results.get_opt<'l'>());
+    Logger                       logger(Logger::DEBUG);
+
+    const perspective::shoot cam  = CornellBox::camera();
+    const real               bias = 0.001_r;
+
+    // uniformly sampled render with AOVs
+    auto render = [&](const unsigned spp) noexcept {
+        Dispatcher<PathTracerBatch> dispatcher(1000, threads);
+        Render                      ret{FilmRGBA{res}, PixelStatistics{res}, AOVBuffers{res}};
+        const PixelUpdate           updater{TriangleFilter(ret.film._pixel_radius)};
+        AdaptiveScheduler           scheduler(res, 0.f, 2ul, spp);
+        std::size_t                 issued   = 0ul;
+        std::size_t                 received = 0ul;
+
+        auto fetch = [&]() noexcept {
+            while(const auto batch = dispatcher.fetch_result<PathTracerBatch>())
+                for(const auto& [depth, sample, aov]: batch.value())
+                {
+                    const Vec2u pidx = ret.film.pixel_index(sample.first);
+                    ret.film         = sample_based_singular_update(ret.film, updater, sample);
+                    ret.stats.update(pidx, sample.second);
+                    ret.aovs.update(pidx, aov);
+                    ++received;
+                }
+        };
+
+        PathTracerBatch batch;
+        auto            submit = [&]() noexcept {
+            const std::size_t num_tasks = batch.tasks.size();
+            while(!dispatcher.try_submit(batch)) fetch();
+            issued += num_tasks;
+            batch.tasks.clear();
+        };
+
+        while(const auto pidx = scheduler.next(ret.stats))
+        {
+            const Vec2 sample_pos = jittered(ret.film, pidx.value());
+            batch.tasks.push_back(PathTracer{
+                &g, &room_geo, &mat_getter, cam(sample_pos), max_depth, bias, sample_pos});
+            if(batch.tasks.size() == batch_size) submit();
+        }
+        if(!batch.tasks.empty()) submit();
+        while(received < issued) fetch();
+
+        return ret;
+    };
+
+    logger.info("Rendering {} spp reference", ref_spp);
+    const Render reference = render(ref_spp);
+    logger.info("Rendering {} spp image", nsamples);
+    const Render noisy = render(nsamples);
+
+    ATrousDenoiser denoiser(res, ATrousDenoiser::Params{iterations}, threads);
+
+    ElapsedTimer<> timer;
+    for(unsigned i = 0u; i < runs; ++i) denoiser(noisy.film.img, noisy.stats, noisy.aovs);
+    const auto t = timer.elapsed() / runs;
+
+    const Image& denoised       = denoiser(noisy.film.img, noisy.stats, noisy.aovs);
+    const double noisy_error    = rel_mse(noisy.film.img, reference.film.img);
+    const double denoised_error = rel_mse(denoised, reference.film.img);
+
+    write_ppm(reference.film.img, "denoise_reference.ppm");
+    write_ppm(noisy.film.img, "denoise_noisy.ppm");
+    write_ppm(denoised, "denoise_filtered.ppm");
+
+    fmt::print("A-trous denoiser: {}x{}, {} iterations, {} threads: ~{}/call\n",
+               get_x(res),
+               get_y(res),
+               iterations,
+               threads,
+               std::chrono::duration_cast<std::chrono::microseconds>(t));
+    fmt::print("relMSE vs {} spp: {} spp {:.5f}, denoised {:.5f}\n",
+               ref_spp,
+               nsamples,
+               noisy_error,
+               denoised_error);
+    log.append("{},{:%Y%m%d},{},{},{},{},{},{},{}\n",
+               repo_hash,
+               fmt::localtime(std::time(nullptr)),
+               threads,
+               nsamples,
+               ref_spp,
+               iterations,
+               t,
+               noisy_error,
+               denoised_error);
+
+    return 0;
+}
@@ -0,0 +1,252 @@
+// -*- C++ -*-
+// dispatcher.cpp
+#include "benchmark.hpp"
+
+#include <utils/argparse.hpp>
+#include <utils/dispatcher.hpp>
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <numeric>
+#include <thread>
+#include <vector>
+
+using namespace lucid;
+using namespace argparse;
+using namespace std::literals;
+
+// task of a tunable amount of work
+struct SpinTask
+{
+    std::uint64_t seed = 0ul;
+    unsigned      work = 0u;
+
+    std::uint64_t
+    operator()() const noexcept
+    {
+        std::uint64_t x = seed;
+        for(unsigned i = 0u; i < work; ++i)
+        {
+            x = (x ^ (x >> 30u)) * 0xbf58476d1ce4e5b9ul;
+            x = x ^ (x >> 31u);
+        }
+        return x;
+    }
+};
+
+using AsyncDispatcher = Dispatcher<SpinTask, Awaited<SpinTask>>;
+
+// awaits tasks one after another
+Async<std::uint64_t>
+await_each(AsyncDispatcher& dispatcher, const std::size_t count, const unsigned work)
+{
+    std::uint64_t checksum = 0ul;
+    for(std::size_t i = 0ul; i < count; ++i)
+        checksum += co_await dispatcher.submit(SpinTask{i, work});
+    co_return checksum;
+}
+
+// awaits all the tasks at once
+Async<std::uint64_t>
+await_all(AsyncDispatcher& dispatcher, const std::size_t count, const unsigned work)
+{
+    std::vector<SpinTask> tasks;
+    for(std::size_t i = 0ul; i < count; ++i) tasks.push_back(SpinTask{i, work});
+    const auto results = co_await dispatcher.when_all(std::move(tasks));
+    co_return std::accumulate(results.begin(), results.end(), std::uint64_t{0ul});
+}
+
+struct to_unsigned
+{
+    unsigned
+    operator()(const std::string_view word) const noexcept
+    {
+        return std::atoi(word.data());
+    }
+};
+
+constexpr std::tuple options{
+    option<'t'>(to_unsigned{}, 8, "threads", "Maximum number of threads", "T"),
+    option<'b'>(to_unsigned{}, 256, "bulk-size", "Maximum number of tasks moved at once", "B"),
+    option<'n'>(to_unsigned{}, 1u << 20u, "tasks", "Number of tasks per run", "N"),
+    option<'w'>(to_unsigned{}, 64, "work", "Iterations of a task", "W"),
+    option<'l'>(identity, "/dev/null", "log", "File to log to", "FILE")};
+
+int
+main(int argc, char* argv[])
+{
+    ArgsRange  args(argc, argv);
+    const auto parse_results = parse(options, args, StandardErrorHandler(args, options));
+    const unsigned    max_threads = std::max(parse_results.get_opt<'t'>(), 1u);
+    const unsigned    max_bulk    = std::max(parse_results.get_opt<'b'>(), 1u);
+    const std::size_t num_tasks   = parse_results.get_opt<'n'>();
+    const unsigned    work        = parse_results.get_opt<'w'>();
+    const std::size_t queue_size  = 1ul << 16u;
+    const auto        idle_time   = 200ms;
+    const unsigned    num_wakeups = 100u;
+    LogFile           log(parse_results.get_opt<'l'>());
+
+    // Move all the tasks through the dispatcher, bulk_size at a time.
+    // A bulk size of zero submits and fetches one task per call without tokens.
+    auto run = [&](const unsigned threads, const std::size_t bulk_size) {
+        Dispatcher<SpinTask> dispatcher(queue_size, threads, std::max(bulk_size, 1ul));
+        auto                 producer_token = dispatcher.producer_token<SpinTask>();
+        auto                 consumer_token = dispatcher.consumer_token<SpinTask>();
+        std::vector<SpinTask>      tasks(std::max(bulk_size, 1ul));
+        std::vector<std::uint64_t> results(std::max(bulk_size, 1ul));
+        std::uint64_t              checksum  = 0ul;
+        std::size_t                submitted = 0ul;
+        std::size_t                fetched   = 0ul;
+
+        ElapsedTimer<> timer;
+        while(fetched < num_tasks)
+        {
+            if(submitted < num_tasks)
+            {
+                const std::size_t count = std::min(tasks.size(), num_tasks - submitted);
+                for(std::size_t i = 0ul; i < count; ++i) tasks[i] = SpinTask{submitted + i, work};
+                if(bulk_size == 0ul ? dispatcher.try_submit(SpinTask(tasks[0])) :
+                                      dispatcher.try_submit_bulk(
+                                          producer_token, tasks.begin(), count))
+                    submitted += count;
+            }
+
+            if(bulk_size == 0ul)
+            {
+                if(const auto result = dispatcher.fetch_result<SpinTask>())
+                {
+                    checksum += result.value();
+                    ++fetched;
+                }
+            }
+            else
+            {
+                const std::size_t count =
+                    dispatcher.fetch_results<SpinTask>(consumer_token, results.begin(), bulk_size);
+                for(std::size_t i = 0ul; i < count; ++i) checksum += results[i];
+                fetched += count;
+            }
+        }
+        const auto elapsed = std::chrono::duration<double>(timer.elapsed()).count();
+        return std::pair{static_cast<double>(num_tasks) / elapsed, checksum};
+    };
+
+    fmt::print("{} tasks of {} iterations\n", num_tasks, work);
+    for(unsigned threads = 1u; threads <= max_threads; threads *= 2u)
+    {
+        const auto [single_rate, single_checksum] = run(threads, 0ul);
+        fmt::print("{} threads, single: {:.3g} tasks/s\n", threads, single_rate);
+        log.append("{},{:%Y%m%d},{},0,{}\n",
+                   repo_hash,
+                   fmt::localtime(std::time(nullptr)),
+                   threads,
+                   single_rate);
+
+        for(std::size_t bulk_size = 1ul; bulk_size <= max_bulk; bulk_size *= 4ul)
+        {
+            const auto [rate, checksum] = run(threads, bulk_size);
+            // every task has to be run exactly once in both modes
+            if(checksum != single_checksum) fmt::print("Checksums differ\n");
+            fmt::print("{} threads, bulk {}: {:.3g} tasks/s, {:.2f}x\n",
+                       threads,
+                       bulk_size,
+                       rate,
+                       rate / single_rate);
+            log.append("{},{:%Y%m%d},{},{},{}\n",
+                       repo_hash,
+                       fmt::localtime(std::time(nullptr)),
+                       threads,
+                       bulk_size,
+                       rate);
+        }
+    }
+
+    // Coroutines resumed by workers against the main thread polling for results.
+    const std::size_t num_round_trips = std::min(num_tasks, std::size_t{1ul << 14u});
+    for(unsigned threads = 1u; threads <= max_threads; threads *= 2u)
+    {
+        AsyncDispatcher dispatcher(queue_size, threads);
+
+        // a task at a time, the overhead of a single await
+        ElapsedTimer<> poll_timer;
+        std::uint64_t  poll_checksum = 0ul;
+        for(std::size_t i = 0ul; i < num_round_trips; ++i)
+        {
+            while(!dispatcher.try_submit(SpinTask{i, work})) {}
+            std::optional<std::uint64_t> result;
+            while(!(result = dispatcher.fetch_result<SpinTask>())) std::this_thread::yield();
+            poll_checksum += result.value();
+        }
+        const double poll_latency =
+            std::chrono::duration<double, std::micro>(poll_timer.elapsed()).count() /
+            static_cast<double>(num_round_trips);
+
+        ElapsedTimer<> await_timer;
+        const auto     await_checksum = sync_wait(await_each(dispatcher, num_round_trips, work));
+        const double   await_latency =
+            std::chrono::duration<double, std::micro>(await_timer.elapsed()).count() /
+            static_cast<double>(num_round_trips);
+
+        // all the tasks at once, compared with the polling single calls above
+        ElapsedTimer<> all_timer;
+        sync_wait(await_all(dispatcher, num_tasks, work));
+        const double all_rate = static_cast<double>(num_tasks) /
+                                std::chrono::duration<double>(all_timer.elapsed()).count();
+
+        if(poll_checksum != await_checksum) fmt::print("Checksums differ\n");
+        fmt::print("{} threads, round trip: polled {:.2f} us, awaited {:.2f} us; "
+                   "when_all: {:.3g} tasks/s\n",
+                   threads,
+                   poll_latency,
+                   await_latency,
+                   all_rate);
+        log.append("{},{:%Y%m%d},{},await,{},{},{}\n",
+                   repo_hash,
+                   fmt::localtime(std::time(nullptr)),
+                   threads,
+                   poll_latency,
+                   await_latency,
+                   all_rate);
+    }
+
+    // Idle workers should neither burn the CPU nor take long to wake up.
+    for(unsigned threads = 1u; threads <= max_threads; threads *= 2u)
+    {
+        Dispatcher<SpinTask> dispatcher(queue_size, threads);
+        std::this_thread::sleep_for(50ms);
+
+        // processor time consumed by the whole process while idle
+        const std::clock_t idle_start = std::clock();
+        std::this_thread::sleep_for(idle_time);
+        const double busy_cores = static_cast<double>(std::clock() - idle_start) /
+                                  CLOCKS_PER_SEC / std::chrono::duration<double>(idle_time).count();
+
+        std::vector<double> latencies;
+        for(unsigned i = 0u; i < num_wakeups; ++i)
+        {
+            std::this_thread::sleep_for(5ms);
+            ElapsedTimer<> timer;
+            while(!dispatcher.try_submit(SpinTask{i, 0u})) {}
+            while(!dispatcher.fetch_result<SpinTask>()) std::this_thread::yield();
+            latencies.push_back(std::chrono::duration<double, std::micro>(timer.elapsed()).count());
+        }
+        std::sort(latencies.begin(), latencies.end());
+        const double median = latencies[latencies.size() / 2ul];
+        fmt::print("{} threads, idle: {:.2f} cores busy, wake-up latency {:.1f} us\n",
+                   threads,
+                   busy_cores,
+                   median);
+        log.append("{},{:%Y%m%d},{},idle,{},{}\n",
+                   repo_hash,
+                   fmt::localtime(std::time(nullptr)),
+                   threads,
+                   busy_cores,
+                   median);
+    }
+
+    return 0;
+}
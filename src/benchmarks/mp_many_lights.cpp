@@ -0,0 +1,185 @@
+// -*- C++ -*-
+// many_lights.cpp
+#include "benchmark.hpp"
+
+#include <image_reconstruction/film.hpp>
+#include <integrators/bdpt.hpp>
+#include <integrators/restir.hpp>
+#include <sampling/film.hpp>
+#include <scene/cornell_box.hpp>
+#include <utils/argparse.hpp>
+#include <utils/dispatcher.hpp>
+#include <utils/logging.hpp>
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <vector>
+
+using namespace lucid;
+using namespace argparse;
+using namespace std::literals;
+
+using Image    = ScanlineImage<float, 4>;
+using FilmRGBA = Film<Image>;
+
+struct to_unsigned
+{
+    unsigned
+    operator()(const std::string_view word) const noexcept
+    {
+        return std::atoi(word.data());
+    }
+};
+
+constexpr std::tuple options{
+    option<'r', 2>(to_unsigned{}, {128, 128}, "resolution", "Image resolution.", {"W", "H"}),
+    option<'t'>(to_unsigned{}, 8, "threads", "Number of threads", "T"),
+    option<'n'>(to_unsigned{}, 16, "passes", "Number of passes", "N"),
+    option<'d'>(to_unsigned{}, 3, "depth", "Maximum number of bounces of BDPT", "N"),
+    option<'l'>(identity, "/dev/null", "log", "File to log to", "FILE")};
+
+struct Measurement
+{
+    std::chrono::nanoseconds time{0};
+    double                   rel_variance = 0.; // median over pixels of a pass
+};
+
+int
+main(int argc, char* argv[])
+{
+    ArgsRange  args(argc, argv);
+    const auto parse_results = parse(options, args, StandardErrorHandler(args, options));
+    const constexpr unsigned batch_size = 64;
+    const Vec2u              res(parse_results.get_opt<'r'>());
+    const unsigned           threads    = parse_results.get_opt<'t'>();
+    const unsigned           passes     = std::max(parse_results.get_opt<'n'>(), 2u);
+    const auto               max_depth  = static_cast<std::uint8_t>(parse_results.get_opt<'d'>());
+    LogFile                  log(parse_results.get_opt<'l'>());
+    Logger                   logger(Logger::DEBUG);
+
+    const perspective::shoot cam        = CornellBox::camera();
+    const real               bias       = 0.001_r;
+    constexpr auto           mat_getter = CornellBox::many_lights_mat_getter();
+
+    auto run = [&]<unsigned K>(std::integral_constant<unsigned, K>) {
+        static constexpr auto geo = CornellBox::many_lights_geometry<K>();
+        using Scene               = std::decay_t<decltype(geo)>;
+        using MaterialGetter      = std::decay_t<decltype(mat_getter)>;
+        using RandomEngine        = std::default_random_engine;
+        using ReservoirSampler    = ReservoirSampler_<RandomEngine, Scene, MaterialGetter>;
+        using ReservoirShader     = ReservoirShader_<RandomEngine, Scene, MaterialGetter>;
+        using BDPT = BidirectionalPathTracer_<RandomEngine, Scene, MaterialGetter>;
+
+        const SceneLights lights      = collect_lights(geo, mat_getter);
+        const AliasTable  light_table = power_table(lights);
+
+        Dispatcher<TaskBatch<ReservoirSampler>, TaskBatch<ReservoirShader>, TaskBatch<BDPT>>
+            dispatcher(1000, threads);
+
+        // resampled direct lighting without reuse, so light selection alone drives the noise
+        auto resample = [&](FilmRGBA& film, const unsigned n) noexcept {
+            ReservoirBuffers buffers(res);
+            for(unsigned s = 0u; s < n; ++s)
+            {
+                render_pass(dispatcher, film, batch_size, [&](const Vec2u& pidx) noexcept {
+                    const Vec2 sample_pos = jittered(film, pidx);
+                    return ReservoirSampler{&cornell::g,
+                                            &geo,
+                                            &mat_getter,
+                                            &lights,
+                                            &buffers,
+                                            cam(sample_pos),
+                                            pidx,
+                                            sample_pos,
+                                            4u,
+                                            0u};
+                });
+                render_pass(dispatcher, film, batch_size, [&](const Vec2u& pidx) noexcept {
+                    return ReservoirShader{
+                        &cornell::g, &geo, &mat_getter, &lights, &buffers, pidx, 0u, 0_r, bias};
+                });
+            }
+        };
+
+        auto bidirectional_trace = [&](FilmRGBA& film, const unsigned n) noexcept {
+            for(unsigned s = 0u; s < n; ++s)
+                render_pass(dispatcher, film, batch_size, [&](const Vec2u& pidx) noexcept {
+                    const Vec2 sample_pos = jittered(film, pidx);
+                    return BDPT{&cornell::g,
+                                &geo,
+                                &mat_getter,
+                                &lights,
+                                &light_table,
+                                cam(sample_pos),
+                                max_depth,
+                                bias,
+                                sample_pos};
+                });
+        };
+
+        // median variance of pixels over independent passes relative to their squared mean,
+        // which needs no reference image
+        auto measure = [&](auto&& render) {
+            std::vector<double>      sum(product(res), 0.);
+            std::vector<double>      sum2(product(res), 0.);
+            std::chrono::nanoseconds time{0};
+            for(unsigned p = 0u; p < passes; ++p)
+            {
+                ElapsedTimer<> timer;
+                FilmRGBA       film{res};
+                render(film, 1u);
+                time += timer.elapsed();
+                for(auto it = film.img.begin(); it != film.img.end(); ++it)
+                {
+                    const std::size_t i = get_y(it.pos()) * get_x(res) + get_x(it.pos());
+                    const double      v = avg(RGB(*it));
+                    sum[i] += v;
+                    sum2[i] += v * v;
+                }
+            }
+            // the median is robust to the few pixels with fireflies
+            std::vector<double> rel_variances;
+            for(std::size_t i = 0ul; i < sum.size(); ++i)
+            {
+                const double mean = sum[i] / passes;
+                const double var  = (sum2[i] - sum[i] * mean) / (passes - 1u);
+                if(mean > 0.) rel_variances.push_back(var / (mean * mean));
+            }
+            const auto median = rel_variances.begin() + rel_variances.size() / 2;
+            std::nth_element(rel_variances.begin(), median, rel_variances.end());
+            return Measurement{time / passes, rel_variances.empty() ? 0. : *median};
+        };
+
+        logger.info("{} lights", K * K);
+        const Measurement ris  = measure(resample);
+        const Measurement bdpt = measure(bidirectional_trace);
+
+        auto report = [&](const std::string_view name, const Measurement& m) {
+            fmt::print("    {}: {} threads: {}/pass, relVar {:.5f}\n",
+                       name,
+                       threads,
+                       std::chrono::duration_cast<std::chrono::microseconds>(m.time),
+                       m.rel_variance);
+        };
+        report("Resampling", ris);
+        report("Bidirectional path tracing", bdpt);
+        log.append("{},{:%Y%m%d},{},{},{},{},{},{},{}\n",
+                   repo_hash,
+                   fmt::localtime(std::time(nullptr)),
+                   threads,
+                   passes,
+                   K * K,
+                   ris.time,
+                   ris.rel_variance,
+                   bdpt.time,
+                   bdpt.rel_variance);
+    };
+
+    run(std::integral_constant<unsigned, 1u>{});
+    run(std::integral_constant<unsigned, 2u>{});
+    run(std::integral_constant<unsigned, 4u>{});
+    run(std::integral_constant<unsigned, 8u>{});
+
+    return 0;
+}
@@ -0,0 +1,187 @@
+// -*- C++ -*-
+// photon_mapping.cpp
+#include "benchmark.hpp"
+
+#include <image/io.hpp>
+#include <image_reconstruction/adaptive.hpp>
+#include <image_reconstruction/film.hpp>
+#include <integrators/basic.hpp>
+#include <integrators/photon_mapping.hpp>
+#include <sampling/film.hpp>
+#include <scene/cornell_box.hpp>
+#include <utils/argparse.hpp>
+#include <utils/dispatcher.hpp>
+#include <utils/logging.hpp>
+
+#include <fmt/format.h>
+
+using namespace lucid;
+using namespace argparse;
+using namespace std::literals;
+using namespace cornell;
+
+using PathTracer      = PathTracer_<std::default_random_engine, Scene, MaterialGetter>;
+using PathTracerBatch = TaskBatch<PathTracer>;
+using PhotonTracer    = PhotonTracer_<std::default_random_engine, Scene, MaterialGetter>;
+using GathererBatch   = TaskBatch<PhotonGatherer_<Scene, MaterialGetter>>;
+using Image           = ScanlineImage<float, 4>;
+using FilmRGBA        = Film<Image>;
+
+struct to_unsigned
+{
+    unsigned
+    operator()(const std::string_view word) const noexcept
+    {
+        return std::atoi(word.data());
+    }
+};
+
+constexpr std::tuple options{
+    option<'r', 2>(to_unsigned{}, {256, 256}, "resolution", "Image resolution.", {"W", "H"}),
+    option<'t'>(to_unsigned{}, 8, "threads", "Number of threads", "T"),
+    option<'p'>(to_unsigned{}, 100000, "photons", "Photon paths per pass", "N"),
+    option<'n'>(to_unsigned{}, 16, "passes", "Number of passes", "N"),
+    option<'R'>([](const std::string_view word) noexcept { return std::atof(word.data()); },
+                0.05_r,
+                "radius",
+                "Gather radius of the first pass",
+                "R"),
+    option<'S'>(to_unsigned{}, 256, "reference", "Samples per pixel of the reference image", "N"),
+    option<'l'>(identity, "/dev/null", "log", "File to log to", "FILE")};
+
+int
+main(int argc, char* argv[])
+{
+    ArgsRange  args(argc, argv);
+    const auto parse_results = parse(options, args, StandardErrorHandler(args, options));
+    const constexpr std::uint8_t max_depth  = 8;
+    const constexpr unsigned     batch_size = 64;
+    const Vec2u                  res(parse_results.get_opt<'r'>());
+    const unsigned               threads     = parse_results.get_opt<'t'>();
+    const unsigned               num_photons = parse_results.get_opt<'p'>();
+    const unsigned               passes      = parse_results.get_opt<'n'>();
+    const real                   radius      = parse_results.get_opt<'R'>();
+    const unsigned               ref_spp     = parse_results.get_opt<'S'>();
+    LogFile                      log(parse_results.get_opt<'l'>());
+    Logger                       logger(Logger::DEBUG);
+
+    const perspective::shoot cam  = CornellBox::camera();
+    const real               bias = 0.001_r;
+
+    const SceneLights lights      = collect_lights(room_geo, mat_getter);
+    const AliasTable  light_table = power_table(lights);
+
+    Dispatcher<PathTracerBatch, PhotonTracer, GathererBatch> dispatcher(1000, threads);
+
+    auto path_trace = [&](FilmRGBA& film, const unsigned spp) noexcept {
+        for(unsigned s = 0u; s < spp; ++s)
+            render_pass(dispatcher, film, batch_size, [&](const Vec2u& pidx) noexcept {
+                const Vec2 sample_pos = jittered(film, pidx);
+                return PathTracer{&g,
+                                  &room_geo,
+                                  &mat_getter,
+                                  cam(sample_pos),
+                                  max_depth + 1u,
+                                  bias,
+                                  sample_pos};
+            });
+    };
+
+    logger.info("Rendering {} spp reference", ref_spp);
+    FilmRGBA reference{res};
+    path_trace(reference, ref_spp);
+
+    // photon paths are traced in as many tasks as there are threads
+    auto trace_photons = [&]() noexcept {
+        std::vector<Photon> photons;
+        for(unsigned t = 0u; t < threads; ++t)
+        {
+            const std::size_t paths = num_photons * (t + 1ul) / threads - num_photons * t / threads;
+            PhotonTracer      task{&g,
+                                   &room_geo,
+                                   &mat_getter,
+                                   &lights,
+                                   &light_table,
+                                   paths,
+                                   1_r / static_cast<real>(num_photons),
+                                   max_depth,
+                                   bias};
+            while(!dispatcher.try_submit(task)) {}
+        }
+        for(unsigned received = 0u; received < threads;)
+            if(const auto ret = dispatcher.fetch_result<PhotonTracer>())
+            {
+                photons.insert(photons.end(), ret->begin(), ret->end());
+                ++received;
+            }
+        return photons;
+    };
+
+    FilmRGBA                 film{res};
+    std::chrono::nanoseconds photon_time{};
+    std::chrono::nanoseconds build_time{};
+    ElapsedTimer<>           timer;
+    double                   ppm_error = 0.;
+    for(unsigned pass = 0u; pass < passes; ++pass)
+    {
+        ElapsedTimer<>            pass_timer;
+        const std::vector<Photon> photons = trace_photons();
+        photon_time += pass_timer.restart();
+        const PhotonMap map(photons, threads);
+        build_time += pass_timer.elapsed();
+
+        const real radius2 = progressive_radius2(radius * radius, pass);
+        render_pass(dispatcher, film, batch_size, [&](const Vec2u& pidx) noexcept {
+            const Vec2 sample_pos = jittered(film, pidx);
+            return PhotonGatherer_<Scene, MaterialGetter>{
+                &room_geo, &mat_getter, &map, cam(sample_pos), radius2, sample_pos};
+        });
+
+        // passes are independent estimates, so the error keeps decreasing
+        if((pass & (pass + 1u)) == 0u || pass + 1u == passes)
+        {
+            ppm_error = rel_mse(film.img, reference.img);
+            logger.info("pass {}: {} photons, radius {:.4f}, relMSE {:.5f}",
+                        pass + 1u,
+                        map.size(),
+                        std::sqrt(radius2),
+                        ppm_error);
+        }
+    }
+    const auto ppm_time = timer.restart();
+
+    FilmRGBA pt{res};
+    path_trace(pt, passes);
+    const auto   pt_time  = timer.elapsed();
+    const double pt_error = rel_mse(pt.img, reference.img);
+
+    write_ppm(film.img, "photon_mapping.ppm");
+
+    fmt::print("Photon mapping: {} passes of {} photon paths, {} threads: {} "
+               "(tracing {}, kd-tree {}), relMSE {:.5f}\n",
+               passes,
+               num_photons,
+               threads,
+               std::chrono::duration_cast<std::chrono::milliseconds>(ppm_time),
+               std::chrono::duration_cast<std::chrono::milliseconds>(photon_time),
+               std::chrono::duration_cast<std::chrono::milliseconds>(build_time),
+               ppm_error);
+    fmt::print("Path tracing: {} spp: {}, relMSE {:.5f}\n",
+               passes,
+               std::chrono::duration_cast<std::chrono::milliseconds>(pt_time),
+               pt_error);
+    log.append("{},{:%Y%m%d},{},{},{},{},{},{},{},{},{}\n",
+               repo_hash,
+               fmt::localtime(std::time(nullptr)),
+               threads,
+               num_photons,
+               passes,
+               radius,
+               ppm_time,
+               build_time,
+               ppm_error,
+               pt_time,
+               pt_error);
+
+    return 0;
+}
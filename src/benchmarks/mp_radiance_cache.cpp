@@ -0,0 +1,190 @@
+// -*- C++ -*-
+// radiance_cache.cpp
+#include "benchmark.hpp"
+
+#include <image/io.hpp>
+#include <image_reconstruction/adaptive.hpp>
+#include <image_reconstruction/film.hpp>
+#include <integrators/basic.hpp>
+#include <sampling/film.hpp>
+#include <sampling/radiance_cache.hpp>
+#include <scene/cornell_box.hpp>
+#include <utils/argparse.hpp>
+#include <utils/dispatcher.hpp>
+#include <utils/logging.hpp>
+
+#include <fmt/format.h>
+
+using namespace lucid;
+using namespace argparse;
+using namespace std::literals;
+using namespace cornell;
+
+using PathTracer      = PathTracer_<std::default_random_engine, Scene, MaterialGetter>;
+using PathTracerBatch = TaskBatch<PathTracer>;
+using Image           = ScanlineImage<float, 4>;
+using FilmRGBA        = Film<Image>;
+
+struct to_unsigned
+{
+    unsigned
+    operator()(const std::string_view word) const noexcept
+    {
+        return std::atoi(word.data());
+    }
+};
+
+constexpr std::tuple options{
+    option<'r', 2>(to_unsigned{}, {320, 320}, "resolution", "Image resolution.", {"W", "H"}),
+    option<'t'>(to_unsigned{}, 8, "threads", "Number of threads", "T"),
+    option<'s'>(to_unsigned{}, 16, "samples", "Samples per pixel", "N"),
+    option<'S'>(to_unsigned{}, 256, "reference", "Samples per pixel of the reference image", "N"),
+    option<'d'>(to_unsigned{}, 8, "depth", "Maximal path depth", "N"),
+    option<'c'>(to_unsigned{}, 2, "cache", "Bounces after which the cache is looked up", "N"),
+    option<'l'>(identity, "/dev/null", "log", "File to log to", "FILE")};
+
+struct Render
+{
+    FilmRGBA                 film;
+    std::size_t              ray_count;
+    std::chrono::nanoseconds time;
+};
+
+// relative difference of the image energy
+double
+rel_bias(const Image& img, const Image& ref) noexcept
+{
+    double sum     = 0.;
+    double ref_sum = 0.;
+    for(auto it = ref.begin(); it != ref.end(); ++it)
+    {
+        sum += avg(RGB(img[it.pos()]));
+        ref_sum += avg(RGB(*it));
+    }
+    return (sum - ref_sum) / ref_sum;
+}
+
+int
+main(int argc, char* argv[])
+{
+    ArgsRange  args(argc, argv);
+    const auto parse_results = parse(options, args, StandardErrorHandler(args, options));
+    const constexpr unsigned batch_size  = 64;
+    const Vec2u              res(parse_results.get_opt<'r'>());
+    const unsigned           threads     = parse_results.get_opt<'t'>();
+    const unsigned           nsamples    = parse_results.get_opt<'s'>();
+    const unsigned           ref_spp     = parse_results.get_opt<'S'>();
+    const auto               max_depth   = static_cast<std::uint8_t>(parse_results.get_opt<'d'>());
+    const unsigned           cache_depth = parse_results.get_opt<'c'>();
+    LogFile                  log(parse_results.get_opt<'l'>());
+    Logger                   logger(Logger::DEBUG);
+
+    const perspective::shoot cam  = CornellBox::camera();
+    const real               bias = 0.001_r;
+
+    // uniformly sampled render
+    auto render = [&](const unsigned spp, RadianceCache* cache) noexcept {
+        Dispatcher<PathTracerBatch> dispatcher(1000, threads);
+        Render                      ret{FilmRGBA{res}, 0ul, {}};
+        const PixelUpdate           updater{TriangleFilter(ret.film._pixel_radius)};
+        PixelStatistics             stats{res};
+        AdaptiveScheduler           scheduler(res, 0.f, 2ul, spp);
+        std::size_t                 issued   = 0ul;
+        std::size_t                 received = 0ul;
+        ElapsedTimer<>              timer;
+
+        auto fetch = [&]() noexcept {
+            while(const auto batch = dispatcher.fetch_result<PathTracerBatch>())
+                for(const auto& [depth, sample]: batch.value())
+                {
+                    ret.film = sample_based_singular_update(ret.film, updater, sample);
+                    stats.update(ret.film.pixel_index(sample.first), sample.second);
+                    ret.ray_count += depth;
+                    ++received;
+                }
+        };
+
+        PathTracerBatch batch;
+        auto            submit = [&]() noexcept {
+            const std::size_t num_tasks = batch.tasks.size();
+            while(!dispatcher.try_submit(batch)) fetch();
+            issued += num_tasks;
+            batch.tasks.clear();
+        };
+
+        while(const auto pidx = scheduler.next(stats))
+        {
+            const Vec2 sample_pos = jittered(ret.film, pidx.value());
+            batch.tasks.push_back(PathTracer{&g,
+                                             &room_geo,
+                                             &mat_getter,
+                                             cam(sample_pos),
+                                             max_depth,
+                                             bias,
+                                             sample_pos,
+                                             nullptr,
+                                             cache});
+            if(batch.tasks.size() == batch_size) submit();
+        }
+        if(!batch.tasks.empty()) submit();
+        while(received < issued) fetch();
+
+        ret.time = timer.elapsed();
+        return ret;
+    };
+
+    logger.info("Rendering {} spp reference", ref_spp);
+    const Render reference = render(ref_spp, nullptr);
+    logger.info("Rendering {} spp image", nsamples);
+    const Render plain = render(nsamples, nullptr);
+    logger.info("Rendering {} spp image with the radiance cache", nsamples);
+    RadianceCache cache(RadianceCache::Params{.depth = cache_depth});
+    const Render  cached = render(nsamples, &cache);
+
+    const auto   plain_ms     = std::chrono::duration_cast<std::chrono::milliseconds>(plain.time);
+    const auto   cached_ms    = std::chrono::duration_cast<std::chrono::milliseconds>(cached.time);
+    const double speedup      = static_cast<double>(plain.time.count()) /
+                           static_cast<double>(cached.time.count());
+    const double plain_error  = rel_mse(plain.film.img, reference.film.img);
+    const double cached_error = rel_mse(cached.film.img, reference.film.img);
+    const double plain_bias   = rel_bias(plain.film.img, reference.film.img);
+    const double cached_bias  = rel_bias(cached.film.img, reference.film.img);
+
+    write_ppm(cached.film.img, "radiance_cache.ppm");
+
+    fmt::print("Radiance cache: {}x{}, {} spp, depth {}, lookup after {} bounces, {} cells\n",
+               get_x(res),
+               get_y(res),
+               nsamples,
+               max_depth,
+               cache_depth,
+               cache.num_cells());
+    fmt::print("time: plain {} ({} rays), cached {} ({} rays), speedup {:.2f}\n",
+               plain_ms,
+               plain.ray_count,
+               cached_ms,
+               cached.ray_count,
+               speedup);
+    fmt::print("vs {} spp: relMSE plain {:.5f}, cached {:.5f}; "
+               "relative bias plain {:.4f}, cached {:.4f}\n",
+               ref_spp,
+               plain_error,
+               cached_error,
+               plain_bias,
+               cached_bias);
+    log.append("{},{:%Y%m%d},{},{},{},{},{},{},{},{},{},{}\n",
+               repo_hash,
+               fmt::localtime(std::time(nullptr)),
+               threads,
+               nsamples,
+               max_depth,
+               cache_depth,
+               plain.time,
+               cached.time,
+               plain_error,
+               cached_error,
+               plain_bias,
+               cached_bias);
+
+    return 0;
+}
@@ -0,0 +1,160 @@
+// -*- C++ -*-
+// restir.cpp
+#include "benchmark.hpp"
+
+#include <image/io.hpp>
+#include <image_reconstruction/adaptive.hpp>
+#include <image_reconstruction/film.hpp>
+#include <integrators/basic.hpp>
+#include <integrators/restir.hpp>
+#include <sampling/film.hpp>
+#include <scene/cornell_box.hpp>
+#include <utils/argparse.hpp>
+#include <utils/dispatcher.hpp>
+#include <utils/logging.hpp>
+
+#include <fmt/format.h>
+
+using namespace lucid;
+using namespace argparse;
+using namespace std::literals;
+using namespace cornell;
+
+using PathTracer       = PathTracer_<std::default_random_engine, Scene, MaterialGetter>;
+using ReservoirSampler = ReservoirSampler_<std::default_random_engine, Scene, MaterialGetter>;
+using ReservoirShader  = ReservoirShader_<std::default_random_engine, Scene, MaterialGetter>;
+using PathTracerBatch  = TaskBatch<PathTracer>;
+using ReservoirSamplerBatch = TaskBatch<ReservoirSampler>;
+using ReservoirShaderBatch  = TaskBatch<ReservoirShader>;
+using Image            = ScanlineImage<float, 4>;
+using FilmRGBA         = Film<Image>;
+
+struct to_unsigned
+{
+    unsigned
+    operator()(const std::string_view word) const noexcept
+    {
+        return std::atoi(word.data());
+    }
+};
+
+constexpr std::tuple options{
+    option<'r', 2>(to_unsigned{}, {256, 256}, "resolution", "Image resolution.", {"W", "H"}),
+    option<'t'>(to_unsigned{}, 8, "threads", "Number of threads", "T"),
+    option<'n'>(to_unsigned{}, 16, "passes", "Number of passes", "N"),
+    option<'c'>(to_unsigned{}, 16, "candidates", "Light candidates per pixel and pass", "N"),
+    option<'S'>(to_unsigned{}, 1024, "reference", "Passes of the reference image", "N"),
+    option<'l'>(identity, "/dev/null", "log", "File to log to", "FILE")};
+
+int
+main(int argc, char* argv[])
+{
+    ArgsRange  args(argc, argv);
+    const auto parse_results = parse(options, args, StandardErrorHandler(args, options));
+    const constexpr unsigned batch_size = 64;
+    const Vec2u              res(parse_results.get_opt<'r'>());
+    const unsigned           threads        = parse_results.get_opt<'t'>();
+    const unsigned           passes         = parse_results.get_opt<'n'>();
+    const unsigned           num_candidates = parse_results.get_opt<'c'>();
+    const unsigned           ref_passes     = parse_results.get_opt<'S'>();
+    LogFile                  log(parse_results.get_opt<'l'>());
+    Logger                   logger(Logger::DEBUG);
+
+    const perspective::shoot cam  = CornellBox::camera();
+    const real               bias = 0.001_r;
+
+    const SceneLights lights = collect_lights(room_geo, mat_getter);
+
+    Dispatcher<PathTracerBatch, ReservoirSamplerBatch, ReservoirShaderBatch> dispatcher(1000,
+                                                                                        threads);
+
+    // direct lighting with BSDF sampling
+    auto path_trace = [&](FilmRGBA& film, const unsigned n) noexcept {
+        for(unsigned s = 0u; s < n; ++s)
+            render_pass(dispatcher, film, batch_size, [&](const Vec2u& pidx) noexcept {
+                const Vec2 sample_pos = jittered(film, pidx);
+                return PathTracer{
+                    &g, &room_geo, &mat_getter, cam(sample_pos), 2u, bias, sample_pos};
+            });
+    };
+
+    auto resample = [&](FilmRGBA&         film,
+                        const unsigned    n,
+                        const unsigned    temporal_limit,
+                        const unsigned    num_neighbors) noexcept {
+        ReservoirBuffers buffers(res);
+        for(unsigned s = 0u; s < n; ++s)
+        {
+            render_pass(dispatcher, film, batch_size, [&](const Vec2u& pidx) noexcept {
+                const Vec2 sample_pos = jittered(film, pidx);
+                return ReservoirSampler{&g,
+                                        &room_geo,
+                                        &mat_getter,
+                                        &lights,
+                                        &buffers,
+                                        cam(sample_pos),
+                                        pidx,
+                                        sample_pos,
+                                        num_candidates,
+                                        temporal_limit};
+            });
+            render_pass(dispatcher, film, batch_size, [&](const Vec2u& pidx) noexcept {
+                return ReservoirShader{
+                    &g, &room_geo, &mat_getter, &lights, &buffers, pidx, num_neighbors, 16_r, bias};
+            });
+        }
+    };
+
+    logger.info("Rendering {} passes reference", ref_passes);
+    FilmRGBA reference{res};
+    resample(reference, ref_passes, 0u, 0u);
+
+    ElapsedTimer<> timer;
+    FilmRGBA       pt{res};
+    path_trace(pt, passes);
+    const auto   pt_time  = timer.restart();
+    const double pt_error = rel_mse(pt.img, reference.img);
+
+    FilmRGBA ris{res};
+    resample(ris, passes, 0u, 0u);
+    const auto   ris_time  = timer.restart();
+    const double ris_error = rel_mse(ris.img, reference.img);
+
+    FilmRGBA restir{res};
+    resample(restir, passes, 20u, 4u);
+    const auto   restir_time  = timer.elapsed();
+    const double restir_error = rel_mse(restir.img, reference.img);
+
+    write_ppm(restir.img, "restir.ppm");
+
+    // inverse of the time needed to reach unit error
+    auto efficiency = [](const double error, const auto time) noexcept {
+        return 1. / (error * std::chrono::duration<double>(time).count());
+    };
+    auto report = [&](const std::string_view name, const double error, const auto time) {
+        fmt::print("{}: {} passes, {} threads: {}, relMSE {:.5f}, efficiency {:.2f}\n",
+                   name,
+                   passes,
+                   threads,
+                   std::chrono::duration_cast<std::chrono::milliseconds>(time),
+                   error,
+                   efficiency(error, time));
+    };
+    report("BSDF sampling", pt_error, pt_time);
+    report("Resampling", ris_error, ris_time);
+    report("Spatiotemporal resampling", restir_error, restir_time);
+    log.append("{},{:%Y%m%d},{},{},{},{},{},{},{},{},{}\n",
+               repo_hash,
+               fmt::localtime(std::time(nullptr)),
+               threads,
+               passes,
+               num_candidates,
+               pt_time,
+               pt_error,
+               ris_time,
+               ris_error,
+               restir_time,
+               restir_error);
+
+    return 0;
+}
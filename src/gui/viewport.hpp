@@ -218,6 +218,15 @@ class _Viewport
         return res;
     }
 
+    // in screen coordinates, like cursor positions, unlike the framebuffer resolution
+    static Vec2i
+    get_window_size() noexcept
+    {
+        int width, height;
+        glfwGetWindowSize(window, &width, &height);
+        return Vec2i(width, height);
+    }
+
     template <typename Format>
     static void
     load_img(const lucid::ScanlineImage<Format, 4>& img) noexcept
@@ -307,6 +316,12 @@ class _Viewport
             return _Viewport::get_res();
         }
 
+        Vec2i
+        get_window_size() const noexcept
+        {
+            return _Viewport::get_window_size();
+        }
+
         template <typename Format>
         void
         load_img(const lucid::ScanlineImage<Format, 4>& img) const noexcept
@@ -8,9 +8,14 @@
 
 #include <fmt/ostream.h>
 
+#include <bit>
+#include <cstdint>
 #include <filesystem>
 #include <fstream>
+#include <optional>
+#include <string>
 #include <string_view>
+#include <vector>
 
 namespace fs = std::filesystem;
 
@@ -31,4 +36,82 @@ write_ppm(const ScanlineImage<T, NC, Alloc>& img, const fs::path& filename)
     }
 }
 
+/// @brief Write floating point image in Portable Float Map format.
+///
+/// Single channel images are written as grayscale, others as RGB
+/// with extra channels dropped.
+/// Values are stored unclamped, so the format suits HDR data and AOVs.
+template <typename T, std::size_t NC, typename Alloc>
+void
+write_pfm(const ScanlineImage<T, NC, Alloc>& img, const fs::path& filename)
+{
+    static_assert(NC == 1 || NC >= 3, "PFM stores either grayscale or RGB images.");
+    constexpr std::size_t out_nc = NC == 1 ? 1 : 3;
+
+    std::ofstream os(filename, std::ios_base::out | std::ios_base::binary);
+    const auto [w, h] = img.res();
+    // negative scale stands for little endian data
+    fmt::print(os, "{}\n{} {}\n-1.0\n", out_nc == 1 ? "Pf" : "PF", w, h);
+
+    // scanlines go from bottom to top
+    std::vector<float> row(w * out_nc);
+    for(unsigned j = h; j-- > 0u;)
+    {
+        for(unsigned i = 0u; i < w; ++i)
+        {
+            const auto pix = img[Vec2u(i, j)];
+            for(std::size_t c = 0ul; c < out_nc; ++c)
+                row[i * out_nc + c] = static_cast<float>(pix[c]);
+        }
+        os.write(reinterpret_cast<const char*>(row.data()),
+                 static_cast<std::streamsize>(row.size() * sizeof(float)));
+    }
+}
+
+/// @brief Read Portable Float Map as an RGB image.
+///
+/// Grayscale images are expanded to RGB.
+/// @return empty optional if the file cannot be read or is not a valid PFM.
+inline std::optional<ScanlineImage<float, 3>>
+read_pfm(const fs::path& filename)
+{
+    std::ifstream is(filename, std::ios_base::in | std::ios_base::binary);
+    std::string   type;
+    unsigned      w     = 0u;
+    unsigned      h     = 0u;
+    float         scale = 0.f;
+    is >> type >> w >> h >> scale;
+    // single whitespace character separates the header from the data
+    is.get();
+    if(!is || (type != "PF" && type != "Pf") || w == 0u || h == 0u || scale == 0.f)
+        return std::nullopt;
+
+    const std::size_t in_nc = type == "PF" ? 3ul : 1ul;
+    // negative scale stands for little endian data
+    const bool swap     = (scale < 0.f) != (std::endian::native == std::endian::little);
+    auto       byteswap = [](const float val) noexcept {
+        const auto bits = std::bit_cast<std::uint32_t>(val);
+        return std::bit_cast<float>((bits >> 24u) | ((bits >> 8u) & 0xff00u) |
+                                    ((bits << 8u) & 0xff0000u) | (bits << 24u));
+    };
+
+    ScanlineImage<float, 3> img(Vec2u(w, h));
+    std::vector<float>      row(w * in_nc);
+    // scanlines go from bottom to top
+    for(unsigned j = h; j-- > 0u;)
+    {
+        is.read(reinterpret_cast<char*>(row.data()),
+                static_cast<std::streamsize>(row.size() * sizeof(float)));
+        if(!is) return std::nullopt;
+
+        if(swap)
+            for(float& val: row) val = byteswap(val);
+        for(unsigned i = 0u; i < w; ++i)
+        {
+            auto pix = img[Vec2u(i, j)];
+            for(std::size_t c = 0ul; c < 3ul; ++c) pix[c] = row[i * in_nc + c % in_nc];
+        }
+    }
+    return img;
+}
 } // namespace lucid
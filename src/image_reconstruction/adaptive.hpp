@@ -0,0 +1,222 @@
+// -*- C++ -*-
+// adaptive.hpp
+//
+
+/// @file
+/// Per-pixel variance estimation and adaptive sample scheduling.
+
+#pragma once
+
+#include <image/image.hpp>
+#include <image_reconstruction/film.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <optional>
+#include <vector>
+
+namespace lucid
+{
+/// @brief Running per-pixel mean and variance of radiance samples.
+///
+/// Estimates are updated with Welford's online algorithm,
+/// so they take constant memory and stay numerically stable
+/// for any number of samples.
+struct PixelStatistics
+{
+    // RGB mean and number of samples
+    ScanlineImage<float, 4> mean;
+    // RGB sum of squared differences from the mean
+    ScanlineImage<float, 3> m2;
+
+    explicit PixelStatistics(const Vec2u& res) : mean(res), m2(res) {}
+
+    /// @brief Account a new sample of pixel @p pidx.
+    void
+    update(const Vec2u& pidx, const RGB& val) noexcept
+    {
+        decltype(auto) pmean  = mean[pidx];
+        decltype(auto) pm2    = m2[pidx];
+        const float    n      = pmean[3] + 1.f;
+        const RGB      old_mu = RGB(pmean);
+        const RGB      delta  = val - old_mu;
+        const RGB      new_mu = old_mu + delta / n;
+        pm2                   = RGB(pm2) + delta * (val - new_mu);
+        pmean                 = RGBA(new_mu, n);
+    }
+
+    /// @brief Account samples of pixel @p pidx of @p other, which are removed from it.
+    ///
+    /// Means and squared differences are combined as in Chan et al.'s parallel algorithm.
+    void
+    merge(const Vec2u& pidx, PixelStatistics& other) noexcept
+    {
+        decltype(auto) pmean = mean[pidx];
+        decltype(auto) pm2   = m2[pidx];
+        decltype(auto) omean = other.mean[pidx];
+        decltype(auto) om2   = other.m2[pidx];
+        const float    na    = pmean[3];
+        const float    nb    = omean[3];
+        const float    n     = na + nb;
+        if(nb > 0.f)
+        {
+            const RGB delta = RGB(omean) - RGB(pmean);
+            pm2             = RGB(pm2) + RGB(om2) + delta * delta * (na * nb / n);
+            pmean           = RGBA(RGB(pmean) + delta * (nb / n), n);
+        }
+        omean = RGBA(0.f);
+        om2   = RGB(0.f);
+    }
+
+    std::size_t
+    count(const Vec2u& pidx) const noexcept
+    {
+        return static_cast<std::size_t>(get_w(mean[pidx]));
+    }
+
+    /// @brief Unbiased sample variance of pixel @p pidx.
+    RGB
+    variance(const Vec2u& pidx) const noexcept
+    {
+        const float n = get_w(mean[pidx]);
+        return n > 1.f ? RGB(m2[pidx]) / (n - 1.f) : RGB(0.f);
+    }
+
+    /// @brief Relative standard error of the pixel mean.
+    ///
+    /// Channels are averaged before comparison,
+    /// so the metric roughly follows perceived brightness.
+    /// Pixels with less than two samples have infinite error.
+    float
+    error(const Vec2u& pidx) const noexcept
+    {
+        const float n = get_w(mean[pidx]);
+        if(n < 2.f) return std::numeric_limits<float>::infinity();
+        const float mu = avg(RGB(mean[pidx]));
+        return std::sqrt(avg(variance(pidx)) / n) / (mu + 1e-3f);
+    }
+
+    /// @brief Maximum error in 3x3 neighbourhood of pixel @p pidx.
+    ///
+    /// With few samples, a pixel can see only zero radiance
+    /// and report no variance at all while its neighbours are still noisy.
+    /// Taking the neighbourhood into account protects such pixels
+    /// from being considered converged prematurely.
+    float
+    window_error(const Vec2u& pidx) const noexcept
+    {
+        const auto [w, h] = mean.res();
+        const auto [i, j] = pidx;
+        float ret         = 0.f;
+        for(unsigned y = j ? j - 1u : j; y <= std::min(j + 1u, h - 1u); ++y)
+            for(unsigned x = i ? i - 1u : i; x <= std::min(i + 1u, w - 1u); ++x)
+                ret = std::max(ret, error(Vec2u(x, y)));
+        return ret;
+    }
+
+    /// @brief Average error over the whole image.
+    float
+    mean_error() const noexcept
+    {
+        double sum = 0.;
+        for(auto it = mean.begin(); it != mean.end(); ++it)
+            sum += std::min(error(it.pos()), 1.f);
+        return static_cast<float>(sum / static_cast<double>(mean.num_pixels()));
+    }
+
+    /// @brief Total number of accounted samples.
+    std::size_t
+    total_count() const noexcept
+    {
+        std::size_t ret = 0ul;
+        for(const auto pix: mean) ret += static_cast<std::size_t>(get_w(pix));
+        return ret;
+    }
+};
+
+/// @brief Hands out pixels to sample in passes, skipping converged ones.
+///
+/// Every pass visits each active pixel once.
+/// When the pass is over, pixels whose neighbourhood error estimate is below threshold
+/// (or that have reached the sample limit) are excluded from subsequent passes,
+/// redirecting the work to noisy regions.
+/// Zero threshold disables convergence test and gives uniform sampling.
+class AdaptiveScheduler
+{
+    std::vector<Vec2u> active;
+    std::size_t        cur  = 0ul;
+    std::size_t        pass = 0ul;
+    float              threshold;
+    std::size_t        min_spp;
+    std::size_t        max_spp;
+
+    void
+    restart(const PixelStatistics& stats) noexcept
+    {
+        // every active pixel is issued exactly one sample per pass
+        ++pass;
+        if(max_spp && pass >= max_spp)
+            active.clear();
+        else
+            std::erase_if(active,
+                          [&](const Vec2u& pidx) noexcept { return converged(stats, pidx); });
+        cur = 0ul;
+    }
+
+  public:
+    /// @param max_spp Sample limit per pixel. Zero is for no limit.
+    AdaptiveScheduler(const Vec2u&      res,
+                      const float       _threshold,
+                      const std::size_t _min_spp = 16ul,
+                      const std::size_t _max_spp = 0ul) :
+        threshold(_threshold),
+        min_spp(std::max(_min_spp, 2ul)), max_spp(_max_spp)
+    {
+        const auto [w, h] = res;
+        active.reserve(product(res));
+        for(unsigned j = 0u; j < h; ++j)
+            for(unsigned i = 0u; i < w; ++i) active.emplace_back(i, j);
+    }
+
+    bool
+    converged(const PixelStatistics& stats, const Vec2u& pidx) const noexcept
+    {
+        return threshold > 0.f && stats.count(pidx) >= min_spp &&
+               stats.window_error(pidx) <= threshold;
+    }
+
+    /// @brief Get the next pixel to sample.
+    /// @return Empty value when every pixel has converged.
+    std::optional<Vec2u>
+    next(const PixelStatistics& stats) noexcept
+    {
+        if(cur == active.size()) restart(stats);
+        if(active.empty()) return std::nullopt;
+        return active[cur++];
+    }
+
+    /// @brief Whether every pixel of the current pass was handed out.
+    ///
+    /// The next pixel starts a new pass, which excludes pixels converged by then.
+    bool
+    end_of_pass() const noexcept
+    {
+        return cur == active.size();
+    }
+
+    /// @brief Number of completed passes.
+    std::size_t
+    passes() const noexcept
+    {
+        return pass;
+    }
+
+    /// @brief Number of pixels still sampled.
+    std::size_t
+    num_active() const noexcept
+    {
+        return active.size();
+    }
+};
+} // namespace lucid
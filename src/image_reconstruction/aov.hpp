@@ -0,0 +1,96 @@
+// -*- C++ -*-
+// aov.hpp
+//
+
+/// @file
+/// Arbitrary output variables (AOVs) accumulated alongside radiance.
+
+#pragma once
+
+#include <image/image.hpp>
+#include <image_reconstruction/film.hpp>
+
+#include <algorithm>
+#include <limits>
+
+namespace lucid
+{
+/// @brief Surface properties seen by a camera ray at its first hit.
+struct AOV
+{
+    RGB         albedo{0};
+    Vec3        normal{0};
+    real        depth        = std::numeric_limits<real>::infinity();
+    std::size_t primitive_id = miss_id;
+
+    static constexpr std::size_t miss_id = std::numeric_limits<std::size_t>::max();
+};
+
+/// @brief Per-pixel AOV images.
+///
+/// Albedo and normal are averaged over the samples of a pixel,
+/// which suits them as auxiliary features for denoising.
+/// Depth and primitive id can't be meaningfully averaged,
+/// so the nearest hit within a pixel is kept instead.
+/// Pixels without any hit have infinite depth and primitive id of -1.
+struct AOVBuffers
+{
+    // RGB mean albedo and number of samples
+    ScanlineImage<float, 4> albedo;
+    ScanlineImage<float, 3> normal;
+    ScanlineImage<float, 1> depth;
+    ScanlineImage<float, 1> primitive_id;
+
+    explicit AOVBuffers(const Vec2u& res) : albedo(res), normal(res), depth(res), primitive_id(res)
+    {
+        for(auto pix: depth) pix[0] = std::numeric_limits<float>::infinity();
+        for(auto pix: primitive_id) pix[0] = -1.f;
+    }
+
+    /// @brief Account AOVs of a new sample of pixel @p pidx.
+    void
+    update(const Vec2u& pidx, const AOV& aov) noexcept
+    {
+        decltype(auto) palbedo = albedo[pidx];
+        decltype(auto) pnormal = normal[pidx];
+        decltype(auto) pdepth  = depth[pidx];
+        const float    n       = palbedo[3] + 1.f;
+        palbedo                = RGBA(RGB(palbedo) + (aov.albedo - RGB(palbedo)) / n, n);
+        pnormal                = Vec3(pnormal) + (aov.normal - Vec3(pnormal)) / n;
+        if(aov.depth < pdepth[0])
+        {
+            pdepth[0]             = static_cast<float>(aov.depth);
+            primitive_id[pidx][0] = static_cast<float>(aov.primitive_id);
+        }
+    }
+
+    /// @brief Account AOVs of pixel @p pidx of @p other, which are reset there.
+    void
+    merge(const Vec2u& pidx, AOVBuffers& other) noexcept
+    {
+        decltype(auto) palbedo = albedo[pidx];
+        decltype(auto) pnormal = normal[pidx];
+        decltype(auto) pdepth  = depth[pidx];
+        decltype(auto) oalbedo = other.albedo[pidx];
+        decltype(auto) onormal = other.normal[pidx];
+        decltype(auto) odepth  = other.depth[pidx];
+        const float    na      = palbedo[3];
+        const float    nb      = oalbedo[3];
+        if(nb > 0.f)
+        {
+            const float n = na + nb;
+            palbedo       = RGBA((RGB(palbedo) * na + RGB(oalbedo) * nb) / n, n);
+            pnormal       = (Vec3(pnormal) * na + Vec3(onormal) * nb) / n;
+        }
+        if(odepth[0] < pdepth[0])
+        {
+            pdepth[0]             = odepth[0];
+            primitive_id[pidx][0] = other.primitive_id[pidx][0];
+        }
+        oalbedo                     = RGBA(0.f);
+        onormal                     = Vec3(0.f);
+        odepth[0]                   = std::numeric_limits<float>::infinity();
+        other.primitive_id[pidx][0] = -1.f;
+    }
+};
+} // namespace lucid
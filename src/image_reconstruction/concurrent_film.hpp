@@ -0,0 +1,131 @@
+// -*- C++ -*-
+// concurrent_film.hpp
+//
+
+/// @file
+/// Film any thread can splat samples into.
+
+#pragma once
+
+#include <image_reconstruction/film.hpp>
+#include <image_reconstruction/filtering.hpp>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace lucid
+{
+/// @brief Image of filter weighted sums of samples any thread can update.
+///
+/// Pixels hold weighted colors and weight sums instead of weighted means,
+/// so an update is a few additions.
+/// Every pixel is guarded by a sequence lock: writers of the same pixel take turns,
+/// while readers never block them and retry if a write happened meanwhile.
+/// A writer takes the lock with a compare-and-swap, retried only while another writer
+/// updates the same pixel, instead of a compare-and-swap loop for each channel.
+class ConcurrentImage
+{
+    struct Pixel
+    {
+        // odd while a writer updates the sums
+        std::atomic_uint32_t seq{0u};
+        // weighted red, green, blue and weight sum
+        std::atomic<float> sums[4] = {0.f, 0.f, 0.f, 0.f};
+    };
+
+    Vec2u              m_res;
+    std::vector<Pixel> m_pixels;
+
+    Pixel&
+    pixel(const Vec2u& pidx) noexcept
+    {
+        CHECK_INDEX(get_x(pidx), get_x(m_res));
+        CHECK_INDEX(get_y(pidx), get_y(m_res));
+        return m_pixels[get_y(pidx) * get_x(m_res) + get_x(pidx)];
+    }
+
+    const Pixel&
+    pixel(const Vec2u& pidx) const noexcept
+    {
+        CHECK_INDEX(get_x(pidx), get_x(m_res));
+        CHECK_INDEX(get_y(pidx), get_y(m_res));
+        return m_pixels[get_y(pidx) * get_x(m_res) + get_x(pidx)];
+    }
+
+  public:
+    explicit ConcurrentImage(const Vec2u& res) : m_res(res), m_pixels(product(res)) {}
+
+    const Vec2u&
+    res() const noexcept
+    {
+        return m_res;
+    }
+
+    void
+    add(const Vec2u& pidx, const RGB& color, const float weight) noexcept
+    {
+        Pixel&        p   = pixel(pidx);
+        std::uint32_t seq = p.seq.load(std::memory_order_relaxed);
+        while((seq & 1u) ||
+              !p.seq.compare_exchange_weak(seq, seq + 1u, std::memory_order_acquire))
+            seq = p.seq.load(std::memory_order_relaxed);
+        // keeps the stores of the sums after the odd sequence readers check against
+        std::atomic_thread_fence(std::memory_order_release);
+
+        const float vals[4] = {color[0] * weight, color[1] * weight, color[2] * weight, weight};
+        for(std::size_t c = 0ul; c < 4ul; ++c)
+            p.sums[c].store(p.sums[c].load(std::memory_order_relaxed) + vals[c],
+                            std::memory_order_relaxed);
+        p.seq.store(seq + 2u, std::memory_order_release);
+    }
+
+    /// @brief Weighted mean color and weight sum, like pixels updated by PixelUpdate.
+    RGBA
+    operator[](const Vec2u& pidx) const noexcept
+    {
+        const Pixel& p = pixel(pidx);
+        float        sums[4];
+        for(;;)
+        {
+            const std::uint32_t seq = p.seq.load(std::memory_order_acquire);
+            if(seq & 1u) continue;
+            for(std::size_t c = 0ul; c < 4ul; ++c)
+                sums[c] = p.sums[c].load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if(p.seq.load(std::memory_order_relaxed) == seq) break;
+        }
+
+        if(sums[3] <= 0.f) return RGBA(0.f);
+        return RGBA(RGB(sums[0], sums[1], sums[2]) / sums[3], sums[3]);
+    }
+};
+
+using ConcurrentFilm = Film<ConcurrentImage>;
+
+/// @brief Splat @p sample into every pixel within the filter radius of @p update.
+///
+/// Safe to call from any number of threads.
+/// Only the filter of @p update is used, as pixels accumulate weighted sums.
+template <typename Updater>
+ConcurrentFilm&
+sample_based_region_update(ConcurrentFilm& film, Updater&& update, const Sample& sample) noexcept
+{
+    const auto& [sample_pos, sample_val] = sample;
+    for(const Vec2u pidx: filter_iterate(film, sample_pos, update.filter.radius))
+    {
+        const real weight = update.filter(film.sample_space(pidx), sample_pos);
+        if(weight > 0_r) film.img.add(pidx, sample_val, static_cast<float>(weight));
+    }
+    return film;
+}
+
+/// @brief Copy weighted means of @p film to @p out, e.g. for display or output.
+template <typename Image>
+void
+resolve(const ConcurrentFilm& film, Film<Image>& out) noexcept
+{
+    for(auto it = out.img.begin(); it != out.img.end(); ++it) *it = film.img[it.pos()];
+}
+} // namespace lucid
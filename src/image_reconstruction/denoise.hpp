@@ -0,0 +1,429 @@
+// -*- C++ -*-
+// denoise.hpp
+//
+
+/// @file
+/// Image space denoising of low sample count renders.
+
+#pragma once
+
+#include <image/image.hpp>
+#include <image_reconstruction/adaptive.hpp>
+#include <image_reconstruction/aov.hpp>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <barrier>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+namespace lucid
+{
+/// @brief Edge-avoiding à-trous wavelet denoiser.
+///
+/// Implements the filter of @cite Dammertz2010ATrous
+/// with the variance-guided luminance weight of @cite 10.1145/3105762.3105770.
+/// Every iteration applies a 5x5 B3-spline kernel with taps spread twice as far as before,
+/// so a few iterations cover a wide footprint at a constant per-pixel cost.
+/// Taps are weighted down across normal discontinuities
+/// and where luminance difference is large compared to the estimated noise level.
+///
+/// The filter runs on illumination: the image is divided by the first hit albedo
+/// before filtering and multiplied back afterwards, so texture-like albedo edges stay sharp.
+///
+/// Images are kept as separate channel planes and every kernel tap is applied
+/// to a whole scanline at once, so the inner loops are free of branches and vectorize.
+/// Scanlines are split between threads which synchronize after each iteration.
+/// The threads are started once with the denoiser and sleep between calls.
+class ATrousDenoiser
+{
+  public:
+    struct Params
+    {
+        unsigned iterations = 5u;
+        // larger values allow more blur across luminance edges
+        float sigma_luminance = 4.f;
+    };
+
+  private:
+    using Plane = std::vector<float>;
+
+    static constexpr std::array<float, 5> kernel{
+        1.f / 16.f, 1.f / 4.f, 3.f / 8.f, 1.f / 4.f, 1.f / 16.f};
+    static constexpr float eps = 1e-4f;
+    // normal similarity is raised to the power of 2^normal_sharpness
+    static constexpr unsigned normal_sharpness = 7u;
+
+    Vec2u    res;
+    Params   params;
+    unsigned threads;
+
+    // illumination and its variance, one for the input and one for the output of an iteration
+    std::array<std::array<Plane, 4>, 2> buffers;
+    Plane                               lum;
+    Plane                               filtered_var;
+    std::array<Plane, 3>                normal;
+    std::array<Plane, 3>                albedo;
+
+    ScanlineImage<float, 4> result;
+
+    // input of the current call
+    const ScanlineImage<float, 4>* input_img   = nullptr;
+    const PixelStatistics*         input_stats = nullptr;
+    const AOVBuffers*              input_aovs  = nullptr;
+
+    // scanline accumulators of each thread
+    std::vector<Plane>       accumulators;
+    std::barrier<>           sync;
+    std::atomic_uint32_t     num_calls{0u};
+    std::atomic_bool         stopping{false};
+    std::vector<std::thread> workers;
+
+    static constexpr float
+    luminance(const float r, const float g, const float b) noexcept
+    {
+        return 0.2126f * r + 0.7152f * g + 0.0722f * b;
+    }
+
+    // albedo to divide illumination by, black surfaces are left as they are
+    static constexpr float
+    modulation(const float a) noexcept
+    {
+        return a > eps ? a : 1.f;
+    }
+
+    void
+    prepare(const ScanlineImage<float, 4>& img,
+            const PixelStatistics&         stats,
+            const AOVBuffers&              aovs,
+            const unsigned                 y0,
+            const unsigned                 y1) noexcept
+    {
+        const auto [w, h]    = res;
+        auto& [r, g, b, var] = buffers[0];
+        for(unsigned y = y0; y < y1; ++y)
+            for(unsigned x = 0u; x < w; ++x)
+            {
+                const Vec2u       pidx(x, y);
+                const std::size_t p = y * w + x;
+                const RGB         c(img[pidx]);
+                const RGB         a(aovs.albedo[pidx]);
+                const Vec3        n(aovs.normal[pidx]);
+                for(std::size_t i = 0ul; i < 3ul; ++i)
+                {
+                    albedo[i][p] = modulation(a[i]);
+                    normal[i][p] = n[i];
+                }
+                r[p] = c[0] / albedo[0][p];
+                g[p] = c[1] / albedo[1][p];
+                b[p] = c[2] / albedo[2][p];
+
+                // variance of the pixel mean, negative for pixels that need a spatial estimate
+                const float n_samples = static_cast<float>(stats.count(pidx));
+                const RGB   v         = stats.variance(pidx);
+                var[p]                = n_samples < 2.f
+                                            ? -1.f
+                                            : luminance(v[0] / (albedo[0][p] * albedo[0][p]),
+                                                        v[1] / (albedo[1][p] * albedo[1][p]),
+                                                        v[2] / (albedo[2][p] * albedo[2][p])) /
+                                                  n_samples;
+            }
+    }
+
+    // replace missing variance with the luminance variance of the 3x3 neighbourhood
+    void
+    estimate_variance(const unsigned y0, const unsigned y1) noexcept
+    {
+        const auto [w, h]    = res;
+        auto& [r, g, b, var] = buffers[0];
+        for(unsigned y = y0; y < y1; ++y)
+            for(unsigned x = 0u; x < w; ++x)
+            {
+                const std::size_t p = y * w + x;
+                if(var[p] >= 0.f) continue;
+                float sum = 0.f, sum2 = 0.f, count = 0.f;
+                for(unsigned j = y ? y - 1u : y; j <= std::min(y + 1u, h - 1u); ++j)
+                    for(unsigned i = x ? x - 1u : x; i <= std::min(x + 1u, w - 1u); ++i)
+                    {
+                        const std::size_t q = j * w + i;
+                        const float       l = luminance(r[q], g[q], b[q]);
+                        sum += l;
+                        sum2 += l * l;
+                        count += 1.f;
+                    }
+                const float mean = sum / count;
+                // written to the output buffer, so neighbours still see the original value
+                lum[p] = std::max(sum2 / count - mean * mean, 0.f);
+            }
+    }
+
+    void
+    commit_variance(const unsigned y0, const unsigned y1) noexcept
+    {
+        const std::size_t w   = get_x(res);
+        Plane&            var = buffers[0][3];
+        for(std::size_t p = y0 * w; p < y1 * w; ++p)
+            if(var[p] < 0.f) var[p] = lum[p];
+    }
+
+    // luminance of the current illumination and 3x3 gaussian blurred variance
+    void
+    prefilter(const std::size_t src, const unsigned y0, const unsigned y1) noexcept
+    {
+        const auto [w, h]          = res;
+        const auto& [r, g, b, var] = buffers[src];
+        for(std::size_t p = y0 * w; p < y1 * w; ++p) lum[p] = luminance(r[p], g[p], b[p]);
+
+        // borders are replicated, so the interior loop has no branches
+        for(unsigned y = y0; y < y1; ++y)
+        {
+            const float* const vm = var.data() + (y ? y - 1u : y) * w;
+            const float* const vc = var.data() + y * w;
+            const float* const vp = var.data() + std::min(y + 1u, h - 1u) * w;
+            float* const       fv = filtered_var.data() + y * w;
+
+            auto blur = [&](const unsigned x, const unsigned xm, const unsigned xp) noexcept {
+                return 0.25f * vc[x] + 0.125f * (vc[xm] + vc[xp] + vm[x] + vp[x]) +
+                       0.0625f * (vm[xm] + vm[xp] + vp[xm] + vp[xp]);
+            };
+
+            for(unsigned x = 1u; x + 1u < w; ++x) fv[x] = blur(x, x - 1u, x + 1u);
+            fv[0]     = blur(0u, 0u, std::min(1u, w - 1u));
+            fv[w - 1] = blur(w - 1u, w > 1u ? w - 2u : 0u, w - 1u);
+        }
+    }
+
+    void
+    filter(const std::size_t src,
+           const unsigned    step,
+           const unsigned    y0,
+           const unsigned    y1,
+           Plane&            acc) noexcept
+    {
+        const auto [w, h]   = res;
+        const float sigma_l = params.sigma_luminance;
+
+        // raw pointers let the compiler keep the loops free of reloads
+        const float* const r       = buffers[src][0].data();
+        const float* const g       = buffers[src][1].data();
+        const float* const b       = buffers[src][2].data();
+        const float* const var     = buffers[src][3].data();
+        float* const       out_r   = buffers[1ul - src][0].data();
+        float* const       out_g   = buffers[1ul - src][1].data();
+        float* const       out_b   = buffers[1ul - src][2].data();
+        float* const       out_var = buffers[1ul - src][3].data();
+        const float* const nx      = normal[0].data();
+        const float* const ny      = normal[1].data();
+        const float* const nz      = normal[2].data();
+        const float* const l       = lum.data();
+        const float* const fvar    = filtered_var.data();
+        float* const       acc_r   = acc.data();
+        float* const       acc_g   = acc_r + w;
+        float* const       acc_b   = acc_g + w;
+        float* const       acc_var = acc_b + w;
+        float* const       acc_w   = acc_var + w;
+        float* const       acc_sd  = acc_w + w;
+
+        for(unsigned y = y0; y < y1; ++y)
+        {
+            const float* const pr  = r + y * w;
+            const float* const pg  = g + y * w;
+            const float* const pb  = b + y * w;
+            const float* const pv  = var + y * w;
+            const float* const pnx = nx + y * w;
+            const float* const pny = ny + y * w;
+            const float* const pnz = nz + y * w;
+            const float* const pl  = l + y * w;
+
+            // the center tap always has the full weight
+            const float kc = kernel[2] * kernel[2];
+            for(unsigned x = 0u; x < w; ++x)
+            {
+                acc_r[x]   = kc * pr[x];
+                acc_g[x]   = kc * pg[x];
+                acc_b[x]   = kc * pb[x];
+                acc_var[x] = kc * kc * pv[x];
+                acc_w[x]   = kc;
+                // reciprocal of luminance edge-stopping scale
+                acc_sd[x] = 1.f / (sigma_l * std::sqrt(fvar[y * w + x]) + eps);
+            }
+
+            for(int dy = -2; dy <= 2; ++dy)
+            {
+                const std::ptrdiff_t yq =
+                    static_cast<std::ptrdiff_t>(y) + dy * static_cast<std::ptrdiff_t>(step);
+                if(yq < 0 || yq >= static_cast<std::ptrdiff_t>(h)) continue;
+
+                for(int dx = -2; dx <= 2; ++dx)
+                {
+                    if(dx == 0 && dy == 0) continue;
+
+                    // taps falling outside the image are skipped
+                    const std::ptrdiff_t off = dx * static_cast<std::ptrdiff_t>(step);
+                    const std::ptrdiff_t lw  = static_cast<std::ptrdiff_t>(w);
+                    const std::ptrdiff_t x0  = std::clamp(-off, std::ptrdiff_t{0}, lw);
+                    const std::ptrdiff_t x1  = std::clamp(lw - off, std::ptrdiff_t{0}, lw);
+                    const float          k   = kernel[dx + 2] * kernel[dy + 2];
+                    // index of the tap of the pixel x is qrow + x, which is never negative
+                    // within [x0, x1), unlike qrow itself
+                    const std::ptrdiff_t qrow = yq * lw + off;
+
+                    // accumulators never alias the inputs
+#if defined(__clang__)
+#pragma clang loop vectorize(assume_safety)
+#elif defined(__GNUC__)
+#pragma GCC ivdep
+#endif
+                    for(std::ptrdiff_t x = x0; x < x1; ++x)
+                    {
+                        const std::ptrdiff_t q = qrow + x;
+                        float wn = std::max(pnx[x] * nx[q] + pny[x] * ny[q] + pnz[x] * nz[q], 0.f);
+                        // fixed power takes a few multiplications instead of a call to pow
+                        for(unsigned i = 0u; i < normal_sharpness; ++i) wn *= wn;
+                        // the exponent is clamped to keep vectorized exp off its slow path
+                        const float wl = std::abs(pl[x] - l[q]) * acc_sd[x];
+                        const float wq = k * wn * std::exp(std::max(-wl, -80.f));
+                        acc_r[x] += wq * r[q];
+                        acc_g[x] += wq * g[q];
+                        acc_b[x] += wq * b[q];
+                        acc_var[x] += wq * wq * var[q];
+                        acc_w[x] += wq;
+                    }
+                }
+            }
+
+            for(unsigned x = 0u; x < w; ++x)
+            {
+                const std::size_t p   = y * w + x;
+                const float       inv = 1.f / acc_w[x];
+                out_r[p]              = acc_r[x] * inv;
+                out_g[p]              = acc_g[x] * inv;
+                out_b[p]              = acc_b[x] * inv;
+                out_var[p]            = acc_var[x] * inv * inv;
+            }
+        }
+    }
+
+    void
+    finalize(const ScanlineImage<float, 4>& img,
+             const std::size_t              src,
+             const unsigned                 y0,
+             const unsigned                 y1) noexcept
+    {
+        const auto [w, h]          = res;
+        const auto& [r, g, b, var] = buffers[src];
+        for(unsigned y = y0; y < y1; ++y)
+            for(unsigned x = 0u; x < w; ++x)
+            {
+                const Vec2u       pidx(x, y);
+                const std::size_t p = y * w + x;
+                const RGB         illumination(r[p], g[p], b[p]);
+                const RGB         a(albedo[0][p], albedo[1][p], albedo[2][p]);
+                result[pidx] = RGBA(illumination * a, get_w(img[pidx]));
+            }
+    }
+
+    // filter rows of the thread @p tid, all threads are done when it returns
+    void
+    run(const unsigned tid) noexcept
+    {
+        const unsigned h   = get_y(res);
+        const unsigned y0  = h * tid / threads;
+        const unsigned y1  = h * (tid + 1u) / threads;
+        Plane&         acc = accumulators[tid];
+
+        prepare(*input_img, *input_stats, *input_aovs, y0, y1);
+        sync.arrive_and_wait();
+        estimate_variance(y0, y1);
+        sync.arrive_and_wait();
+        commit_variance(y0, y1);
+        sync.arrive_and_wait();
+
+        std::size_t src = 0ul;
+        for(unsigned i = 0u; i < params.iterations; ++i, src = 1ul - src)
+        {
+            prefilter(src, y0, y1);
+            sync.arrive_and_wait();
+            filter(src, 1u << i, y0, y1, acc);
+            sync.arrive_and_wait();
+        }
+
+        finalize(*input_img, src, y0, y1);
+        sync.arrive_and_wait();
+    }
+
+    // a worker thread waits for calls until the denoiser is destroyed
+    void
+    serve(const unsigned tid) noexcept
+    {
+        for(std::uint32_t served = 0u;;)
+        {
+            num_calls.wait(served);
+            if(stopping.load()) return;
+            // the next call can't begin before this one is done by every thread
+            served = num_calls.load();
+            run(tid);
+        }
+    }
+
+  public:
+    /// @param _threads Number of threads to run the filter on, including the calling one.
+    ATrousDenoiser(const Vec2u& _res, const Params& _params, const unsigned _threads = 1u) :
+        res(_res), params(_params), threads(std::max(std::min(_threads, get_y(_res)), 1u)),
+        result(_res), accumulators(threads, Plane(get_x(_res) * 6ul)),
+        sync(static_cast<std::ptrdiff_t>(threads))
+    {
+        const std::size_t size = product(res);
+        for(auto& buffer: buffers)
+            for(Plane& plane: buffer) plane.resize(size);
+        for(Plane& plane: normal) plane.resize(size);
+        for(Plane& plane: albedo) plane.resize(size);
+        lum.resize(size);
+        filtered_var.resize(size);
+
+        workers.reserve(threads - 1u);
+        for(unsigned tid = 1u; tid < threads; ++tid)
+            workers.emplace_back([this, tid]() noexcept { serve(tid); });
+    }
+
+    explicit ATrousDenoiser(const Vec2u& _res) : ATrousDenoiser(_res, Params{}) {}
+
+    ATrousDenoiser(const ATrousDenoiser&) = delete;
+    ATrousDenoiser&
+    operator=(const ATrousDenoiser&) = delete;
+
+    ~ATrousDenoiser()
+    {
+        stopping.store(true);
+        num_calls.fetch_add(1u);
+        num_calls.notify_all();
+        for(std::thread& worker: workers) worker.join();
+    }
+
+    /// @brief Denoise @p img.
+    /// @param img Film image with RGB color and filter weight.
+    /// @param stats Sample statistics of @p img pixels.
+    /// @param aovs First hit features of @p img pixels.
+    /// @return Denoised image with the weights of @p img.
+    /// It is owned by the denoiser and gets overwritten by the next call.
+    const ScanlineImage<float, 4>&
+    operator()(const ScanlineImage<float, 4>& img,
+               const PixelStatistics&         stats,
+               const AOVBuffers&              aovs) noexcept
+    {
+        input_img   = &img;
+        input_stats = &stats;
+        input_aovs  = &aovs;
+
+        num_calls.fetch_add(1u);
+        num_calls.notify_all();
+        run(0u);
+
+        return result;
+    }
+};
+} // namespace lucid
@@ -0,0 +1,110 @@
+// -*- C++ -*-
+// film_pool.hpp
+//
+
+/// @file
+/// Private films of worker threads merged by a parallel reduction.
+
+#pragma once
+
+#include <image_reconstruction/film.hpp>
+#include <image_reconstruction/filtering.hpp>
+#include <image_reconstruction/tiles.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace lucid
+{
+/// @brief Buffers workers accumulate samples into without synchronization.
+///
+/// A worker borrows buffers nobody else uses for the time of a task,
+/// so no thread identity is needed and any scheduler works.
+/// With at least as many buffers as workers, free ones are always found.
+/// reduce() merges them pixel by pixel in parallel.
+template <typename Buffers>
+class BufferPool
+{
+    std::vector<Buffers>                buffers;
+    std::unique_ptr<std::atomic_flag[]> busy;
+
+  public:
+    /// @param args Arguments every buffer is constructed from.
+    template <typename... Args>
+    explicit BufferPool(const unsigned num_buffers, const Args&... args) :
+        busy(std::make_unique<std::atomic_flag[]>(std::max(num_buffers, 1u)))
+    {
+        buffers.reserve(std::max(num_buffers, 1u));
+        for(unsigned i = 0u; i < std::max(num_buffers, 1u); ++i) buffers.emplace_back(args...);
+    }
+
+    /// @brief Call @p f with buffers no other thread accesses during the call.
+    template <typename F>
+    void
+    with_buffers(F&& f)
+    {
+        for(std::size_t i = 0ul;; i = (i + 1ul) % buffers.size())
+            if(!busy[i].test_and_set(std::memory_order_acquire))
+            {
+                f(buffers[i]);
+                busy[i].clear(std::memory_order_release);
+                return;
+            }
+    }
+
+    /// @brief Call @p merge with every pixel of an image of @p res and every buffer
+    /// on @p num_threads threads.
+    ///
+    /// Threads merge disjoint tiles, so @p merge may write its pixel without synchronization.
+    /// Must not run concurrently with with_buffers().
+    template <typename Merge>
+    void
+    reduce(const Vec2u& res, const unsigned num_threads, Merge&& merge)
+    {
+        render_tiles(res, 4096ul, num_threads, [&](const Tile& tile, const unsigned) {
+            for(unsigned j = get_y(tile.min); j < get_y(tile.max); ++j)
+                for(unsigned i = get_x(tile.min); i < get_x(tile.max); ++i)
+                    for(auto& private_buffers: buffers) merge(Vec2u(i, j), private_buffers);
+        });
+    }
+};
+
+/// @brief Films workers accumulate samples into without synchronization.
+///
+/// reduce() merges the films into the final one in parallel
+/// and empties them for the next pass.
+template <typename Image>
+class FilmPool
+{
+    BufferPool<Film<Image>> pool;
+
+  public:
+    FilmPool(const Vec2u& res, const unsigned num_films) : pool(num_films, res) {}
+
+    /// @brief Call @p f with a film no other thread accesses during the call.
+    template <typename F>
+    void
+    with_film(F&& f)
+    {
+        pool.with_buffers(std::forward<F>(f));
+    }
+
+    /// @brief Merge samples of all the films into @p film on @p num_threads threads.
+    ///
+    /// Must not run concurrently with with_film().
+    void
+    reduce(Film<Image>& film, const unsigned num_threads)
+    {
+        pool.reduce(
+            film.img.res(), num_threads, [&](const Vec2u& pidx, Film<Image>& private_film) {
+                decltype(auto) pixel_val = private_film.img[pidx];
+                film.img[pidx]           = merge_pixels(film.img[pidx], pixel_val);
+                pixel_val                = RGBA(0_r);
+            });
+    }
+};
+} // namespace lucid
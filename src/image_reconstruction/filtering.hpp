@@ -130,6 +130,19 @@ struct PixelReset
     }
 };
 
+// pixel accumulating the weighted samples of both pixels updated by PixelUpdate
+template <template <typename, std::size_t> typename ContainerA,
+          template <typename, std::size_t> typename ContainerB>
+constexpr RGBA
+merge_pixels(const RGBA_<ContainerA>& a, const RGBA_<ContainerB>& b) noexcept
+{
+    const real weight_a = a.template get<3>();
+    const real weight_b = b.template get<3>();
+    const real weight   = weight_a + weight_b;
+    if(weight <= 0_r) return RGBA(a);
+    return RGBA((RGB(a) * weight_a + RGB(b) * weight_b) / weight, weight);
+}
+
 template <typename Image, typename Updater>
 Film<Image>&
 sample_based_region_update(Film<Image>& film, Updater&& update, const Sample& sample) noexcept
@@ -151,8 +164,8 @@ sample_based_singular_update(Film<Image>& film, Updater&& update, const Sample&
     Vec2u pidx                           = film.pixel_index(sample_pos);
     auto& [i, j]                         = pidx;
     const auto [w, h]                    = film.img.res();
-    i                                    = std::clamp(i, 0u, w);
-    j                                    = std::clamp(j, 0u, h);
+    i                                    = std::clamp(i, 0u, w - 1u);
+    j                                    = std::clamp(j, 0u, h - 1u);
     const Vec2     pixel_ssp             = film.sample_space(pidx);
     decltype(auto) pixel_val             = film.img[pidx];
     pixel_val                            = update(pixel_val, pixel_ssp, sample);
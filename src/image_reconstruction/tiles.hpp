@@ -0,0 +1,68 @@
+// -*- C++ -*-
+// tiles.hpp
+//
+
+/// @file
+/// Rectangular image regions rendered in parallel.
+
+#pragma once
+
+#include <base/types.hpp>
+#include <utils/work_stealing.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <optional>
+#include <utility>
+
+namespace lucid
+{
+/// @brief Pixels with indices in [min, max).
+struct Tile
+{
+    Vec2u min;
+    Vec2u max;
+
+    constexpr std::size_t
+    num_pixels() const noexcept
+    {
+        return static_cast<std::size_t>(get_x(max) - get_x(min)) * (get_y(max) - get_y(min));
+    }
+};
+
+/// @brief Halves of @p tile split across its longer side,
+/// or nothing if it has at most @p max_pixels pixels.
+constexpr std::optional<std::pair<Tile, Tile>>
+split_tile(const Tile& tile, const std::size_t max_pixels) noexcept
+{
+    if(tile.num_pixels() <= std::max(max_pixels, 1ul)) return std::nullopt;
+
+    const auto [x0, y0] = tile.min;
+    const auto [x1, y1] = tile.max;
+    if(x1 - x0 >= y1 - y0)
+    {
+        const unsigned x = x0 + (x1 - x0) / 2u;
+        return std::pair{Tile{tile.min, Vec2u(x, y1)}, Tile{Vec2u(x, y0), tile.max}};
+    }
+    const unsigned y = y0 + (y1 - y0) / 2u;
+    return std::pair{Tile{tile.min, Vec2u(x1, y)}, Tile{Vec2u(x0, y), tile.max}};
+}
+
+/// @brief Call @p render for tiles of at most @p max_pixels pixels covering an image.
+///
+/// Tiles are disjoint, so @p render may write to its pixels without synchronization.
+/// @param render Callable taking a tile and index of the thread rendering it.
+template <typename Render>
+void
+render_tiles(const Vec2u& res,
+             const std::size_t max_pixels,
+             const unsigned num_threads,
+             Render&& render)
+{
+    steal_work(
+        Tile{Vec2u(0u), res},
+        num_threads,
+        [max_pixels](const Tile& tile) noexcept { return split_tile(tile, max_pixels); },
+        std::forward<Render>(render));
+}
+} // namespace lucid
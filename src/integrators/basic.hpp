@@ -4,12 +4,21 @@
 
 #pragma once
 
+#include <image_reconstruction/aov.hpp>
 #include <image_reconstruction/filtering.hpp>
 #include <primitives/primitives.hpp>
 #include <ray_traversal/ray_traversal.hpp>
+#include <sampling/common.hpp>
+#include <sampling/environment_map.hpp>
+#include <sampling/radiance_cache.hpp>
+#include <sampling/sd_tree.hpp>
 #include <utils/tuple.hpp>
 
+#include <algorithm>
+#include <array>
 #include <random>
+#include <tuple>
+#include <type_traits>
 
 namespace lucid
 {
@@ -29,7 +38,7 @@ struct Constant
         const Vec3 pos             = hit_pos(ray, isect);
         const Vec3 n               = lucid::visit(
             pid, [&](const auto& prim) noexcept { return normal(pos, prim); }, *scene);
-        const auto eval     = bsdf(n).first;
+        const auto eval     = std::get<0>(bsdf(n));
         const RGB  color    = eval(n, n);
         const RGB  emission = emit_f();
         const RGB  ret      = isect ? color + emission : RGB(0_r);
@@ -37,7 +46,17 @@ struct Constant
     }
 };
 
-template <typename RandomEngine, typename Scene, typename MaterialGetter>
+/// @brief Unidirectional path tracer.
+/// @tparam OutputAOV Whether to also return first hit AOVs with the sample.
+/// They are taken from the shading of the first bounce and need no extra traversal.
+///
+/// With @p guide set, bounces are sampled from a mixture of BSDF and
+/// the learned incident radiance, and paths are recorded while the guide is training.
+/// With @p cache set, paths are recorded into it and are terminated after
+/// @ref RadianceCache::depth bounces if the cache has an estimate for the reached surface.
+/// With @p environment set, escaping paths gather its radiance, and every bounce also samples
+/// it directly, with both strategies weighted by the power heuristic.
+template <typename RandomEngine, typename Scene, typename MaterialGetter, bool OutputAOV = false>
 struct PathTracer_
 {
     RandomEngine*         g;
@@ -47,12 +66,48 @@ struct PathTracer_
     std::uint8_t          max_depth;
     real                  bias;
     Vec2                  sample_pos;
+    SDTree*               guide       = nullptr;
+    RadianceCache*        cache       = nullptr;
+    EnvironmentMap const* environment = nullptr;
 
-    std::pair<std::size_t, Sample>
+    // only the last vertices of longer paths are recorded
+    static constexpr const std::size_t max_recorded = 16ul;
+
+    struct Vertex
+    {
+        Vec3 pos;
+        Vec3 n;
+        Vec3 wi;
+        RGB  color;
+        RGB  emission;
+        real pdf;
+    };
+
+    using Result = std::conditional_t<OutputAOV,
+                                      std::tuple<std::size_t, Sample, AOV>,
+                                      std::pair<std::size_t, Sample>>;
+
+    Result
     operator()() noexcept
     {
         RGB  radiance{1};
         bool has_rad = false;
+        AOV  aov;
+
+        const bool guided      = guide && guide->trained();
+        const bool guide_train = guide && guide->is_training();
+        const bool recording   = guide_train || cache;
+        const real alpha       = guided ? guide->bsdf_fraction() : 1_r;
+
+        // ring buffer of the last vertices
+        std::array<Vertex, max_recorded> vertices;
+        std::size_t                      num_vertices = 0ul;
+        // radiance leaving the last recorded vertex
+        RGB tail{0};
+        // light from the environment is accumulated separately
+        RGB  throughput{1};
+        RGB  env_radiance{0};
+        real prev_pdf = 0_r; // zero for camera rays, which are not weighted
 
         std::size_t depth = 0ul;
         for(; depth < max_depth; ++depth)
@@ -60,7 +115,17 @@ struct PathTracer_
             const auto& [ro, wo]    = ray;
             const auto [pid, isect] = hider(ray, *scene);
 
-            if(!isect) break;
+            if(!isect)
+            {
+                if(environment)
+                {
+                    const real env_pdf = environment->pdf(wo);
+                    const real weight  = prev_pdf > 0_r ? power_heuristic(prev_pdf, env_pdf) : 1_r;
+                    tail               = environment->radiance(wo) * static_cast<float>(weight);
+                    env_radiance += throughput * tail;
+                }
+                break;
+            }
 
             const auto& [bsdf, emit_f] = (*material_getter)(pid);
             const Vec3 pos             = hit_pos(ray, isect);
@@ -68,14 +133,48 @@ struct PathTracer_
             const Vec3 n = lucid::visit(
                 pid, [&](const auto& prim) noexcept { return normal(pos, prim); }, *scene);
 
-            const auto [eval, sample] = bsdf(n);
+            const auto [eval, sample, pdf] = bsdf(n);
+
+            if(cache && depth >= cache->depth())
+                if(const auto cached = cache->lookup(pos, n))
+                {
+                    radiance *= cached.value();
+                    has_rad = true;
+                    tail    = cached.value();
+                    break;
+                }
+
+            if constexpr(OutputAOV)
+                if(depth == 0ul)
+                {
+                    aov.albedo       = eval(n, n);
+                    aov.normal       = n;
+                    aov.depth        = isect.t;
+                    aov.primitive_id = pid;
+                }
+
+            const auto randf = static_cast<float (*)(RandomEngine&)>(
+                std::generate_canonical<float, 8>);
+            const Vec2 u(generate<2>(randf, *g));
+            const Vec3 p = ro + wo * isect.t;
 
-            const Vec3 wi =
-                normalize(sample(wo,
-                                 Vec2(generate<2>(static_cast<float (*)(RandomEngine&)>(
-                                                      std::generate_canonical<float, 8>),
-                                                  *g))));
-            const RGB color    = eval(wi, wo);
+            Vec3 wi;
+            real wi_pdf = 1_r;
+            RGB  color;
+            if(guided)
+            {
+                // one-sample mixture of BSDF and guiding distributions
+                wi = randf(*g) < alpha ? normalize(sample(wo, u)) : guide->sample(p, u);
+                const real bsdf_pdf = pdf(wi, wo);
+                wi_pdf = alpha * bsdf_pdf + (1_r - alpha) * guide->pdf(p, wi);
+                color  = wi_pdf > 0_r ? eval(wi, wo) * (bsdf_pdf / wi_pdf) : RGB(0_r);
+            }
+            else
+            {
+                wi     = normalize(sample(wo, u));
+                wi_pdf = pdf(wi, wo);
+                color  = eval(wi, wo);
+            }
             const RGB emission = emit_f();
 
             has_rad |= any(emission > 0_r);
@@ -83,17 +182,54 @@ struct PathTracer_
             if(all(almost_equal(color, 0_r, 10)))
             {
                 radiance *= emission;
+                tail = emission;
                 break;
             }
 
-            const Vec3 p = ro + wo * isect.t;
+            // direct light from the environment leaving towards the previous vertex,
+            // which is only gathered where bounces could still escape to it
+            RGB direct{0};
+            if(environment && depth + 1ul < max_depth)
+            {
+                const real              u_env = randf(*g);
+                const EnvironmentSample es =
+                    environment->sample(u_env, Vec2(generate<2>(randf, *g)));
+                const real bsdf_pdf = es.pdf > 0_r ? pdf(es.dir, wo) : 0_r;
+                const real mix_pdf =
+                    guided ? alpha * bsdf_pdf + (1_r - alpha) * guide->pdf(p, es.dir) : bsdf_pdf;
+                if(bsdf_pdf > 0_r && !hider(Ray(p + es.dir * bias, es.dir), *scene).second)
+                    direct = eval(es.dir, wo) * es.radiance *
+                             static_cast<float>(bsdf_pdf / es.pdf *
+                                                power_heuristic(es.pdf, mix_pdf));
+                env_radiance += throughput * direct;
+            }
+
+            if(recording)
+                vertices[num_vertices++ % max_recorded] =
+                    Vertex{p, n, wi, color, emission + direct, wi_pdf};
 
             radiance = radiance * color + emission;
+            throughput *= color;
+            prev_pdf = wi_pdf;
 
             ray = Ray(p + wi * bias, wi);
         }
 
-        return {depth + 1ul, Sample{sample_pos, radiance * has_rad}};
+        // radiance is propagated back from the end of the path
+        const std::size_t first = num_vertices - std::min(num_vertices, max_recorded);
+        for(std::size_t i = num_vertices; i-- > first;)
+        {
+            const auto& [p, vn, wi, color, emission, wi_pdf] = vertices[i % max_recorded];
+            if(guide_train)
+                guide->record(p, wi, static_cast<float>((sum(tail) / 3_r) / wi_pdf));
+            tail = tail * color + emission;
+            if(cache) cache->record(p, vn, tail);
+        }
+
+        if constexpr(OutputAOV)
+            return {depth + 1ul, Sample{sample_pos, radiance * has_rad + env_radiance}, aov};
+        else
+            return {depth + 1ul, Sample{sample_pos, radiance * has_rad + env_radiance}};
     }
 };
 } // namespace lucid
@@ -0,0 +1,315 @@
+// -*- C++ -*-
+// bdpt.hpp
+//
+
+/// @file
+/// Bidirectional path tracing.
+
+#pragma once
+
+#include <image_reconstruction/filtering.hpp>
+#include <primitives/primitives.hpp>
+#include <ray_traversal/ray_traversal.hpp>
+#include <sampling/common.hpp>
+#include <sampling/light_bvh.hpp>
+#include <utils/arena.hpp>
+#include <utils/tuple.hpp>
+
+#include <algorithm>
+#include <limits>
+#include <random>
+#include <span>
+
+namespace lucid
+{
+/// @brief Bidirectional path tracer @cite Veach1997.
+///
+/// Camera and light subpaths are connected in every way that contributes to the traced pixel,
+/// and the connections are weighted with the power heuristic.
+/// Light subpaths start on lights chosen by power, while connections to a single light vertex
+/// choose it from the light hierarchy by its importance to the camera vertex.
+/// Connections of light subpaths directly to the camera would land in other pixels,
+/// so they are not made, and the weights account only for the remaining strategies.
+///
+/// Vertices are kept in a per-thread arena, so paths don't allocate.
+template <typename RandomEngine, typename Scene, typename MaterialGetter>
+struct BidirectionalPathTracer_
+{
+    RandomEngine*         g;
+    Scene const*          scene;
+    MaterialGetter const* material_getter;
+    SceneLights const*    lights;
+    AliasTable const*     light_table;
+    Ray                   ray;
+    std::uint8_t          max_depth;
+    real                  bias;
+    Vec2                  sample_pos;
+
+    struct Vertex
+    {
+        Vec3        pos;
+        Vec3        n;
+        RGB         beta;  // path throughput up to the vertex
+        std::size_t pid;   // camera vertex has none
+        std::size_t light; // index in SceneLights, if the vertex lies on a light
+    };
+
+    static constexpr const std::size_t no_pid = std::numeric_limits<std::size_t>::max();
+
+  private:
+    using RandF = float (*)(RandomEngine&);
+
+    // BSDF value
+    RGB
+    f(const Vertex& v, const Vec3& wi, const Vec3& wo) const noexcept
+    {
+        const auto [eval, sample, pdf] = std::get<0>((*material_getter)(v.pid))(v.n);
+        const real cos_theta           = dot(v.n, wi);
+        return cos_theta > 0_r ? eval(wi, wo) * static_cast<float>(pdf(wi, wo) / cos_theta)
+                               : RGB(0_r);
+    }
+
+    // solid angle density of sampling direction w at a vertex reached from direction w_prev
+    real
+    pdf(const Vertex& v, const Vec3& w, const Vec3& w_prev) const noexcept
+    {
+        const auto [eval, sample, bsdf_pdf] = std::get<0>((*material_getter)(v.pid))(v.n);
+        return bsdf_pdf(w, w_prev);
+    }
+
+    RGB
+    emission(const std::size_t pid) const noexcept
+    {
+        return std::get<1>((*material_getter)(pid))();
+    }
+
+    // area density of sampling v on its light to start a light subpath
+    real
+    light_pdf(const Vertex& v) const noexcept
+    {
+        const real light_area = lucid::visit(
+            v.pid, [](const auto& prim) noexcept { return area(prim); }, *scene);
+        return light_table->pmf(v.light) / light_area;
+    }
+
+    // solid angle density of emitting in direction w
+    real
+    emission_pdf(const Vertex& v, const Vec3& w) const noexcept
+    {
+        const real cos_theta = dot(v.n, w);
+        return lights->bounds[v.light].two_sided ? lucid::abs(cos_theta) / (2_r * Pi)
+                                                 : std::max(cos_theta, 0_r) / Pi;
+    }
+
+    static real
+    to_area(const real pdf_w, const Vertex& from, const Vertex& to) noexcept
+    {
+        const Vec3 d = to.pos - from.pos;
+        return pdf_w * lucid::abs(dot(to.n, normalize(d))) / length2(d);
+    }
+
+    bool
+    visible(const Vertex& a, const Vertex& b) const noexcept
+    {
+        const Vec3 d    = b.pos - a.pos;
+        const real dist = length(d);
+        const Vec3 w    = d / dist;
+        const auto [pid, isect] = hider(Ray(a.pos + w * bias, w), *scene);
+        return !isect || isect.t > dist - 2_r * bias;
+    }
+
+    static real
+    remap0(const real x) noexcept
+    {
+        return x != 0_r ? x : 1_r;
+    }
+
+    // power heuristic weight of a path made by s light and path.size() - s camera vertices
+    real
+    mis_weight(const std::span<const Vertex> path, const std::size_t s) const noexcept
+    {
+        const std::size_t n = path.size();
+        auto dir = [&](const std::size_t from, const std::size_t to) noexcept {
+            return normalize(path[to].pos - path[from].pos);
+        };
+        // density of a vertex being made by the light subpath
+        auto p_light = [&](const std::size_t i) noexcept {
+            if(i == 0ul) return light_pdf(path[0]);
+            if(i == 1ul) return to_area(emission_pdf(path[0], dir(0ul, 1ul)), path[0], path[1]);
+            return to_area(pdf(path[i - 1ul], dir(i - 1ul, i), dir(i - 1ul, i - 2ul)),
+                           path[i - 1ul],
+                           path[i]);
+        };
+        // density of a vertex being made by the camera subpath
+        auto p_camera = [&](const std::size_t i) noexcept {
+            return to_area(pdf(path[i + 1ul], dir(i + 1ul, i), dir(i + 1ul, i + 2ul)),
+                           path[i + 1ul],
+                           path[i]);
+        };
+
+        // Connections to a single light vertex choose it by its importance to the camera vertex
+        // instead of by power, which scales the density of that strategy.
+        const real resampled =
+            lucid::light_pdf(*scene, *lights, path[1].pos, path[1].n, path[0].light) /
+            remap0(p_light(0ul));
+        auto choice = [&](const std::size_t strategy) noexcept {
+            return strategy == 1ul ? resampled : 1_r;
+        };
+
+        // ratios of densities of the other strategies to the density of this one
+        real sum   = 1_r;
+        real ratio = 1_r / choice(s);
+        for(std::size_t i = s; i + 2ul < n; ++i)
+        {
+            ratio *= remap0(p_light(i)) / remap0(p_camera(i));
+            const real r = ratio * choice(i + 1ul);
+            sum += r * r;
+        }
+        ratio = 1_r / choice(s);
+        for(std::size_t i = s; i-- > 0ul;)
+        {
+            ratio *= remap0(p_camera(i)) / remap0(p_light(i));
+            const real r = ratio * choice(i);
+            sum += r * r;
+        }
+        return 1_r / sum;
+    }
+
+    // extend subpath of the given size along r and return its new size
+    std::size_t
+    random_walk(const std::span<Vertex> vertices,
+                std::size_t             size,
+                Ray                     r,
+                RGB                     beta,
+                const bool              from_light,
+                const RandF             randf,
+                std::size_t&            ray_count) const noexcept
+    {
+        while(size < vertices.size())
+        {
+            const auto& [ro, rd]    = r;
+            const auto [pid, isect] = hider(r, *scene);
+            ++ray_count;
+            if(!isect) break;
+
+            const Vec3 pos = ro + rd * isect.t;
+            const Vec3 n   = lucid::visit(
+                pid, [&](const auto& prim) noexcept { return normal(pos, prim); }, *scene);
+            Vertex& v = vertices[size++] = Vertex{pos, n, beta, pid, lights->indices[pid]};
+
+            const auto [eval, sample, bsdf_pdf] = std::get<0>((*material_getter)(pid))(v.n);
+            const Vec2 u(generate<2>(randf, *g));
+            const Vec3 w = normalize(sample(-rd, u));
+            // camera paths are weighted as by the path tracer, light paths by the adjoint BSDF
+            beta *= from_light ? f(v, -rd, w) * static_cast<float>(lucid::abs(dot(n, w)) /
+                                                                   bsdf_pdf(w, -rd))
+                               : eval(w, -rd);
+            if(all(almost_equal(beta, 0_r, 10))) break;
+
+            r = Ray(pos + w * bias, w);
+        }
+        return size;
+    }
+
+  public:
+    std::pair<std::size_t, Sample>
+    operator()() const noexcept
+    {
+        static thread_local Arena arena;
+        arena.reset();
+
+        const auto        randf        = static_cast<RandF>(std::generate_canonical<float, 8>);
+        const std::size_t max_vertices = max_depth + 1ul;
+        std::size_t       ray_count    = 0ul;
+
+        const std::span<Vertex> camera = arena.allocate<Vertex>(max_vertices);
+        const std::span<Vertex> light  = arena.allocate<Vertex>(max_vertices);
+        const std::span<Vertex> path   = arena.allocate<Vertex>(max_vertices);
+
+        camera[0] = Vertex{ray.origin, ray.dir, RGB(1_r), no_pid, SceneLights::no_light};
+        const std::size_t nc = random_walk(camera, 1ul, ray, RGB(1_r), false, randf, ray_count);
+
+        // point on a light with emitted radiance over its density
+        auto light_vertex = [&]() noexcept {
+            const real        u_light = randf(*g);
+            const Vec2        u_pos(generate<2>(randf, *g));
+            const LightSample ls  = sample_light(*scene, *lights, *light_table, u_light, u_pos);
+            const std::size_t pid = lights->pids[ls.light];
+            return Vertex{ls.pos, ls.n, emission(pid) / static_cast<float>(ls.pdf), pid, ls.light};
+        };
+
+        // point on a light chosen by its importance to camera vertex y,
+        // or a vertex without primitive if no light reaches it
+        auto connection_vertex = [&](const Vertex& y) noexcept {
+            const real u_light = randf(*g);
+            const Vec2 u_pos(generate<2>(randf, *g));
+            const auto ls = sample_light(*scene, *lights, y.pos, y.n, u_light, u_pos);
+            if(!ls) return Vertex{y.pos, y.n, RGB(0_r), no_pid, SceneLights::no_light};
+            const std::size_t pid = lights->pids[ls->light];
+            return Vertex{
+                ls->pos, ls->n, emission(pid) / static_cast<float>(ls->pdf), pid, ls->light};
+        };
+
+        light[0]       = light_vertex();
+        std::size_t nl = 1ul;
+        {
+            const bool two_sided = lights->bounds[light[0].light].two_sided;
+            const Vec3 n         = two_sided && randf(*g) < 0.5f ? -light[0].n : light[0].n;
+            const Vec2 u(generate<2>(randf, *g));
+            const Vec3 w     = normalize(sample_cosine_hemisphere(n, u));
+            const real w_pdf = emission_pdf(light[0], w);
+            const RGB  beta  = light[0].beta * static_cast<float>(lucid::abs(dot(n, w)) / w_pdf);
+            if(w_pdf > 0_r)
+                nl = random_walk(
+                    light, 1ul, Ray(light[0].pos + w * bias, w), beta, true, randf, ray_count);
+        }
+
+        // full path of light vertices and t camera vertices ordered from the light
+        auto make_path = [&](const std::span<const Vertex> light_vertices,
+                             const std::size_t             t) noexcept {
+            const std::size_t s = light_vertices.size();
+            std::copy(light_vertices.begin(), light_vertices.end(), path.begin());
+            std::reverse_copy(camera.begin(), camera.begin() + t, path.begin() + s);
+            return std::span<const Vertex>(path.data(), s + t);
+        };
+
+        RGB radiance(0_r);
+        for(std::size_t t = 2ul; t <= nc; ++t)
+        {
+            const Vertex& y      = camera[t - 1ul];
+            const Vec3    y_wo   = normalize(camera[t - 2ul].pos - y.pos);
+            const RGB     y_emit = emission(y.pid);
+
+            // camera subpath hits a light
+            if(any(y_emit > 0_r))
+                radiance +=
+                    y.beta * y_emit * static_cast<float>(mis_weight(make_path({}, t), 0ul));
+
+            for(std::size_t s = 1ul; s <= nl && s + t <= max_vertices; ++s)
+            {
+                // the light vertex is resampled for every camera vertex
+                const Vertex z = s == 1ul ? connection_vertex(y) : light[s - 1ul];
+                if(z.pid == no_pid) continue;
+                const Vec3 d = z.pos - y.pos;
+                const Vec3   w = normalize(d);
+
+                const RGB z_f = s == 1ul ? RGB(emission_pdf(z, -w) > 0_r)
+                                         : f(z, normalize(light[s - 2ul].pos - z.pos), -w);
+                const RGB c   = z.beta * z_f * f(y, w, y_wo) * y.beta;
+                if(all(almost_equal(c, 0_r, 10))) continue;
+
+                ++ray_count;
+                if(!visible(y, z)) continue;
+
+                // the resampled light vertex takes the place of the first one
+                const auto full_path = make_path(
+                    s == 1ul ? std::span<const Vertex>(&z, 1ul) : light.first(s), t);
+                const real geom = lucid::abs(dot(y.n, w)) * lucid::abs(dot(z.n, w)) / length2(d);
+                radiance += c * static_cast<float>(geom * mis_weight(full_path, s));
+            }
+        }
+
+        return {ray_count, Sample{sample_pos, radiance}};
+    }
+};
+} // namespace lucid
@@ -0,0 +1,144 @@
+// -*- C++ -*-
+// photon_mapping.hpp
+//
+
+/// @file
+/// Progressive photon mapping.
+
+#pragma once
+
+#include <image_reconstruction/filtering.hpp>
+#include <primitives/primitives.hpp>
+#include <ray_traversal/ray_traversal.hpp>
+#include <sampling/common.hpp>
+#include <sampling/light_bvh.hpp>
+#include <sampling/photon_map.hpp>
+#include <utils/tuple.hpp>
+
+#include <array>
+#include <random>
+#include <span>
+#include <vector>
+
+namespace lucid
+{
+/// @brief Trace photons from emissive primitives.
+///
+/// Lights are chosen with probability proportional to their power
+/// and emit from a uniformly sampled point into the cosine weighted hemisphere.
+/// Flat lights emit from both sides. A photon is stored at every surface it hits.
+template <typename RandomEngine, typename Scene, typename MaterialGetter>
+struct PhotonTracer_
+{
+    RandomEngine*         g;
+    Scene const*          scene;
+    MaterialGetter const* material_getter;
+    SceneLights const*    lights;
+    AliasTable const*     light_table;
+    std::size_t           num_paths;
+    // power of every photon is divided by the number of paths of the pass
+    real         power_scale;
+    std::uint8_t max_depth;
+    real         bias;
+
+    std::vector<Photon>
+    operator()() const noexcept
+    {
+        const auto randf =
+            static_cast<float (*)(RandomEngine&)>(std::generate_canonical<float, 8>);
+
+        std::vector<Photon> photons;
+        photons.reserve(num_paths * max_depth);
+        for(std::size_t path = 0ul; path < num_paths; ++path)
+        {
+            const real u_light = randf(*g);
+            const auto [light, pos, n, pos_pdf] =
+                sample_light(*scene, *lights, *light_table, u_light, Vec2(generate<2>(randf, *g)));
+            const Vec2 u_dir(generate<2>(randf, *g));
+            const bool two_sided = lights->bounds[light].two_sided;
+            const Vec3 side      = two_sided && randf(*g) < 0.5f ? -n : n;
+            const Vec3 dir       = normalize(sample_cosine_hemisphere(side, u_dir));
+
+            const auto& emit_f = std::get<1>((*material_getter)(lights->pids[light]));
+            // emitted radiance over the density of position, direction and light choice
+            RGB power = emit_f() * static_cast<float>(Pi * (two_sided ? 2_r : 1_r) / pos_pdf *
+                                                      power_scale);
+
+            Ray ray(pos + dir * bias, dir);
+            for(std::uint8_t depth = 0u; depth < max_depth; ++depth)
+            {
+                const auto& [ro, rd]    = ray;
+                const auto [hit, isect] = hider(ray, *scene);
+                if(!isect) break;
+
+                const auto& [bsdf, hit_emit] = (*material_getter)(hit);
+                const Vec3 p                 = ro + rd * isect.t;
+                const Vec3 hn                = lucid::visit(
+                    hit, [&](const auto& prim) noexcept { return normal(p, prim); }, *scene);
+                const auto [eval, sample, pdf] = bsdf(hn);
+
+                photons.push_back(Photon{p, -rd, power});
+
+                // photons are scattered by the BSDF, which is symmetric for the scene materials
+                const Vec2 u(generate<2>(randf, *g));
+                const Vec3 wo = normalize(sample(-rd, u));
+                power *= eval(wo, -rd);
+                if(all(almost_equal(power, 0_r, 10))) break;
+
+                ray = Ray(p + wo * bias, wo);
+            }
+        }
+        return photons;
+    }
+};
+
+/// @brief Estimate radiance at the first hit of a camera ray from nearby photons.
+///
+/// Up to @p max_neighbors photons within the gather radius contribute, and the estimate
+/// is normalized by the area of the disk containing them.
+template <typename Scene, typename MaterialGetter>
+struct PhotonGatherer_
+{
+    Scene const*          scene;
+    MaterialGetter const* material_getter;
+    PhotonMap const*      photon_map;
+    Ray                   ray;
+    real                  radius2;
+    Vec2                  sample_pos;
+
+    static constexpr const std::size_t max_neighbors = 64ul;
+
+    std::pair<std::size_t, Sample>
+    operator()() const noexcept
+    {
+        const auto& [ro, rd]    = ray;
+        const auto [pid, isect] = hider(ray, *scene);
+        if(!isect) return {1ul, Sample{sample_pos, RGB(0_r)}};
+
+        const auto& [bsdf, emit_f] = (*material_getter)(pid);
+        const Vec3 p               = ro + rd * isect.t;
+        const Vec3 n               = lucid::visit(
+            pid, [&](const auto& prim) noexcept { return normal(p, prim); }, *scene);
+        const auto [eval, sample, pdf] = bsdf(n);
+
+        std::array<PhotonMap::Neighbor, max_neighbors> heap;
+        real                                           r2 = radius2;
+        const std::size_t found = photon_map->nearest(p, r2, std::span(heap));
+        // with too few neighbors the gather disk has the pass radius
+        if(found < max_neighbors) r2 = radius2;
+
+        RGB reflected(0_r);
+        for(std::size_t i = 0ul; i < found; ++i)
+        {
+            const auto& [pos, wi, power] = (*photon_map)[heap[i].idx];
+            const real cos_theta         = dot(n, wi);
+            if(cos_theta <= 0_r) continue;
+            // BSDF value is its sampling weight times sampling density over the cosine
+            reflected += power * eval(wi, -rd) * static_cast<float>(pdf(wi, -rd) / cos_theta);
+        }
+        reflected /= static_cast<float>(Pi * r2);
+
+        return {1ul, Sample{sample_pos, reflected + emit_f()}};
+    }
+};
+} // namespace lucid
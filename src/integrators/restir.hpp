@@ -0,0 +1,258 @@
+// -*- C++ -*-
+// restir.hpp
+//
+
+/// @file
+/// Direct lighting with spatiotemporal reservoir resampling.
+
+#pragma once
+
+#include <image_reconstruction/aov.hpp>
+#include <image_reconstruction/filtering.hpp>
+#include <primitives/primitives.hpp>
+#include <ray_traversal/ray_traversal.hpp>
+#include <sampling/light_bvh.hpp>
+#include <sampling/reservoir.hpp>
+#include <utils/tuple.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <random>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+namespace lucid
+{
+/// @brief Point on a light resampled for a pixel.
+struct LightPoint
+{
+    Vec3        pos;
+    Vec3        n;
+    std::size_t light; // index in SceneLights
+};
+
+/// @brief Primary hit of a pixel sample with the lights resampled for it.
+struct ReservoirPixel
+{
+    Vec3                  pos;
+    Vec3                  n;
+    Vec3                  wo;
+    std::size_t           pid = miss_id;
+    RGB                   emission{0};
+    Vec2                  sample_pos;
+    Reservoir<LightPoint> reservoir;
+
+    static constexpr std::size_t miss_id = std::numeric_limits<std::size_t>::max();
+
+    /// @brief Whether reservoirs of the pixels can be reused for each other.
+    ///
+    /// Rejecting neighbors across geometric discontinuities keeps the bias low.
+    bool
+    similar(const ReservoirPixel& other) const noexcept
+    {
+        return pid != miss_id && other.pid != miss_id && dot(n, other.n) > 0.9_r &&
+               length2(pos - other.pos) < 0.01_r;
+    }
+};
+
+/// @brief Reservoirs of every pixel.
+///
+/// Passes resample candidates into @p current, then reuse them spatially into @p previous,
+/// which in turn is reused temporally by the next pass.
+struct ReservoirBuffers
+{
+    Vec2u                       res;
+    std::vector<ReservoirPixel> current;
+    std::vector<ReservoirPixel> previous;
+
+    explicit ReservoirBuffers(const Vec2u& _res)
+        : res(_res), current(product(_res)), previous(product(_res))
+    {
+    }
+
+    std::size_t
+    index(const Vec2u& pidx) const noexcept
+    {
+        return get_y(pidx) * get_x(res) + get_x(pidx);
+    }
+};
+
+/// @brief Unshadowed light reaching the camera from @p lp through the primary hit of @p px.
+///
+/// Its luminance is the target density of resampling.
+template <typename MaterialGetter>
+RGB
+unshadowed_light(const MaterialGetter& material_getter,
+                 const SceneLights&    lights,
+                 const ReservoirPixel& px,
+                 const LightPoint&     lp) noexcept
+{
+    const Vec3 d     = lp.pos - px.pos;
+    const real dist2 = length2(d);
+    if(!(dist2 > 0_r)) return RGB(0_r);
+
+    const Vec3 w     = d / std::sqrt(dist2);
+    const real cos_l = lights.bounds[lp.light].two_sided ? lucid::abs(dot(lp.n, w))
+                                                         : std::max(-dot(lp.n, w), 0_r);
+    const auto& [bsdf, emit_f]     = material_getter(px.pid);
+    const auto [eval, sample, pdf] = bsdf(px.n);
+    // BSDF times cosine, as eval is weighted by the sampling density
+    const RGB f_cos    = eval(w, px.wo) * static_cast<float>(pdf(w, px.wo));
+    const RGB emission = std::get<1>(material_getter(lights.pids[lp.light]))();
+    return f_cos * emission * static_cast<float>(cos_l / dist2);
+}
+
+/// @brief First pass of reservoir resampling of direct lighting @cite Bitterli2020ReSTIR.
+///
+/// Finds the primary hit of a pixel sample, resamples @p num_candidates light points for it,
+/// with lights chosen from the light hierarchy by their importance to the hit,
+/// and merges them with the reservoir the pixel had in the previous pass.
+/// No rays are traced towards the lights.
+/// @tparam OutputAOV Whether to also return the pixel and AOVs of the primary hit.
+template <typename RandomEngine, typename Scene, typename MaterialGetter, bool OutputAOV = false>
+struct ReservoirSampler_
+{
+    RandomEngine*         g;
+    Scene const*          scene;
+    MaterialGetter const* material_getter;
+    SceneLights const*    lights;
+    ReservoirBuffers*     buffers;
+    Ray                   ray;
+    Vec2u                 pixel;
+    Vec2                  sample_pos;
+    unsigned              num_candidates;
+    // history is limited to this many times the candidates of a pass, zero disables reuse
+    unsigned temporal_limit;
+
+    using Result =
+        std::conditional_t<OutputAOV, std::tuple<std::size_t, Vec2u, AOV>, std::size_t>;
+
+    /// @return number of traced rays.
+    Result
+    operator()() const noexcept
+    {
+        const auto randf =
+            static_cast<float (*)(RandomEngine&)>(std::generate_canonical<float, 8>);
+        const std::size_t idx = buffers->index(pixel);
+        ReservoirPixel    px;
+        AOV               aov;
+        px.sample_pos = sample_pos;
+
+        const auto& [ro, wo]    = ray;
+        const auto [pid, isect] = hider(ray, *scene);
+        if(isect)
+        {
+            px.pos = ro + wo * isect.t;
+            px.n   = lucid::visit(
+                pid, [&](const auto& prim) noexcept { return normal(px.pos, prim); }, *scene);
+            px.wo       = wo;
+            px.pid      = pid;
+            px.emission = std::get<1>((*material_getter)(pid))();
+            if constexpr(OutputAOV)
+            {
+                const auto [eval, sample, pdf] = std::get<0>((*material_getter)(pid))(px.n);
+                aov.albedo                     = eval(px.n, px.n);
+                aov.normal                     = px.n;
+                aov.depth                      = isect.t;
+                aov.primitive_id               = pid;
+            }
+
+            for(unsigned i = 0u; i < num_candidates; ++i)
+            {
+                const real u_light = randf(*g);
+                const Vec2 u_pos(generate<2>(randf, *g));
+                const auto ls = sample_light(*scene, *lights, px.pos, px.n, u_light, u_pos);
+                // a point no light reaches is a candidate of zero weight
+                if(!ls)
+                {
+                    px.reservoir.update(LightPoint{}, 0_r, 0_r, randf(*g));
+                    continue;
+                }
+                const LightPoint lp{ls->pos, ls->n, ls->light};
+                const real       target = avg(unshadowed_light(*material_getter, *lights, px, lp));
+                px.reservoir.update(lp, target / ls->pdf, target, randf(*g));
+            }
+
+            const ReservoirPixel& prev = buffers->previous[idx];
+            if(temporal_limit && px.similar(prev))
+            {
+                Reservoir<LightPoint> history = prev.reservoir;
+                history.clamp(temporal_limit * num_candidates);
+                const real target =
+                    avg(unshadowed_light(*material_getter, *lights, px, history.sample));
+                px.reservoir.merge(history, target, randf(*g));
+            }
+        }
+
+        buffers->current[idx] = px;
+        if constexpr(OutputAOV)
+            return {1ul, pixel, aov};
+        else
+            return 1ul;
+    }
+};
+
+/// @brief Second pass of reservoir resampling of direct lighting.
+///
+/// Merges the reservoir of a pixel with reservoirs of random neighbors
+/// and traces a single shadow ray towards the chosen light point.
+/// Reused reservoirs are not tested for visibility, so the result is biased
+/// towards brighter shadows in exchange for far less noise.
+template <typename RandomEngine, typename Scene, typename MaterialGetter>
+struct ReservoirShader_
+{
+    RandomEngine*         g;
+    Scene const*          scene;
+    MaterialGetter const* material_getter;
+    SceneLights const*    lights;
+    ReservoirBuffers*     buffers;
+    Vec2u                 pixel;
+    unsigned              num_neighbors;
+    real                  radius; // in pixels
+    real                  bias;
+
+    std::pair<std::size_t, Sample>
+    operator()() const noexcept
+    {
+        const auto randf =
+            static_cast<float (*)(RandomEngine&)>(std::generate_canonical<float, 8>);
+        ReservoirPixel px = buffers->current[buffers->index(pixel)];
+        if(px.pid == ReservoirPixel::miss_id) return {0ul, Sample{px.sample_pos, RGB(0_r)}};
+
+        const auto [w, h] = buffers->res;
+        for(unsigned i = 0u; i < num_neighbors; ++i)
+        {
+            // uniformly distributed in a disk around the pixel
+            const real  r   = radius * std::sqrt(randf(*g));
+            const real  phi = 2_r * Pi * randf(*g);
+            const int   x   = static_cast<int>(get_x(pixel)) + static_cast<int>(r * std::cos(phi));
+            const int   y   = static_cast<int>(get_y(pixel)) + static_cast<int>(r * std::sin(phi));
+            const Vec2u q(static_cast<unsigned>(std::clamp(x, 0, static_cast<int>(w) - 1)),
+                          static_cast<unsigned>(std::clamp(y, 0, static_cast<int>(h) - 1)));
+            const ReservoirPixel& other = buffers->current[buffers->index(q)];
+            if(!px.similar(other)) continue;
+
+            const real target =
+                avg(unshadowed_light(*material_getter, *lights, px, other.reservoir.sample));
+            px.reservoir.merge(other.reservoir, target, randf(*g));
+        }
+        buffers->previous[buffers->index(pixel)] = px;
+
+        const LightPoint& lp       = px.reservoir.sample;
+        const real        weight   = px.reservoir.contribution_weight();
+        RGB               radiance = px.emission;
+        if(!(weight > 0_r)) return {0ul, Sample{px.sample_pos, radiance}};
+
+        const Vec3 d            = lp.pos - px.pos;
+        const real dist         = length(d);
+        const Vec3 dir          = d / dist;
+        const auto [pid, isect] = hider(Ray(px.pos + dir * bias, dir), *scene);
+        if(!isect || isect.t > dist - 2_r * bias)
+            radiance +=
+                unshadowed_light(*material_getter, *lights, px, lp) * static_cast<float>(weight);
+        return {1ul, Sample{px.sample_pos, radiance}};
+    }
+};
+} // namespace lucid
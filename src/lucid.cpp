@@ -2,24 +2,16 @@
 // lucid.cpp
 
 #include <gui/viewport.hpp>
-#include <image_reconstruction/film.hpp>
-#include <image_reconstruction/filtering.hpp>
-#include <integrators/basic.hpp>
-#include <sampling/film.hpp>
-#include <scene/cornell_box.hpp>
+#include <image/io.hpp>
+#include <renderer.hpp>
 #include <utils/argparse.hpp>
-#include <utils/dispatcher.hpp>
 #include <utils/logging.hpp>
 #include <utils/timer.hpp>
-#include <utils/tuple.hpp>
 
 using namespace lucid;
 using namespace std::literals;
 using namespace argparse;
 
-using Image    = ScanlineImage<float, 4>;
-using FilmRGBA = Film<Image>;
-
 struct to_unsigned
 {
     unsigned
@@ -29,96 +21,277 @@ struct to_unsigned
     }
 };
 
+struct to_uint64
+{
+    std::uint64_t
+    operator()(const std::string_view word) const noexcept
+    {
+        return std::strtoull(word.data(), nullptr, 10);
+    }
+};
+
 constexpr std::tuple options{
     option<'r', 2>(to_unsigned{}, {640, 640}, "resolution", "Image resolution.", {"W", "H"}),
     option<'d'>(to_unsigned{}, 4, "depth", "Maximum bounces.", "N"),
-    option<'q'>(to_unsigned{}, 100000, "queue-size", "Task dispatcher queue size.", "Q"),
+    option<'q'>(to_unsigned{}, 100000, "queue-size", "Task dispatcher queue size in samples.", "Q"),
+    option<'b'>(to_unsigned{}, 64, "batch-size", "Number of samples traced by a single task.", "B"),
     option<'f'>([](const std::string_view word) noexcept { return std::atof(word.data()); },
                 2_r,
                 "filter-width",
                 "Pixel filter width.",
-                "W")};
+                "W"),
+    option<'e'>([](const std::string_view word) noexcept { return std::atof(word.data()); },
+                0_r,
+                "error",
+                "Adaptive sampling error threshold. Zero disables adaptive sampling.",
+                "E"),
+    option<'t'>([](const std::string_view word) noexcept { return std::atof(word.data()); },
+                0_r,
+                "time",
+                "Render without the viewport for the given number of seconds.",
+                "S"),
+    option<'n'>([](const std::string_view word) noexcept { return std::atof(word.data()); },
+                0_r,
+                "noise",
+                "Render without the viewport until the mean error is below the given level.",
+                "E"),
+    option<'o'>(identity, "lucid.ppm", "output", "Output image of budgeted rendering.", "FILE"),
+    flag<'a'>(false,
+              "aov",
+              "Write albedo, normal, depth and primitive id PFM images of budgeted rendering."),
+    flag<'D'>(false, "denoise", "Denoise the displayed and the written image."),
+    option<'g'>(to_unsigned{},
+                0,
+                "guide",
+                "Number of path guiding training passes. Zero disables guiding.",
+                "N"),
+    option<'M'>(to_unsigned{}, 64, "guide-memory", "Path guiding memory budget.", "MB"),
+    option<'c'>(to_unsigned{},
+                0,
+                "cache",
+                "Number of bounces after which paths look the radiance cache up. "
+                "Zero disables the cache.",
+                "N"),
+    option<'E'>(identity, "", "environment", "Environment map PFM image.", "FILE"),
+    option<'s'>(to_unsigned{}, 0, "spp", "Sample limit per pixel. Zero is for no limit.", "N"),
+    option<'S'>(to_uint64{},
+                0ul,
+                "seed",
+                "Render deterministically with the given seed, giving the same image "
+                "for any number of threads unless stopped by the time budget. "
+                "Zero renders with a random seed.",
+                "N"),
+    flag<'R'>(false, "restir", "Preview direct lighting only, with reservoir resampling."),
+    flag<'W'>(false,
+              "work-stealing",
+              "Trace passes of budgeted rendering on threads stealing pixels from each other "
+              "instead of dispatching samples from the main thread. "
+              "The time budget is then checked between passes."),
+    flag<'B'>(false,
+              "blue-noise",
+              "Dither random numbers of neighbouring pixels, turning noise into blue noise."),
+    option<'I'>(to_unsigned{},
+                0,
+                "region",
+                "Side of the region under the cursor the viewport refines first. "
+                "Dragging selects a rectangle instead, a right click releases it. "
+                "Zero disables the region.",
+                "N")};
 
 static_assert(!keywords_have_space(options));
 
-static std::random_device                      rd;
-static thread_local std::default_random_engine g(rd());
+static std::random_device rd;
 
-int
-main(int argc, char* argv[])
+// Region of the image the viewport refines first:
+// a square under the cursor or a rectangle selected by dragging.
+struct RegionOfInterest
 {
-    ArgsRange  args(argc, argv);
-    const auto parse_results = parse(options, args, StandardErrorHandler(args, options));
+    Vec2u                res;
+    unsigned             size;
+    // window size in screen coordinates, which cursor positions are in
+    Vec2i                window{res};
+    Vec2u                cursor{res / 2u};
+    std::optional<Vec2u> drag_start{};
+    std::optional<Tile>  selection{};
 
-    const std::uint8_t max_depth    = parse_results.get_opt<'d'>();
-    const unsigned     qsize        = parse_results.get_opt<'q'>();
-    const real         filter_width = parse_results.get_opt<'f'>();
+    Tile
+    region() const noexcept
+    {
+        if(selection) return selection.value();
+        const Vec2u first(max(Vec2i(cursor) - Vec2i(size / 2u), Vec2i(0)));
+        return Tile{first, min(first + size, res)};
+    }
+};
 
-    const Vec2u res(parse_results.get_opt<'r'>());
+// Pixel under the cursor and selection of the region.
+struct RegionMouse
+{
+    RegionOfInterest* roi = nullptr;
 
-    Logger logger(Logger::DEBUG);
+    void
+    operator()(int button, bool pressed, int /*mods*/) noexcept
+    {
+        if(button == GLFW_MOUSE_BUTTON_RIGHT && pressed) roi->selection.reset();
+        if(button != GLFW_MOUSE_BUTTON_LEFT) return;
+        if(pressed)
+            roi->drag_start = roi->cursor;
+        else
+            roi->drag_start.reset();
+    }
+
+    void
+    operator()(const Vec2& pos) noexcept
+    {
+        // window coordinates grow downwards, like pixel rows
+        const Vec2 pixel = pos * Vec2(roi->res) / Vec2(max(roi->window, Vec2i(1)));
+        roi->cursor = Vec2u(min(max(Vec2i(pixel), Vec2i(0)), Vec2i(roi->res) - 1));
+        if(!roi->drag_start) return;
+
+        const Vec2u a = roi->drag_start.value();
+        const Vec2u b = roi->cursor;
+        const Tile  rect{min(a, b), min(max(a, b) + 1u, roi->res)};
+        if(rect.num_pixels() > 1ul) roi->selection = rect;
+    }
+};
+
+// Arrow keys orbit the camera around the center of the box.
+struct CameraOrbit
+{
+    perspective::shoot* cam       = nullptr;
+    bool*               moved     = nullptr;
+    real                azimuth   = 0_r;
+    real                elevation = 0_r;
+
+    void
+    operator()(int key, int action, int /*mods*/) noexcept
+    {
+        if(action != GLFW_PRESS && action != GLFW_REPEAT) return;
+        constexpr real step = radians(5_r);
+        switch(key)
+        {
+        case GLFW_KEY_LEFT: azimuth -= step; break;
+        case GLFW_KEY_RIGHT: azimuth += step; break;
+        case GLFW_KEY_UP: elevation = std::min(elevation + step, radians(80_r)); break;
+        case GLFW_KEY_DOWN: elevation = std::max(elevation - step, -radians(80_r)); break;
+        default: return;
+        }
+
+        const Vec3 eye = Vec3(std::sin(azimuth) * std::cos(elevation),
+                              std::sin(elevation),
+                              std::cos(azimuth) * std::cos(elevation)) *
+                         4_r;
+        *cam   = perspective::shoot(convert_fov(radians(60_r)),
+                                  look_at(eye, Vec3(0_r), Vec3(0_r, 1_r, 0_r)));
+        *moved = true;
+    }
+};
+
+// Render until the time, the noise or the sample budget is exhausted,
+// and write the image, and its AOVs next to it with write_aov.
+void
+render_budget(Renderer&              renderer,
+              const real             time_budget,
+              const real             noise_target,
+              const std::string_view output,
+              const bool             write_aov,
+              ATrousDenoiser* const  denoiser,
+              Logger&                logger)
+{
+    const std::chrono::duration<real> budget(time_budget);
+    ElapsedTimer<>                    timer{};
+    ElapsedTimer<>                    noise_timer{};
+    std::size_t                       ray_count = 0ul;
+
+    bool done = false;
+    while(!done)
+    {
+        const auto [rays, active] = renderer.advance();
+        ray_count += rays;
+        done = !active;
+
+        if(time_budget > 0_r && timer.has_expired(budget)) done = true;
 
-    const perspective::shoot cam        = CornellBox::camera();
-    const constexpr auto     room_geo   = CornellBox::geometry();
-    const constexpr auto     mat_getter = CornellBox::mat_getter();
+        // estimating the error takes a full image traversal, so we don't do it too often,
+        // or only between passes
+        if(noise_target > 0_r && (renderer.checks_between_passes()
+                                      ? renderer.between_passes()
+                                      : noise_timer.has_expired(1s)))
+        {
+            noise_timer.restart();
+            done |= renderer.mean_error() <= noise_target;
+        }
+    }
 
-    const real bias = 0.001_r;
+    ray_count += renderer.finish();
 
-    using PathTracer = PathTracer_<std::default_random_engine,
-                                   std::decay_t<decltype(room_geo)>,
-                                   std::decay_t<decltype(mat_getter)>>;
+    const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(timer.elapsed());
+    write_ppm(renderer.image(denoiser), output);
+    if(write_aov)
+    {
+        const auto aov_path = [&](const std::string_view name) {
+            fs::path ret(output);
+            ret.replace_filename(fmt::format("{}_{}.pfm", ret.stem().string(), name));
+            return ret;
+        };
+        const AOVBuffers& aovs = renderer.aov_buffers();
+        write_pfm(aovs.albedo, aov_path("albedo"));
+        write_pfm(aovs.normal, aov_path("normal"));
+        write_pfm(aovs.depth, aov_path("depth"));
+        write_pfm(aovs.primitive_id, aov_path("primitive_id"));
+    }
+    logger.info("{}: {:.2f} spp, estimated error {:.4f}, time {}, {} MRay/s",
+                output,
+                renderer.spp(),
+                renderer.mean_error(),
+                elapsed,
+                elapsed.count() ? ray_count / elapsed.count() : 0ul);
+}
 
+// Show the image while it is rendered, refining the region of region_size under the cursor
+// first unless it is zero, and starting over when the camera is moved.
+void
+render_viewport(Renderer&             renderer,
+                const Vec2u&          res,
+                const unsigned        region_size,
+                ATrousDenoiser* const denoiser,
+                Logger&               logger)
+{
     try
     {
-        FilmRGBA   film{res};
-        auto       da         = [](auto&&...) noexcept {};
-        auto       viewport   = make_viewport(res, da, da, da);
-        const real filter_rad = film._pixel_radius * filter_width;
+        bool             camera_moved = false;
+        RegionOfInterest roi{res, region_size};
+        auto             da       = [](auto&&...) noexcept {};
+        auto             viewport = make_viewport(
+            res, da, CameraOrbit{&renderer.camera(), &camera_moved}, RegionMouse{&roi});
 
-        viewport.load_img(film.img);
+        viewport.load_img(renderer.image());
         viewport.check_errors();
         logger.debug("OpenGL initialized");
 
-        Dispatcher<PathTracer> dispatcher(qsize);
-        const PixelUpdate      updater{TriangleFilter(filter_rad)};
-
-        auto it = film.img.begin();
-
         std::size_t    avg_mrps = 0ul; // average ray per second
         std::size_t    mnumber  = 0ul; // number of measurements
         ElapsedTimer<> timer{};
 
         while(viewport.active())
         {
-            std::size_t ray_count = 0ul;
-
-            Vec2 sample_pos;
-            do
-            {
-                if(it != film.img.end())
-                    ++it;
-                else
-                    it = film.img.begin();
-                sample_pos = sample_pixel(g, film._pixel_width, film.sample_space(it.pos()));
-            } while(dispatcher.try_submit(PathTracer{
-                &g, &room_geo, &mat_getter, cam(sample_pos), max_depth, bias, sample_pos}));
-
-            while(const auto ret = dispatcher.fetch_result<PathTracer>())
-            {
-                const auto& [depth, sample] = ret.value();
-                film                        = sample_based_singular_update(film, updater, sample);
-                ray_count += depth;
-            }
+            if(std::exchange(camera_moved, false)) renderer.restart();
+
+            const auto ray_count =
+                renderer.advance(region_size ? std::optional(roi.region()) : std::nullopt).first;
 
             const auto elapsed =
                 std::chrono::duration_cast<std::chrono::milliseconds>(timer.restart()).count();
-            const auto mrps = ray_count / elapsed; // MRay/s
+            const auto mrps = elapsed ? ray_count / elapsed : 0ul; // MRay/s
             avg_mrps += mrps;
             ++mnumber;
-            viewport.reload_img(film.img);
+            viewport.reload_img(renderer.image(denoiser));
             viewport.draw();
+            // cursor positions of the events are mapped to pixels with the current window size,
+            // which differs from the framebuffer resolution on HiDPI displays
+            roi.window = viewport.get_window_size();
             glfwPollEvents();
-            logger.debug(Logger::flush, "{} MRay/s", mrps);
+            logger.debug(
+                Logger::flush, "{} MRay/s, {} active pixels", mrps, renderer.num_active());
         }
 
         logger.debug("Average MRay/s: {}", avg_mrps / mnumber);
@@ -131,6 +304,99 @@ main(int argc, char* argv[])
     {
         logger.critical("GLFW init error: {}", er);
     }
+}
+
+int
+main(int argc, char* argv[])
+{
+    ArgsRange  args(argc, argv);
+    const auto parse_results = parse(options, args, StandardErrorHandler(args, options));
+
+    const real          time_budget  = parse_results.get_opt<'t'>();
+    const real          noise_target = parse_results.get_opt<'n'>();
+    const auto          output       = parse_results.get_opt<'o'>();
+    const bool          output_aov   = parse_results.get_opt<'a'>();
+    const bool          denoise      = parse_results.get_opt<'D'>();
+    const unsigned      guide_passes = parse_results.get_opt<'g'>();
+    const std::size_t   guide_memory = parse_results.get_opt<'M'>();
+    const unsigned      cache_depth  = parse_results.get_opt<'c'>();
+    const auto          env_file     = parse_results.get_opt<'E'>();
+    const std::uint64_t seed         = parse_results.get_opt<'S'>();
+    const bool          blue_noise   = parse_results.get_opt<'B'>();
+    const unsigned      region_size  = parse_results.get_opt<'I'>();
+
+    const bool           deterministic = seed != 0ul;
+    const bool           restir        = parse_results.get_opt<'R'>();
+    const bool           stealing      = parse_results.get_opt<'W'>();
+    const bool           budgeted =
+        time_budget > 0_r || noise_target > 0_r || parse_results.get_opt<'s'>();
+    const RenderSettings settings{
+        .res           = Vec2u(parse_results.get_opt<'r'>()),
+        .max_depth     = static_cast<std::uint8_t>(parse_results.get_opt<'d'>()),
+        .batch_size    = std::max(parse_results.get_opt<'b'>(), 1u),
+        .queue_size    = parse_results.get_opt<'q'>(),
+        .filter_width  = static_cast<real>(parse_results.get_opt<'f'>()),
+        .threshold     = static_cast<real>(parse_results.get_opt<'e'>()),
+        .max_spp       = parse_results.get_opt<'s'>(),
+        .need_aov      = output_aov || denoise,
+        .restir        = restir,
+        .deterministic = deterministic,
+        .base_seed     = deterministic ? seed : (static_cast<std::uint64_t>(rd()) << 32u) | rd(),
+        // accumulation order of private buffers depends on the scheduling of workers
+        .private_buffers = budgeted && !deterministic && !restir && !stealing,
+        .work_stealing   = budgeted && !restir && stealing};
+    const Vec2u& res = settings.res;
+
+    Logger logger(Logger::DEBUG);
+
+    std::optional<SDTree> guide;
+    if(guide_passes)
+        guide.emplace(scene_bound(room_geo), SDTree::Params{.memory = guide_memory << 20u});
+
+    std::optional<RadianceCache> cache;
+    if(cache_depth) cache.emplace(RadianceCache::Params{.depth = cache_depth});
+
+    std::optional<EnvironmentMap> environment;
+    if(!std::string_view(env_file).empty())
+    {
+        auto env_img = read_pfm(env_file);
+        if(!env_img)
+        {
+            logger.error("Failed to read environment map {}", env_file);
+            return 1;
+        }
+        environment.emplace(std::move(env_img.value()));
+    }
+
+    if(deterministic && (guide_passes || cache_depth))
+        logger.warning("Path guiding and the radiance cache are trained concurrently, "
+                       "so the image is not deterministic");
+
+    std::optional<BlueNoiseMask> mask;
+    if(blue_noise) mask.emplace();
+
+    std::optional<ATrousDenoiser> denoiser;
+    if(denoise)
+        denoiser.emplace(res, ATrousDenoiser::Params{}, std::thread::hardware_concurrency());
+
+    const auto ptr = [](auto& opt) noexcept { return opt ? &opt.value() : nullptr; };
+    Renderer   renderer(settings, ptr(guide), ptr(cache), ptr(environment), ptr(mask));
+
+    renderer.train_guide(guide_passes, logger);
+
+    if(budgeted)
+    {
+        render_budget(renderer,
+                      time_budget,
+                      noise_target,
+                      output,
+                      output_aov,
+                      ptr(denoiser),
+                      logger);
+        return 0;
+    }
+
+    render_viewport(renderer, res, region_size, ptr(denoiser), logger);
 
     logger.debug("Good bye.");
 
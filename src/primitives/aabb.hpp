@@ -151,6 +151,15 @@ bound(const AABB_<Container>& prim) noexcept
     return prim;
 }
 
+/// @brief Compute AABB surface area.
+template <template <typename, std::size_t> typename Container>
+constexpr real
+area(const AABB_<Container>& prim) noexcept
+{
+    const auto& [x, y, z] = prim.vmax - prim.vmin;
+    return 2_r * (x * y + y * z + z * x);
+}
+
 /// @brief Apply transformation matrix to AABB.
 template <template <typename, std::size_t> typename MatContainer,
           template <typename, std::size_t>
@@ -97,6 +97,14 @@ bound(const Disk_<Container>& prim) noexcept
     return AABB{p - offset, p + offset};
 }
 
+/// @brief Compute surface area of a disk.
+template <template <typename, std::size_t> typename Container>
+constexpr real
+area(const Disk_<Container>& prim) noexcept
+{
+    return Pi * static_pow<2>(prim.radius);
+}
+
 /// @brief Transform disk with a transformation matrix.
 template <template <typename, std::size_t> typename MatContainer,
           template <typename, std::size_t>
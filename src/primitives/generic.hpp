@@ -64,6 +64,13 @@ bound(const std::variant<Prims...>& prim) noexcept
     return std::visit([](const auto& held_prim) noexcept { return bound(held_prim); }, prim);
 }
 
+template <typename... Prims>
+constexpr real
+area(const std::variant<Prims...>& prim) noexcept
+{
+    return std::visit([](const auto& held_prim) noexcept { return area(held_prim); }, prim);
+}
+
 template <template <typename, size_t> typename MatContainer, typename... Prims>
 constexpr std::variant<Prims...>
 apply_transform(const Mat4_<MatContainer>& t, const std::variant<Prims...>& prim) noexcept
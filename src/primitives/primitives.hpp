@@ -18,6 +18,7 @@ MK_FN_OBJ(normal)
 MK_FN_OBJ(sample)
 MK_FN_OBJ(centroid)
 MK_FN_OBJ(bound)
+MK_FN_OBJ(area)
 
 namespace fn
 {
@@ -170,6 +170,15 @@ bound(const Quad_<Container>& prim) noexcept
     return detail::bound(prim);
 }
 
+/// @brief Compute surface area of a planar quadrilateral.
+template <template <typename, size_t> typename Container>
+constexpr real
+area(const Quad_<Container>& prim) noexcept
+{
+    const auto& [v00, v01, v11, v10] = prim;
+    return 0.5_r * length(cross(v11 - v00, v10 - v01));
+}
+
 /// @brief Transform a quadrilateral using a transformation matrix.
 template <template <typename, size_t> typename MatContainer,
           template <typename, size_t>
@@ -94,6 +94,14 @@ bound(const Sphere_<Container>& prim) noexcept
     return AABB{c - r, c + r};
 }
 
+/// @brief Compute surface area of a sphere.
+template <template <typename, size_t> typename Container>
+constexpr real
+area(const Sphere_<Container>& prim) noexcept
+{
+    return 4_r * Pi * static_pow<2>(prim.radius);
+}
+
 /// @brief Change sphere position using a transformation matrix.
 template <template <typename, size_t> typename MatContainer,
           template <typename, size_t>
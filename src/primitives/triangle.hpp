@@ -101,8 +101,14 @@ template <typename Prim>
 constexpr AABB
 bound(const Prim& prim) noexcept
 {
-    const Vec3 vmin = fold_tuple(lucid::min, prim);
-    const Vec3 vmax = fold_tuple(lucid::max, prim);
+    // vertices are copied, so primitives referencing static data are supported too
+    Vec3 vmin(std::get<0>(prim));
+    Vec3 vmax(std::get<0>(prim));
+    for(const auto& v: prim)
+    {
+        vmin = lucid::min(vmin, Vec3(v));
+        vmax = lucid::max(vmax, Vec3(v));
+    }
     return AABB{vmin, vmax};
 }
 } // namespace detail
@@ -136,6 +142,15 @@ bound(const Triangle_<Container>& prim) noexcept
     return detail::bound(prim);
 }
 
+/// @brief Compute triangle surface area.
+template <template <typename, std::size_t> typename Container>
+constexpr real
+area(const Triangle_<Container>& prim) noexcept
+{
+    const auto& [v0, v1, v2] = prim;
+    return 0.5_r * length(cross(v1 - v0, v2 - v0));
+}
+
 /// @brief Transform triangle with a transformation matrix.
 template <template <typename, std::size_t> typename MatContainer,
           template <typename, std::size_t>
@@ -0,0 +1,628 @@
+// -*- C++ -*-
+// renderer.hpp
+//
+
+/// @file
+/// Progressive rendering of the Cornell box, shared by lucid and its tests.
+
+#pragma once
+
+#include <image_reconstruction/adaptive.hpp>
+#include <image_reconstruction/aov.hpp>
+#include <image_reconstruction/denoise.hpp>
+#include <image_reconstruction/film.hpp>
+#include <image_reconstruction/film_pool.hpp>
+#include <image_reconstruction/filtering.hpp>
+#include <image_reconstruction/tiles.hpp>
+#include <integrators/basic.hpp>
+#include <integrators/restir.hpp>
+#include <sampling/blue_noise.hpp>
+#include <sampling/environment_map.hpp>
+#include <sampling/film.hpp>
+#include <sampling/radiance_cache.hpp>
+#include <sampling/sd_tree.hpp>
+#include <sampling/seeding.hpp>
+#include <scene/cornell_box.hpp>
+#include <utils/dispatcher.hpp>
+#include <utils/logging.hpp>
+#include <utils/timer.hpp>
+#include <utils/work_stealing.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <optional>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace lucid
+{
+using Image    = ScanlineImage<float, 4>;
+using FilmRGBA = Film<Image>;
+
+static constexpr auto room_geo   = CornellBox::geometry();
+static constexpr auto mat_getter = CornellBox::mat_getter();
+
+using Scene          = std::decay_t<decltype(room_geo)>;
+using MaterialGetter = std::decay_t<decltype(mat_getter)>;
+
+// every sample draws random numbers from a stream of its own
+using RandomEngine     = std::default_random_engine;
+using PathEngine       = DitheredEngine<RandomEngine>;
+using PathTracer       = PathTracer_<PathEngine, Scene, MaterialGetter, true>;
+using PathTracerBatch  = TaskBatch<Seeded<PathTracer, PathEngine>>;
+using ReservoirSampler = ReservoirSampler_<RandomEngine, Scene, MaterialGetter, true>;
+using ReservoirShader  = ReservoirShader_<RandomEngine, Scene, MaterialGetter>;
+using ReservoirSamplerBatch = TaskBatch<Seeded<ReservoirSampler, RandomEngine>>;
+using ReservoirShaderBatch  = TaskBatch<Seeded<ReservoirShader, RandomEngine>>;
+
+// Samples a worker accumulates without synchronization, merged at the end of every pass.
+struct Accumulation
+{
+    FilmRGBA        film;
+    PixelStatistics stats;
+    AOVBuffers      aovs;
+
+    Accumulation(const Vec2u& res, const bool need_aov) :
+        film(res), stats(res), aovs(need_aov ? res : Vec2u(0u))
+    {
+    }
+};
+
+// Traces a batch into the buffers of the worker,
+// returns the numbers of traced rays and of samples.
+struct SplattingBatch
+{
+    PathTracerBatch                    batch;
+    BufferPool<Accumulation>*          pool     = nullptr;
+    PixelUpdate<TriangleFilter> const* updater  = nullptr;
+    bool                               need_aov = false;
+
+    std::pair<std::size_t, std::size_t>
+    operator()() noexcept
+    {
+        const auto  results   = batch();
+        std::size_t ray_count = 0ul;
+        pool->with_buffers([&](Accumulation& acc) noexcept {
+            for(const auto& [depth, sample, aov]: results)
+            {
+                const Vec2u pidx = acc.film.pixel_index(sample.first);
+                sample_based_singular_update(acc.film, *updater, sample);
+                acc.stats.update(pidx, sample.second);
+                if(need_aov) acc.aovs.update(pidx, aov);
+                ray_count += depth;
+            }
+        });
+        return {ray_count, results.size()};
+    }
+};
+
+// samples of the region of interest
+using RegionBatch    = Prioritized<PathTracerBatch, 1u>;
+using TaskDispatcher = Dispatcher<PathTracerBatch,
+                                  RegionBatch,
+                                  SplattingBatch,
+                                  ReservoirSamplerBatch,
+                                  ReservoirShaderBatch>;
+
+struct RenderSettings
+{
+    Vec2u         res;
+    std::uint8_t  max_depth;
+    unsigned      batch_size;
+    unsigned      queue_size;
+    real          filter_width;
+    real          threshold;
+    std::size_t   max_spp;
+    bool          need_aov;
+    bool          restir;
+    bool          deterministic;
+    std::uint64_t base_seed;
+    // Workers accumulate path traced samples into buffers of their own instead of the main
+    // thread. The viewport can't use them, as it shows and restarts the image mid-pass.
+    bool          private_buffers = false;
+    // Passes are traced by threads stealing pixels from each other, with no main thread
+    // involved. Every pixel gets a sample per pass, so they write to the film directly.
+    bool          work_stealing   = false;
+    real          bias            = 0.001_r;
+    unsigned      num_threads     = std::thread::hardware_concurrency();
+};
+
+// Accumulation of the image: the film with its statistics and AOVs, the scheduler
+// and the dispatcher with the count of samples issued to it and received from it.
+// With private buffers, workers accumulate samples and the main thread merges them
+// when every sample of a pass is traced, so the scheduler sees complete statistics.
+// Optional guide, cache, environment and mask are owned by the caller and must outlive it.
+class Renderer
+{
+    RenderSettings        settings;
+    SDTree*               guide;
+    RadianceCache*        cache;
+    EnvironmentMap const* environment;
+    BlueNoiseMask const*  mask;
+
+    perspective::shoot                cam = CornellBox::camera();
+    FilmRGBA                          film;
+    const PixelUpdate<TriangleFilter> updater;
+    PixelStatistics                   stats;
+    AOVBuffers                        aovs;
+    AdaptiveScheduler                 scheduler;
+
+    // Reservoirs are resampled for all pixels before any of them is reused by its neighbors.
+    SceneLights      lights;
+    ReservoirBuffers reservoirs;
+    std::uint64_t    restir_passes = 0ul;
+
+    std::optional<BufferPool<Accumulation>> pool;
+    // whether samples of the private buffers are merged into the film
+    bool               merged = true;
+    std::vector<Vec2u> pass_pixels;
+
+    std::size_t     issued   = 0ul;
+    std::size_t     received = 0ul;
+    PathTracerBatch batch;
+    RegionBatch     region_batch;
+    std::uint64_t   region_samples = 0ul;
+
+    // declared last, so that workers are joined before the state their tasks point to is gone
+    TaskDispatcher dispatcher;
+
+    // Path tracing task of a sample of pixel pidx.
+    // Dithered pixels of a mask tile share random numbers, which the mask rotates.
+    Seeded<PathTracer, PathEngine>
+    path_tracer(const Vec2u& pidx, const std::uint64_t sample, SDTree* const guide_tree) noexcept
+    {
+        const auto&         res    = settings.res;
+        const unsigned      tile   = mask ? mask->size() : 1u;
+        const std::uint64_t stream = get_y(pidx) / tile * get_x(res) + get_x(pidx) / tile;
+        PathEngine          engine(
+            seeded_engine<RandomEngine>(stream_seed(settings.base_seed, stream, sample)),
+            mask,
+            pidx);
+        const Vec2 sample_pos = sample_pixel(engine, film, pidx);
+        return Seeded<PathTracer, PathEngine>{PathTracer{nullptr,
+                                                         &room_geo,
+                                                         &mat_getter,
+                                                         cam(sample_pos),
+                                                         settings.max_depth,
+                                                         settings.bias,
+                                                         sample_pos,
+                                                         guide_tree,
+                                                         cache,
+                                                         environment},
+                                              engine};
+    }
+
+    // Submit samples until the task queue is full.
+    // Returns false when every pixel has converged.
+    bool
+    submit() noexcept
+    {
+        bool active = true;
+        while(active)
+        {
+            while(batch.tasks.size() < settings.batch_size)
+            {
+                // A pixel gets one sample per pass. Deterministic passes start only when
+                // the previous one is accumulated, so samples of a pixel are accumulated in
+                // order, and convergence is tested against complete passes.
+                // Private buffers are merged at that point as well.
+                if((settings.deterministic || pool) && scheduler.end_of_pass() &&
+                   (received < issued || !batch.tasks.empty() || !merged))
+                    break;
+                const auto pidx = scheduler.next(stats);
+                if(!pidx)
+                {
+                    active = false;
+                    break;
+                }
+                batch.tasks.push_back(path_tracer(pidx.value(), scheduler.passes(), guide));
+            }
+
+            if(batch.tasks.empty()) break;
+
+            const std::size_t num_tasks = batch.tasks.size();
+            // the batch is left untouched when the queue is full
+            if(pool ? !dispatcher.try_submit(
+                          SplattingBatch{batch, &pool.value(), &updater, settings.need_aov})
+                    : !dispatcher.try_submit(batch))
+                return true;
+            issued += num_tasks;
+            merged = !pool;
+            batch.tasks.clear();
+            batch.tasks.reserve(settings.batch_size);
+        }
+        return active;
+    }
+
+    // Accumulate available results and return the number of traced rays.
+    // Samples of the region of interest come on top of the ones the scheduler issued.
+    std::size_t
+    fetch() noexcept
+    {
+        std::size_t ray_count  = 0ul;
+        auto        accumulate = [&](const auto& results) noexcept {
+            for(const auto& [depth, sample, aov]: results)
+            {
+                const Vec2u pidx = film.pixel_index(sample.first);
+                film             = sample_based_singular_update(film, updater, sample);
+                stats.update(pidx, sample.second);
+                if(settings.need_aov) aovs.update(pidx, aov);
+                ray_count += depth;
+            }
+        };
+        while(const auto ret = dispatcher.fetch_result<RegionBatch>()) accumulate(ret.value());
+        while(const auto ret = dispatcher.fetch_result<PathTracerBatch>())
+        {
+            accumulate(ret.value());
+            received += ret.value().size();
+        }
+        while(const auto ret = dispatcher.fetch_result<SplattingBatch>())
+        {
+            ray_count += ret->first;
+            received += ret->second;
+        }
+        return ray_count;
+    }
+
+    // Merge the private buffers into the film, its statistics and AOVs once no worker
+    // accumulates into them.
+    void
+    merge() noexcept
+    {
+        if(merged || received < issued) return;
+        pool->reduce(settings.res, settings.num_threads, [&](const Vec2u& pidx, Accumulation& acc) {
+            decltype(auto) pixel_val = acc.film.img[pidx];
+            film.img[pidx]           = merge_pixels(film.img[pidx], pixel_val);
+            pixel_val                = RGBA(0_r);
+            stats.merge(pidx, acc.stats);
+            if(settings.need_aov) aovs.merge(pidx, acc.aovs);
+        });
+        merged = true;
+    }
+
+    // Submit up to budget samples of the region, cycling over its pixels,
+    // until the queue of the region is full.
+    void
+    submit_region(const Tile& region, std::size_t budget) noexcept
+    {
+        const unsigned width  = get_x(region.max) - get_x(region.min);
+        const unsigned height = get_y(region.max) - get_y(region.min);
+        if(!region.num_pixels()) return;
+
+        while(budget > 0ul)
+        {
+            while(region_batch.tasks.size() < settings.batch_size)
+            {
+                const std::uint64_t sample = region_samples++;
+                const Vec2u         pidx =
+                    region.min + Vec2u(static_cast<unsigned>(sample % width),
+                                       static_cast<unsigned>(sample / width % height));
+                // streams of the region are apart from the scheduled and the training ones
+                region_batch.tasks.push_back(path_tracer(pidx, (1ul << 62u) | sample, guide));
+            }
+
+            const std::size_t num_tasks = region_batch.tasks.size();
+            if(!dispatcher.try_submit(region_batch)) return;
+            budget -= std::min(budget, num_tasks);
+            region_batch.tasks.clear();
+            region_batch.tasks.reserve(settings.batch_size);
+        }
+    }
+
+    // Trace a pass of the scheduler on threads stealing ranges of its pixels from each other.
+    // Returns the number of traced rays and whether any pixel was left to sample.
+    std::pair<std::size_t, bool>
+    steal_pass() noexcept
+    {
+        constexpr std::size_t range_size = 256ul;
+
+        pass_pixels.clear();
+        while(const auto pidx = scheduler.next(stats))
+        {
+            pass_pixels.push_back(pidx.value());
+            if(scheduler.end_of_pass()) break;
+        }
+        if(pass_pixels.empty()) return {0ul, false};
+
+        using Range = std::pair<std::size_t, std::size_t>;
+        std::atomic_size_t  ray_count{0ul};
+        const std::uint64_t pass = scheduler.passes();
+        steal_work(
+            Range{0ul, pass_pixels.size()},
+            settings.num_threads,
+            [](const Range& range) noexcept -> std::optional<std::pair<Range, Range>> {
+                const auto [first, last] = range;
+                if(last - first <= range_size) return std::nullopt;
+                const std::size_t mid = first + (last - first) / 2ul;
+                return std::pair{Range{first, mid}, Range{mid, last}};
+            },
+            [&](const Range& range, const unsigned) noexcept {
+                std::size_t range_rays = 0ul;
+                for(std::size_t k = range.first; k < range.second; ++k)
+                {
+                    const Vec2u pidx                = pass_pixels[k];
+                    const auto [depth, sample, aov] = path_tracer(pidx, pass, guide)();
+                    decltype(auto) pixel_val        = film.img[pidx];
+                    pixel_val = updater(pixel_val, film.sample_space(pidx), sample);
+                    stats.update(pidx, sample.second);
+                    if(settings.need_aov) aovs.update(pidx, aov);
+                    range_rays += depth;
+                }
+                ray_count.fetch_add(range_rays, std::memory_order_relaxed);
+            });
+        issued += pass_pixels.size();
+        received += pass_pixels.size();
+        return {ray_count.load(), true};
+    }
+
+    // Render a pass of direct lighting with reservoir resampling over every pixel.
+    // Returns the number of traced rays.
+    std::size_t
+    restir_pass() noexcept
+    {
+        constexpr unsigned num_candidates = 16u;
+        constexpr unsigned temporal_limit = 20u;
+        constexpr unsigned num_neighbors  = 4u;
+        constexpr real     radius         = 16_r;
+
+        const auto&           res       = settings.res;
+        std::size_t           ray_count = 0ul;
+        std::size_t           pending   = 0ul;
+        const std::uint64_t   pass      = restir_passes++;
+        ReservoirSamplerBatch samplers;
+        ReservoirShaderBatch  shaders;
+        samplers.epoch = dispatcher.epoch();
+        shaders.epoch  = dispatcher.epoch();
+
+        auto drain_samplers = [&]() noexcept {
+            while(const auto ret = dispatcher.fetch_result<ReservoirSamplerBatch>())
+                for(const auto& [rays, pidx, aov]: ret.value())
+                {
+                    if(settings.need_aov) aovs.update(pidx, aov);
+                    ray_count += rays;
+                    --pending;
+                }
+        };
+        auto drain_shaders = [&]() noexcept {
+            while(const auto ret = dispatcher.fetch_result<ReservoirShaderBatch>())
+                for(const auto& [rays, sample]: ret.value())
+                {
+                    film = sample_based_singular_update(film, updater, sample);
+                    stats.update(film.pixel_index(sample.first), sample.second);
+                    ray_count += rays;
+                    --pending;
+                    ++received;
+                }
+        };
+        auto flush = [&](auto& batch, auto&& drain) noexcept {
+            pending += batch.tasks.size();
+            while(!dispatcher.try_submit(batch)) drain();
+            batch.tasks.clear();
+        };
+
+        for(unsigned j = 0u; j < get_y(res); ++j)
+            for(unsigned i = 0u; i < get_x(res); ++i)
+            {
+                const Vec2u         pidx(i, j);
+                const std::uint64_t pixel  = j * get_x(res) + i;
+                auto                engine = seeded_engine<RandomEngine>(
+                    stream_seed(settings.base_seed, pixel, 2ul * pass));
+                const Vec2 sample_pos = sample_pixel(engine, film, pidx);
+                samplers.tasks.push_back({ReservoirSampler{nullptr,
+                                                           &room_geo,
+                                                           &mat_getter,
+                                                           &lights,
+                                                           &reservoirs,
+                                                           cam(sample_pos),
+                                                           pidx,
+                                                           sample_pos,
+                                                           num_candidates,
+                                                           temporal_limit},
+                                          engine});
+                if(samplers.tasks.size() == settings.batch_size) flush(samplers, drain_samplers);
+            }
+        if(!samplers.tasks.empty()) flush(samplers, drain_samplers);
+        while(pending) drain_samplers();
+
+        issued += product(res);
+        for(unsigned j = 0u; j < get_y(res); ++j)
+            for(unsigned i = 0u; i < get_x(res); ++i)
+            {
+                const std::uint64_t pixel = j * get_x(res) + i;
+                shaders.tasks.push_back(
+                    {ReservoirShader{nullptr,
+                                     &room_geo,
+                                     &mat_getter,
+                                     &lights,
+                                     &reservoirs,
+                                     Vec2u(i, j),
+                                     num_neighbors,
+                                     radius,
+                                     settings.bias},
+                     seeded_engine<RandomEngine>(
+                         stream_seed(settings.base_seed, pixel, 2ul * pass + 1ul))});
+                if(shaders.tasks.size() == settings.batch_size) flush(shaders, drain_shaders);
+            }
+        if(!shaders.tasks.empty()) flush(shaders, drain_shaders);
+        while(pending) drain_shaders();
+
+        return ray_count;
+    }
+
+  public:
+    Renderer(const RenderSettings&       _settings,
+             SDTree* const               _guide       = nullptr,
+             RadianceCache* const        _cache       = nullptr,
+             EnvironmentMap const* const _environment = nullptr,
+             BlueNoiseMask const* const  _mask        = nullptr) :
+        settings(_settings),
+        guide(_guide), cache(_cache), environment(_environment), mask(_mask), film(settings.res),
+        updater(TriangleFilter(film._pixel_radius * settings.filter_width)), stats(settings.res),
+        aovs(settings.need_aov ? settings.res : Vec2u(0u)),
+        scheduler(settings.res, settings.threshold, 16ul, settings.max_spp),
+        lights(collect_lights(room_geo, mat_getter)),
+        reservoirs(settings.restir ? settings.res : Vec2u(0u)),
+        dispatcher(std::max(settings.queue_size / settings.batch_size, 1u), settings.num_threads)
+    {
+        batch.tasks.reserve(settings.batch_size);
+        if(settings.private_buffers)
+            pool.emplace(settings.num_threads, settings.res, settings.need_aov);
+    }
+
+    // tasks in flight point into the renderer
+    Renderer(const Renderer&) = delete;
+    Renderer&
+    operator=(const Renderer&) = delete;
+
+    // Guiding is learned from passes of doubling sample counts, which are then discarded.
+    void
+    train_guide(const unsigned num_passes, Logger& logger) noexcept
+    {
+        const auto& res = settings.res;
+        for(unsigned pass = 0u; pass < num_passes; ++pass)
+        {
+            ElapsedTimer<> timer{};
+            auto           drain = [&]() noexcept {
+                while(const auto ret = dispatcher.fetch_result<PathTracerBatch>())
+                    received += ret.value().size();
+            };
+
+            for(unsigned s = 0u; s < (1u << pass); ++s)
+                for(unsigned j = 0u; j < get_y(res); ++j)
+                    for(unsigned i = 0u; i < get_x(res); ++i)
+                    {
+                        // training streams are apart from the rendered ones
+                        const std::uint64_t sample = (1ul << 63u) | ((1ul << pass) + s);
+                        batch.tasks.push_back(path_tracer(Vec2u(i, j), sample, guide));
+                        if(batch.tasks.size() < settings.batch_size) continue;
+
+                        issued += batch.tasks.size();
+                        while(!dispatcher.try_submit(batch)) drain();
+                        batch.tasks.clear();
+                    }
+            if(!batch.tasks.empty())
+            {
+                issued += batch.tasks.size();
+                while(!dispatcher.try_submit(batch)) drain();
+                batch.tasks.clear();
+            }
+            // the guide must not be read while it is refined
+            while(received < issued) drain();
+
+            guide->refine();
+            logger.debug("Guiding pass {}: {} spp, {} spatial leaves, {:.1f} MB, {}",
+                         pass,
+                         1u << pass,
+                         guide->num_leaves(),
+                         static_cast<real>(guide->memory()) / static_cast<real>(1u << 20u),
+                         std::chrono::duration_cast<std::chrono::milliseconds>(timer.elapsed()));
+        }
+        if(guide) guide->stop_training();
+        issued   = 0ul;
+        received = 0ul;
+    }
+
+    // Submit samples and accumulate the available ones, with region samples first.
+    // Returns the number of traced rays and whether sampling goes on.
+    std::pair<std::size_t, bool>
+    advance(std::optional<Tile> region = std::nullopt) noexcept
+    {
+        // every pass gives every pixel a sample
+        if(settings.restir)
+            return {restir_pass(), !settings.max_spp || restir_passes < settings.max_spp};
+        if(settings.work_stealing) return steal_pass();
+
+        const std::size_t scheduled = issued;
+        const bool        active    = submit();
+        // the region gets at least as many samples as the rest of the image,
+        // and workers take them first
+        if(region)
+            submit_region(region.value(), std::max(issued - scheduled, region->num_pixels()));
+        const std::size_t ray_count = fetch();
+        if(scheduler.end_of_pass()) merge();
+        return {ray_count, active};
+    }
+
+    // Accumulate the samples in flight, which are bounded by the queue size,
+    // and return the number of traced rays.
+    std::size_t
+    finish() noexcept
+    {
+        std::size_t ray_count = 0ul;
+        while(received < issued) ray_count += fetch();
+        merge();
+        return ray_count;
+    }
+
+    // Start over once the camera moved: samples in flight are cancelled, accumulation is reset.
+    void
+    restart() noexcept
+    {
+        ASSERT(!pool, "Private buffers can't be reset under running tasks");
+        batch.epoch = dispatcher.next_epoch();
+        batch.tasks.clear();
+        region_batch.epoch = batch.epoch;
+        region_batch.tasks.clear();
+        film      = FilmRGBA{settings.res};
+        stats     = PixelStatistics{settings.res};
+        scheduler = AdaptiveScheduler(settings.res, settings.threshold, 16ul, settings.max_spp);
+        if(settings.need_aov) aovs = AOVBuffers{settings.res};
+        if(settings.restir) reservoirs = ReservoirBuffers{settings.res};
+        issued   = 0ul;
+        received = 0ul;
+    }
+
+    // Whether every issued sample of the current pass is accumulated.
+    bool
+    between_passes() const noexcept
+    {
+        return settings.restir || (scheduler.end_of_pass() && received == issued && merged);
+    }
+
+    // Whether statistics are to be read between passes only: deterministic rendering stops
+    // at the same pass for any number of threads, private buffers are merged then.
+    bool
+    checks_between_passes() const noexcept
+    {
+        return settings.deterministic || pool;
+    }
+
+    // Accumulated image, denoised with the denoiser if there is one.
+    const Image&
+    image(ATrousDenoiser* const denoiser = nullptr) noexcept
+    {
+        return denoiser ? (*denoiser)(film.img, stats, aovs) : film.img;
+    }
+
+    const AOVBuffers&
+    aov_buffers() const noexcept
+    {
+        return aovs;
+    }
+
+    perspective::shoot&
+    camera() noexcept
+    {
+        return cam;
+    }
+
+    real
+    mean_error() const noexcept
+    {
+        return stats.mean_error();
+    }
+
+    real
+    spp() const noexcept
+    {
+        return static_cast<real>(received) / static_cast<real>(product(settings.res));
+    }
+
+    std::size_t
+    num_active() const noexcept
+    {
+        return scheduler.num_active();
+    }
+};
+} // namespace lucid
@@ -0,0 +1,155 @@
+// -*- C++ -*-
+// alias_table.hpp
+//
+
+/// @file
+/// Constant time discrete sampling.
+
+#pragma once
+
+#include <base/types.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <iterator>
+#include <type_traits>
+#include <vector>
+
+namespace lucid
+{
+/// @brief Bin of an alias table.
+struct AliasBin
+{
+    real          threshold = 1_r; // probability to keep the bin
+    real          pmf       = 0_r;
+    std::uint32_t alias     = 0u;
+};
+
+namespace detail
+{
+template <typename Bins>
+struct alias_indices;
+
+template <std::size_t N>
+struct alias_indices<std::array<AliasBin, N>>
+{
+    using type = std::array<std::uint32_t, N>;
+
+    static constexpr type
+    make(const std::size_t) noexcept
+    {
+        return type{};
+    }
+};
+
+template <>
+struct alias_indices<std::vector<AliasBin>>
+{
+    using type = std::vector<std::uint32_t>;
+
+    static constexpr type
+    make(const std::size_t n)
+    {
+        return type(n);
+    }
+};
+} // namespace detail
+
+/// @brief Walker's alias table with construction by Vose.
+///
+/// Builds in O(N) from non-negative weights, which must not all be zero,
+/// and samples in constant time using a single random number.
+/// @tparam Bins storage: @c std::vector or @c std::array of @c AliasBin.
+/// The latter makes the table constructible at compile time.
+template <typename Bins>
+class AliasTable_
+{
+    Bins bins;
+
+  public:
+    /// @brief Build table from a range of weights.
+    template <typename Weights>
+    constexpr explicit AliasTable_(const Weights& weights) : bins{}
+    {
+        const std::size_t n = std::size(weights);
+        if constexpr(std::is_same_v<Bins, std::vector<AliasBin>>) bins.resize(n);
+
+        real sum = 0_r;
+        for(const auto w: weights) sum += static_cast<real>(w);
+        const real inv_sum = 1_r / sum;
+
+        // small bins are filled with an alias from the large ones
+        using Indices = detail::alias_indices<Bins>;
+        auto          small = Indices::make(n);
+        auto          large = Indices::make(n);
+        std::size_t   ns    = 0ul;
+        std::size_t   nl    = 0ul;
+        std::uint32_t i     = 0u;
+        // the index is written to both stacks to avoid unpredictable branches
+        auto push = [&](const std::uint32_t j) noexcept {
+            const bool is_small = bins[j].threshold < 1_r;
+            small[ns]           = j;
+            large[nl]           = j;
+            ns += is_small;
+            nl += !is_small;
+        };
+        for(const auto w: weights)
+        {
+            bins[i].pmf       = static_cast<real>(w) * inv_sum;
+            bins[i].threshold = bins[i].pmf * static_cast<real>(n);
+            bins[i].alias     = i;
+            push(i);
+            ++i;
+        }
+
+        while(ns && nl)
+        {
+            const std::uint32_t s = small[--ns];
+            const std::uint32_t l = large[--nl];
+            bins[s].alias         = l;
+            bins[l].threshold     = (bins[l].threshold + bins[s].threshold) - 1_r;
+            push(l);
+        }
+
+        // leftovers differ from one only by rounding errors
+        while(ns) bins[small[--ns]].threshold = 1_r;
+        while(nl) bins[large[--nl]].threshold = 1_r;
+    }
+
+    /// @brief Sample index with probability proportional to its weight.
+    /// @param u uniformly distributed random number in [0, 1).
+    ///
+    /// Both the bin and the choice of its alias are taken from @p u,
+    /// so precision of the choice drops with the size of the table.
+    constexpr std::size_t
+    sample(const real u) const noexcept
+    {
+        const real        un = u * static_cast<real>(bins.size());
+        const std::size_t i  = std::min(static_cast<std::size_t>(un), bins.size() - 1ul);
+        const real        up = un - static_cast<real>(i);
+        // the choice is random, so it is made without a branch
+        const std::size_t alias = bins[i].alias;
+        const std::size_t keep  = up < bins[i].threshold;
+        return alias + keep * (i - alias);
+    }
+
+    /// @brief Probability of sampling index @p i.
+    constexpr real
+    pmf(const std::size_t i) const noexcept
+    {
+        return bins[i].pmf;
+    }
+
+    constexpr std::size_t
+    size() const noexcept
+    {
+        return bins.size();
+    }
+};
+
+using AliasTable = AliasTable_<std::vector<AliasBin>>;
+
+template <std::size_t N>
+using StaticAliasTable = AliasTable_<std::array<AliasBin, N>>;
+} // namespace lucid
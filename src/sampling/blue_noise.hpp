@@ -0,0 +1,199 @@
+// -*- C++ -*-
+// blue_noise.hpp
+//
+
+/// @file
+/// Blue noise dithering of random numbers across pixels.
+
+#pragma once
+
+#include <base/types.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+namespace lucid
+{
+/// @brief Tileable mask of values in [0, 1) whose neighbours are far apart.
+///
+/// The mask is made with the void-and-cluster method @cite Ulichney1993:
+/// pixels are ranked by inserting them one by one into the largest void
+/// of the already ranked ones. Each of the rank values appears exactly once,
+/// so the values are uniformly distributed.
+class BlueNoiseMask
+{
+    unsigned          log2_size;
+    std::vector<real> values;
+
+    static constexpr real sigma = 1.5_r;
+
+  public:
+    explicit BlueNoiseMask(const unsigned _log2_size = 6u) :
+        log2_size(_log2_size), values(1ul << (2u * _log2_size))
+    {
+        const int         size = 1 << log2_size;
+        const std::size_t n    = values.size();
+        const int         r    = static_cast<int>(std::ceil(3_r * sigma));
+
+        std::vector<real> kernel;
+        for(int y = -r; y <= r; ++y)
+            for(int x = -r; x <= r; ++x)
+                kernel.push_back(
+                    std::exp(-static_cast<real>(x * x + y * y) / (2_r * sigma * sigma)));
+
+        // energy is the sum of gaussians centered at the ranked pixels on the torus
+        std::vector<real> energy(n, 0_r);
+        std::vector<bool> ranked(n, false);
+        auto              toggle = [&](const std::size_t idx) noexcept {
+            const real sign = ranked[idx] ? -1_r : 1_r;
+            ranked[idx]     = !ranked[idx];
+            const int  cx   = static_cast<int>(idx) & (size - 1);
+            const int  cy   = static_cast<int>(idx) >> log2_size;
+            auto       k    = kernel.begin();
+            for(int y = -r; y <= r; ++y)
+                for(int x = -r; x <= r; ++x, ++k)
+                    energy[(((cy + y) & (size - 1)) << log2_size) | ((cx + x) & (size - 1))] +=
+                        sign * *k;
+        };
+        // ranked pixel of the highest energy or unranked pixel of the lowest one
+        auto extreme = [&](const bool tightest_cluster) noexcept {
+            std::size_t ret  = n;
+            real        best = 0_r;
+            for(std::size_t i = 0ul; i < n; ++i)
+            {
+                if(ranked[i] != tightest_cluster) continue;
+                const real e = tightest_cluster ? energy[i] : -energy[i];
+                if(ret == n || e > best)
+                {
+                    ret  = i;
+                    best = e;
+                }
+            }
+            return ret;
+        };
+
+        // initial pattern is random points relaxed until they are evenly spread
+        std::default_random_engine                 g(0u);
+        std::uniform_int_distribution<std::size_t> idx_dist(0ul, n - 1ul);
+        const std::size_t                          num_initial = std::max(n / 10ul, 1ul);
+        for(std::size_t i = 0ul; i < num_initial;)
+        {
+            const std::size_t idx = idx_dist(g);
+            if(ranked[idx]) continue;
+            toggle(idx);
+            ++i;
+        }
+        for(std::size_t i = 0ul; i < n; ++i)
+        {
+            const std::size_t cluster = extreme(true);
+            toggle(cluster);
+            const std::size_t void_idx = extreme(false);
+            toggle(void_idx);
+            if(void_idx == cluster) break;
+        }
+
+        std::vector<std::size_t> ranks(n);
+        // initial points are ranked by removing the tightest clusters
+        const std::vector<real> initial_energy = energy;
+        const std::vector<bool> initial_ranked = ranked;
+        for(std::size_t count = num_initial; count-- > 0ul;)
+        {
+            const std::size_t cluster = extreme(true);
+            toggle(cluster);
+            ranks[cluster] = count;
+        }
+        energy = initial_energy;
+        ranked = initial_ranked;
+        // the rest by filling the largest voids
+        for(std::size_t count = num_initial; count < n; ++count)
+        {
+            const std::size_t void_idx = extreme(false);
+            toggle(void_idx);
+            ranks[void_idx] = count;
+        }
+
+        for(std::size_t i = 0ul; i < n; ++i)
+            values[i] = (static_cast<real>(ranks[i]) + 0.5_r) / static_cast<real>(n);
+    }
+
+    unsigned
+    size() const noexcept
+    {
+        return 1u << log2_size;
+    }
+
+    /// @brief Value of the mask at the pixel for dimension @p dim of a sample.
+    ///
+    /// Dimensions see the mask shifted by the R2 sequence,
+    /// so values of different dimensions in the same pixel are unrelated.
+    real
+    operator()(const Vec2u& pixel, const std::size_t dim) const noexcept
+    {
+        const real     d     = static_cast<real>(dim);
+        const real     sx    = 0.5_r + d * 0.7548776662_r;
+        const real     sy    = 0.5_r + d * 0.5698402910_r;
+        const unsigned shift = size();
+        const unsigned x = get_x(pixel) + static_cast<unsigned>((sx - std::floor(sx)) * shift);
+        const unsigned y = get_y(pixel) + static_cast<unsigned>((sy - std::floor(sy)) * shift);
+        return values[((y & (shift - 1u)) << log2_size) | (x & (shift - 1u))];
+    }
+};
+
+/// @brief Random engine whose numbers are rotated by a blue noise mask @cite Georgiev2016.
+///
+/// Pixels that share the stream of the underlying engine get numbers
+/// toroidally shifted by the mask values of the pixel, one mask per number drawn.
+/// Each pixel still gets uniformly distributed numbers,
+/// while the error of neighbouring pixels becomes negatively correlated,
+/// and is perceived as high frequency noise instead of white noise.
+/// Without the mask, numbers of the underlying engine are passed through.
+template <typename RandomEngine>
+class DitheredEngine
+{
+    RandomEngine         engine;
+    BlueNoiseMask const* mask = nullptr;
+    Vec2u                pixel{0u};
+    std::size_t          dim = 0ul;
+
+  public:
+    using result_type = typename RandomEngine::result_type;
+
+    DitheredEngine() = default;
+
+    DitheredEngine(const RandomEngine&  _engine,
+                   BlueNoiseMask const* _mask,
+                   const Vec2u&         _pixel) noexcept :
+        engine(_engine),
+        mask(_mask), pixel(_pixel)
+    {
+    }
+
+    static constexpr result_type
+    min() noexcept
+    {
+        return RandomEngine::min();
+    }
+
+    static constexpr result_type
+    max() noexcept
+    {
+        return RandomEngine::max();
+    }
+
+    result_type
+    operator()() noexcept
+    {
+        const result_type x = engine();
+        if(!mask) return x;
+
+        const result_type span = max() - min();
+        const auto        offset =
+            static_cast<result_type>((*mask)(pixel, dim++) * static_cast<double>(span));
+        const result_type d = x - min();
+        return min() + (d <= span - offset ? d + offset : d - (span - offset) - 1u);
+    }
+};
+} // namespace lucid
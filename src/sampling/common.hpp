@@ -18,4 +18,24 @@ sample_hemisphere(const Vec3& n, const Vec2& u) noexcept
     const real phi       = sqrt(1_r - u1 * u1);
     return basis_matrix(n) * Vec3(cos(r) * phi, sin(r) * phi, u1);
 }
+
+/// @brief Sample hemisphere around @p n with density @f$\cos\theta / \pi@f$.
+constexpr Vec3
+sample_cosine_hemisphere(const Vec3& n, const Vec2& u) noexcept
+{
+    const auto& [u1, u2] = u;
+    const real r         = 2_r * Pi * u2;
+    const real rho       = sqrt(u1);
+    return basis_matrix(n) * Vec3(cos(r) * rho, sin(r) * rho, sqrt(1_r - u1));
+}
+
+/// @brief Power heuristic weight of a sample with density @p pdf
+/// against another strategy with density @p other_pdf @cite Veach1997.
+constexpr real
+power_heuristic(const real pdf, const real other_pdf) noexcept
+{
+    const real pdf2 = pdf * pdf;
+    const real sum  = pdf2 + other_pdf * other_pdf;
+    return sum > 0_r ? pdf2 / sum : 0_r;
+}
 } // namespace lucid
@@ -0,0 +1,132 @@
+// -*- C++ -*-
+// environment_map.hpp
+//
+
+/// @file
+/// Distant lighting from a latitude-longitude image.
+
+#pragma once
+
+#include <base/types.hpp>
+#include <base/vector.hpp>
+#include <image/image.hpp>
+#include <sampling/alias_table.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+namespace lucid
+{
+/// @brief Direction towards the environment with radiance coming from it.
+struct EnvironmentSample
+{
+    Vec3 dir;
+    RGB  radiance;
+    real pdf; // solid angle density
+};
+
+/// @brief Infinitely distant emitter surrounding the scene.
+///
+/// The image is mapped to the sphere of directions by latitude and longitude,
+/// with the top row towards +y. Directions are importance sampled by choosing a pixel
+/// from an alias table of pixel luminances weighted by their solid angles,
+/// then a point uniformly inside the pixel.
+class EnvironmentMap
+{
+    ScanlineImage<float, 3> img;
+    AliasTable              table;
+    real                    scale;
+
+    static std::vector<real>
+    weights(const ScanlineImage<float, 3>& image)
+    {
+        const auto [w, h] = image.res();
+        std::vector<real> ret(image.num_pixels());
+        real              sum = 0_r;
+        for(unsigned j = 0u; j < h; ++j)
+        {
+            const real sin_theta =
+                std::sin(Pi * (static_cast<real>(j) + 0.5_r) / static_cast<real>(h));
+            for(unsigned i = 0u; i < w; ++i)
+            {
+                ret[j * w + i] = avg(RGB(image[Vec2u(i, j)])) * sin_theta;
+                sum += ret[j * w + i];
+            }
+        }
+        // black image is sampled uniformly
+        if(sum <= 0_r)
+            for(unsigned j = 0u; j < h; ++j)
+                std::fill_n(ret.begin() + j * w,
+                            w,
+                            std::sin(Pi * (static_cast<real>(j) + 0.5_r) / static_cast<real>(h)));
+        return ret;
+    }
+
+    Vec2u
+    pixel(const Vec3& dir) const noexcept
+    {
+        const auto [w, h] = img.res();
+        const real u = (std::atan2(dir[2], dir[0]) + Pi) / (2_r * Pi);
+        const real v = std::acos(std::clamp(dir[1], -1_r, 1_r)) / Pi;
+        return Vec2u(std::min(static_cast<unsigned>(u * static_cast<real>(w)), w - 1u),
+                     std::min(static_cast<unsigned>(v * static_cast<real>(h)), h - 1u));
+    }
+
+    // solid angle density of directions inside a pixel per unit pmf
+    real
+    pdf_scale(const real sin_theta) const noexcept
+    {
+        return sin_theta > 0_r
+                   ? static_cast<real>(img.num_pixels()) / (2_r * Pi * Pi * sin_theta)
+                   : 0_r;
+    }
+
+  public:
+    /// @param image Latitude-longitude radiance map.
+    /// @param _scale Radiance multiplier.
+    explicit EnvironmentMap(ScanlineImage<float, 3> image, const real _scale = 1_r)
+        : img(std::move(image)), table(weights(img)), scale(_scale)
+    {
+    }
+
+    /// @brief Radiance coming from direction @p dir.
+    RGB
+    radiance(const Vec3& dir) const noexcept
+    {
+        return RGB(img[pixel(dir)]) * static_cast<float>(scale);
+    }
+
+    /// @brief Solid angle density of sampling @p dir.
+    real
+    pdf(const Vec3& dir) const noexcept
+    {
+        const auto [i, j] = pixel(dir);
+        // accurate near the poles, unlike the cosine
+        const real sin_theta = std::sqrt(dir[0] * dir[0] + dir[2] * dir[2]);
+        return table.pmf(j * img.width() + i) * pdf_scale(sin_theta);
+    }
+
+    /// @brief Sample direction proportionally to the radiance.
+    /// @param u_pixel Uniform random number choosing the pixel.
+    /// @param u Uniform random numbers choosing the point inside the pixel.
+    EnvironmentSample
+    sample(const real u_pixel, const Vec2& u) const noexcept
+    {
+        const auto [w, h]   = img.res();
+        const std::size_t k = table.sample(u_pixel);
+        const auto        i = static_cast<unsigned>(k % w);
+        const auto        j = static_cast<unsigned>(k / w);
+
+        const real phi       = 2_r * Pi * (static_cast<real>(i) + u[0]) / static_cast<real>(w) - Pi;
+        const real theta     = Pi * (static_cast<real>(j) + u[1]) / static_cast<real>(h);
+        const real sin_theta = std::sin(theta);
+        const Vec3 dir(sin_theta * std::cos(phi), std::cos(theta), sin_theta * std::sin(phi));
+
+        return EnvironmentSample{dir,
+                                 RGB(img[Vec2u(i, j)]) * static_cast<float>(scale),
+                                 table.pmf(k) * pdf_scale(sin_theta)};
+    }
+};
+} // namespace lucid
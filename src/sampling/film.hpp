@@ -5,6 +5,8 @@
 #pragma once
 
 #include <base/types.hpp>
+#include <image_reconstruction/film.hpp>
+#include <utils/tuple.hpp>
 
 #include <random>
 
@@ -20,4 +22,19 @@ sample_pixel(Generator& g, const real _pixel_width, const Vec2& pos) noexcept
                             g)) *
                _pixel_width;
 }
+
+// sample a random position inside the square of pixel pidx of the film;
+// centers of edge pixels lie on the border of the film,
+// so positions outside of it are reflected back to the inner half of their square
+template <typename Generator, typename Image>
+Vec2
+sample_pixel(Generator& g, const Film<Image>& film, const Vec2u& pidx) noexcept
+{
+    const Vec2 pos = sample_pixel(g, film._pixel_width, film.sample_space(pidx));
+    const Vec2 hi(film._ratio * 0.5_r, 0.5_r);
+    const Vec2 lo     = -hi;
+    const Vec2 inside = min(max(pos, lo * 2_r - pos), hi * 2_r - pos);
+    // reflection may round past the border
+    return min(max(inside, lo), hi);
+}
 } // namespace lucid
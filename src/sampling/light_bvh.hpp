@@ -0,0 +1,525 @@
+// -*- C++ -*-
+// light_bvh.hpp
+//
+
+/// @file
+/// Light hierarchy for many-light importance sampling.
+
+#pragma once
+
+#include <primitives/primitives.hpp>
+#include <sampling/alias_table.hpp>
+#include <utils/tuple.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace lucid
+{
+/// @brief Spatial and directional bounds of emitted power.
+///
+/// Emission is bound by a cone around @p axis of half-angle @f$\theta_o@f$
+/// and the falloff angle @f$\theta_e@f$ past it, as in @cite Conty2018Importance.
+struct LightBounds
+{
+    AABB bounds{Vec3(std::numeric_limits<real>::max()),
+                Vec3(std::numeric_limits<real>::lowest())};
+    Vec3 axis{0, 0, 1};
+    real cos_theta_o = 1_r;
+    real cos_theta_e = 1_r;
+    real power       = 0_r;
+    bool two_sided   = false;
+};
+
+namespace detail
+{
+constexpr real
+safe_sqrt(const real x) noexcept
+{
+    return sqrt(std::max(x, 0_r));
+}
+
+constexpr real
+safe_acos(const real x) noexcept
+{
+    return std::acos(std::clamp(x, -1_r, 1_r));
+}
+
+// cos(a - b) clamped to 1 for a < b
+constexpr real
+cos_sub_clamped(const real sin_a, const real cos_a, const real sin_b, const real cos_b) noexcept
+{
+    return cos_a > cos_b ? 1_r : cos_a * cos_b + sin_a * sin_b;
+}
+
+// sin(a - b) clamped to 0 for a < b
+constexpr real
+sin_sub_clamped(const real sin_a, const real cos_a, const real sin_b, const real cos_b) noexcept
+{
+    return cos_a > cos_b ? 0_r : sin_a * cos_b - cos_a * sin_b;
+}
+
+constexpr AABB
+merge(const AABB& a, const AABB& b) noexcept
+{
+    return AABB{lucid::min(a.vmin, b.vmin), lucid::max(a.vmax, b.vmax)};
+}
+
+/// @brief Bounding cone of two direction cones.
+constexpr std::pair<Vec3, real>
+merge_cones(const Vec3& wa, const real cos_a, const Vec3& wb, const real cos_b) noexcept
+{
+    const real theta_a = safe_acos(cos_a);
+    const real theta_b = safe_acos(cos_b);
+    const real theta_d = safe_acos(dot(wa, wb));
+
+    if(std::min(theta_d + theta_b, Pi) <= theta_a) return {wa, cos_a};
+    if(std::min(theta_d + theta_a, Pi) <= theta_b) return {wb, cos_b};
+
+    const real theta_o = (theta_a + theta_d + theta_b) * 0.5_r;
+    const Vec3 wr      = cross(wa, wb);
+    if(theta_o >= Pi || length2(wr) == 0_r) return {wa, -1_r};
+
+    // rotate wa towards wb
+    const real theta_r = theta_o - theta_a;
+    const Vec3 w = wa * std::cos(theta_r) + cross(normalize(wr), wa) * std::sin(theta_r);
+    return {normalize(w), std::cos(theta_o)};
+}
+} // namespace detail
+
+/// @brief Bounds of a primitive emitting in every direction of its surface.
+template <typename Prim>
+constexpr LightBounds
+light_bounds(const Prim& prim, const RGB& emission) noexcept
+{
+    return LightBounds{
+        bound(prim), Vec3(0, 0, 1), -1_r, 0_r, avg(emission) * area(prim) * Pi, false};
+}
+
+namespace detail
+{
+// emission of flat primitives doesn't depend on the side it's observed from
+template <typename Prim>
+constexpr LightBounds
+flat_light_bounds(const Prim& prim, const RGB& emission) noexcept
+{
+    const Vec3 c = centroid(prim);
+    return LightBounds{
+        bound(prim), normal(c, prim), 1_r, 0_r, 2_r * avg(emission) * area(prim) * Pi, true};
+}
+} // namespace detail
+
+template <template <typename, size_t> typename Container>
+constexpr LightBounds
+light_bounds(const Quad_<Container>& prim, const RGB& emission) noexcept
+{
+    return detail::flat_light_bounds(prim, emission);
+}
+
+template <template <typename, size_t> typename Container>
+constexpr LightBounds
+light_bounds(const Triangle_<Container>& prim, const RGB& emission) noexcept
+{
+    return detail::flat_light_bounds(prim, emission);
+}
+
+template <template <typename, size_t> typename Container>
+constexpr LightBounds
+light_bounds(const Disk_<Container>& prim, const RGB& emission) noexcept
+{
+    return detail::flat_light_bounds(prim, emission);
+}
+
+template <typename... Prims>
+constexpr LightBounds
+light_bounds(const std::variant<Prims...>& prim, const RGB& emission) noexcept
+{
+    return std::visit(
+        [&](const auto& held_prim) noexcept { return light_bounds(held_prim, emission); }, prim);
+}
+
+/// @brief Union of light bounds.
+constexpr LightBounds
+merge(const LightBounds& a, const LightBounds& b) noexcept
+{
+    if(a.power == 0_r) return b;
+    if(b.power == 0_r) return a;
+
+    const auto [axis, cos_theta_o] =
+        detail::merge_cones(a.axis, a.cos_theta_o, b.axis, b.cos_theta_o);
+    return LightBounds{detail::merge(a.bounds, b.bounds),
+                       axis,
+                       cos_theta_o,
+                       std::min(a.cos_theta_e, b.cos_theta_e),
+                       a.power + b.power,
+                       a.two_sided || b.two_sided};
+}
+
+/// @brief Conservative estimate of power received at @p p with normal @p n.
+///
+/// Zero normal disables the incident angle term.
+constexpr real
+importance(const LightBounds& lb, const Vec3& p, const Vec3& n) noexcept
+{
+    const Vec3 pc = (lb.bounds.vmin + lb.bounds.vmax) * 0.5_r;
+    const real r2 = length2(lb.bounds.vmax - lb.bounds.vmin) * 0.25_r;
+    const real d2 = length2(p - pc);
+    const Vec3 wi = d2 > 0_r ? (p - pc) / sqrt(d2) : lb.axis;
+
+    // angle of directions to the bounding sphere of the light
+    const real cos_theta_b = d2 < r2 ? -1_r : detail::safe_sqrt(1_r - r2 / d2);
+    const real sin_theta_b = detail::safe_sqrt(1_r - cos_theta_b * cos_theta_b);
+    const real cos_theta_w = lb.two_sided ? lucid::abs(dot(lb.axis, wi)) : dot(lb.axis, wi);
+    const real sin_theta_w = detail::safe_sqrt(1_r - cos_theta_w * cos_theta_w);
+    const real sin_theta_o = detail::safe_sqrt(1_r - lb.cos_theta_o * lb.cos_theta_o);
+
+    // minimal angle between emitter normals and the direction to the point
+    const real cos_theta_x =
+        detail::cos_sub_clamped(sin_theta_w, cos_theta_w, sin_theta_o, lb.cos_theta_o);
+    const real sin_theta_x =
+        detail::sin_sub_clamped(sin_theta_w, cos_theta_w, sin_theta_o, lb.cos_theta_o);
+    const real cos_theta_p =
+        detail::cos_sub_clamped(sin_theta_x, cos_theta_x, sin_theta_b, cos_theta_b);
+    if(cos_theta_p <= lb.cos_theta_e) return 0_r;
+
+    // avoid singularity when the point is close to the light
+    real ret = lb.power * cos_theta_p / std::max(d2, sqrt(r2));
+    if(any(n != 0_r))
+    {
+        const real cos_theta_i = lucid::abs(dot(wi, n));
+        const real sin_theta_i = detail::safe_sqrt(1_r - cos_theta_i * cos_theta_i);
+        ret *= detail::cos_sub_clamped(sin_theta_i, cos_theta_i, sin_theta_b, cos_theta_b);
+    }
+    return std::max(ret, 0_r);
+}
+
+/// @brief Bounding volume hierarchy over emitters.
+///
+/// Selects a light with probability proportional to the importance
+/// of its subtree at each level, which takes O(log N) importance evaluations.
+/// Built with surface area orientation heuristic of @cite Conty2018Importance.
+class LightBVH
+{
+    struct Node
+    {
+        LightBounds   bounds;
+        std::uint32_t index; // second child for interior nodes, light for leaves
+        bool          is_leaf;
+    };
+
+    static constexpr const std::size_t num_buckets = 12ul;
+    static constexpr const real        max_u       = 1_r - std::numeric_limits<real>::epsilon();
+
+    std::vector<Node>          nodes;
+    std::vector<std::uint64_t> trails; // bits of branches taken to reach a light
+
+    // bounds of directions emitted by lights
+    static real
+    orientation_measure(const LightBounds& lb) noexcept
+    {
+        const real theta_o = detail::safe_acos(lb.cos_theta_o);
+        const real theta_e = detail::safe_acos(lb.cos_theta_e);
+        const real theta_w = std::min(theta_o + theta_e, Pi);
+        const real sin_o   = detail::safe_sqrt(1_r - lb.cos_theta_o * lb.cos_theta_o);
+        return 2_r * Pi * (1_r - lb.cos_theta_o) +
+               Pi * 0.5_r *
+                   (2_r * theta_w * sin_o - std::cos(theta_o - 2_r * theta_w) -
+                    2_r * theta_o * sin_o + lb.cos_theta_o);
+    }
+
+    static real
+    cost(const LightBounds& lb, const real k_r) noexcept
+    {
+        return lb.power * orientation_measure(lb) * k_r * area(lb.bounds);
+    }
+
+    using Item = std::pair<std::uint32_t, LightBounds>;
+
+    void
+    build(const std::vector<Item>::iterator first,
+          const std::vector<Item>::iterator last,
+          const std::uint64_t               trail,
+          const unsigned                    depth)
+    {
+        if(last - first == 1)
+        {
+            nodes.push_back(Node{first->second, first->first, true});
+            trails[first->first] = trail;
+            return;
+        }
+
+        AABB bounds     = LightBounds{}.bounds;
+        AABB centroids  = LightBounds{}.bounds;
+        for(auto it = first; it != last; ++it)
+        {
+            const Vec3 c = centroid(it->second.bounds);
+            bounds       = detail::merge(bounds, it->second.bounds);
+            centroids    = detail::merge(centroids, AABB{c, c});
+        }
+
+        const Vec3  diag     = bounds.vmax - bounds.vmin;
+        const Vec3  extent   = centroids.vmax - centroids.vmin;
+        real        min_cost = std::numeric_limits<real>::max();
+        std::size_t min_dim  = 0ul;
+        std::size_t min_b    = 0ul;
+        auto        bucket   = [&](const Item& item, const std::size_t dim) noexcept {
+            const real c = (centroid(item.second.bounds)[dim] - centroids.vmin[dim]) / extent[dim];
+            return std::min(static_cast<std::size_t>(c * num_buckets), num_buckets - 1ul);
+        };
+
+        for(std::size_t dim = 0ul; dim < 3ul; ++dim)
+        {
+            if(extent[dim] == 0_r) continue;
+
+            std::array<LightBounds, num_buckets> buckets{};
+            for(auto it = first; it != last; ++it)
+                buckets[bucket(*it, dim)] = merge(buckets[bucket(*it, dim)], it->second);
+
+            // elongated boxes are penalized for splits across the long side
+            const real k_r = std::max({diag[0], diag[1], diag[2]}) / diag[dim];
+            // sweep split planes with bounds of buckets above them merged in advance
+            std::array<LightBounds, num_buckets> above{};
+            above[num_buckets - 1ul] = buckets[num_buckets - 1ul];
+            for(std::size_t b = num_buckets - 1ul; b > 0ul; --b)
+                above[b - 1ul] = merge(buckets[b - 1ul], above[b]);
+
+            LightBounds below;
+            for(std::size_t b = 0ul; b < num_buckets - 1ul; ++b)
+            {
+                below = merge(below, buckets[b]);
+                if(below.power == 0_r || above[b + 1ul].power == 0_r) continue;
+
+                const real c = cost(below, k_r) + cost(above[b + 1ul], k_r);
+                if(c < min_cost)
+                {
+                    min_cost = c;
+                    min_dim  = dim;
+                    min_b    = b;
+                }
+            }
+        }
+
+        // balanced splits deep in the tree keep bit trails within 64 bits
+        auto mid = first + (last - first) / 2;
+        if(min_cost < std::numeric_limits<real>::max() && depth < 32u)
+            mid = std::partition(first, last, [&](const Item& item) noexcept {
+                return bucket(item, min_dim) <= min_b;
+            });
+        // lights with coincident centroids can't be separated by buckets
+        if(mid == first || mid == last) mid = first + (last - first) / 2;
+
+        const std::size_t idx = nodes.size();
+        nodes.push_back(Node{LightBounds{}, 0u, false});
+        build(first, mid, trail, depth + 1u);
+        nodes[idx].index = static_cast<std::uint32_t>(nodes.size());
+        build(mid, last, trail | (1ull << depth), depth + 1u);
+        nodes[idx].bounds = merge(nodes[idx + 1ul].bounds, nodes[nodes[idx].index].bounds);
+    }
+
+  public:
+    LightBVH() = default;
+
+    /// @brief Build hierarchy over @p lights.
+    ///
+    /// Sampled indices refer to positions in @p lights.
+    explicit LightBVH(const std::vector<LightBounds>& lights) : trails(lights.size(), 0ull)
+    {
+        std::vector<Item> items;
+        items.reserve(lights.size());
+        for(std::size_t i = 0ul; i < lights.size(); ++i)
+            if(lights[i].power > 0_r) items.emplace_back(static_cast<std::uint32_t>(i), lights[i]);
+
+        if(items.empty()) return;
+        nodes.reserve(2ul * items.size() - 1ul);
+        build(items.begin(), items.end(), 0ull, 0u);
+    }
+
+    /// @brief Number of lights in the hierarchy.
+    std::size_t
+    size() const noexcept
+    {
+        return (nodes.size() + 1ul) / 2ul;
+    }
+
+    /// @brief Sample a light for shading point @p p with normal @p n.
+    /// @param u uniformly distributed random number in [0, 1).
+    /// @return light index and its probability or nothing if no light contributes.
+    std::optional<std::pair<std::size_t, real>>
+    sample(const Vec3& p, const Vec3& n, real u) const noexcept
+    {
+        if(nodes.empty()) return {};
+
+        std::size_t idx = 0ul;
+        real        pmf = 1_r;
+        while(!nodes[idx].is_leaf)
+        {
+            const real i0 = importance(nodes[idx + 1ul].bounds, p, n);
+            const real i1 = importance(nodes[nodes[idx].index].bounds, p, n);
+            if(i0 == 0_r && i1 == 0_r) return {};
+
+            // reuse the random number for the next level
+            const real p0 = i0 / (i0 + i1);
+            if(u < p0)
+            {
+                pmf *= p0;
+                u   = std::min(u / p0, max_u);
+                idx = idx + 1ul;
+            }
+            else
+            {
+                pmf *= 1_r - p0;
+                u   = std::min((u - p0) / (1_r - p0), max_u);
+                idx = nodes[idx].index;
+            }
+        }
+
+        if(idx == 0ul && importance(nodes[idx].bounds, p, n) == 0_r) return {};
+        return std::pair{std::size_t{nodes[idx].index}, pmf};
+    }
+
+    /// @brief Probability of sampling @p light for shading point @p p with normal @p n.
+    real
+    pmf(const Vec3& p, const Vec3& n, const std::size_t light) const noexcept
+    {
+        if(light >= trails.size() || nodes.empty()) return 0_r;
+
+        std::uint64_t trail = trails[light];
+        std::size_t   idx   = 0ul;
+        real          pmf   = 1_r;
+        while(!nodes[idx].is_leaf)
+        {
+            const real i0 = importance(nodes[idx + 1ul].bounds, p, n);
+            const real i1 = importance(nodes[nodes[idx].index].bounds, p, n);
+            if(i0 == 0_r && i1 == 0_r) return 0_r;
+
+            pmf *= (trail & 1ull ? i1 : i0) / (i0 + i1);
+            idx = trail & 1ull ? nodes[idx].index : idx + 1ul;
+            trail >>= 1u;
+        }
+
+        // lights without power are not in the hierarchy
+        if(nodes[idx].index != light) return 0_r;
+        return idx == 0ul ? static_cast<real>(importance(nodes[idx].bounds, p, n) > 0_r) : pmf;
+    }
+};
+
+/// @brief Emissive primitives of a scene.
+struct SceneLights
+{
+    static constexpr std::size_t no_light = std::numeric_limits<std::size_t>::max();
+
+    std::vector<std::size_t> pids;
+    std::vector<LightBounds> bounds;
+    LightBVH                 bvh;     // over bounds
+    std::vector<std::size_t> indices; // of every primitive in pids, or no_light
+};
+
+/// @brief Collect primitives with non-zero emission.
+template <typename Scene, typename MaterialGetter>
+SceneLights
+collect_lights(const Scene& scene, const MaterialGetter& material_getter)
+{
+    SceneLights ret;
+    std::size_t pid = 0ul;
+    for_each(
+        [&](const auto& prim) {
+            const auto& [bsdf, emit_f] = material_getter(pid);
+            const RGB emission         = emit_f();
+            const bool emissive = any(emission > 0_r);
+            ret.indices.push_back(emissive ? ret.pids.size() : SceneLights::no_light);
+            if(emissive)
+            {
+                ret.pids.push_back(pid);
+                ret.bounds.push_back(light_bounds(prim, emission));
+            }
+            ++pid;
+        },
+        scene);
+    ret.bvh = LightBVH(ret.bounds);
+    return ret;
+}
+
+/// @brief Table choosing @p lights proportionally to their power.
+inline AliasTable
+power_table(const SceneLights& lights)
+{
+    std::vector<real> powers;
+    for(const auto& lb: lights.bounds) powers.push_back(lb.power);
+    return AliasTable(powers);
+}
+
+/// @brief Point on a light.
+struct LightSample
+{
+    std::size_t light; // index in SceneLights
+    Vec3        pos;
+    Vec3        n;
+    real        pdf; // area density including the choice of the light
+};
+
+/// @brief Choose a light with @p table and sample a point uniformly on its surface.
+///
+/// The choice doesn't depend on the receiving point, e.g. for starting light paths.
+template <typename Scene>
+constexpr LightSample
+sample_light(const Scene&       scene,
+             const SceneLights& lights,
+             const AliasTable&  table,
+             const real         u_light,
+             const Vec2&        u_pos) noexcept
+{
+    const std::size_t light = table.sample(u_light);
+    return lucid::visit(
+        lights.pids[light],
+        [&](const auto& prim) noexcept {
+            const Vec3 pos = lucid::sample(u_pos, prim);
+            return LightSample{light, pos, normal(pos, prim), table.pmf(light) / area(prim)};
+        },
+        scene);
+}
+
+/// @brief Choose a light for shading point @p p with normal @p n from the hierarchy
+/// of @p lights and sample a point uniformly on its surface.
+/// @return nothing if no light contributes to the point.
+template <typename Scene>
+constexpr std::optional<LightSample>
+sample_light(const Scene&       scene,
+             const SceneLights& lights,
+             const Vec3&        p,
+             const Vec3&        n,
+             const real         u_light,
+             const Vec2&        u_pos) noexcept
+{
+    const auto chosen = lights.bvh.sample(p, n, u_light);
+    if(!chosen) return {};
+
+    const auto [light, pmf] = chosen.value();
+    return lucid::visit(
+        lights.pids[light],
+        [&](const auto& prim) noexcept {
+            const Vec3 pos = lucid::sample(u_pos, prim);
+            return std::optional{LightSample{light, pos, normal(pos, prim), pmf / area(prim)}};
+        },
+        scene);
+}
+
+/// @brief Area density of sampling a point on @p light with the hierarchy
+/// for shading point @p p with normal @p n.
+template <typename Scene>
+constexpr real
+light_pdf(const Scene&       scene,
+          const SceneLights& lights,
+          const Vec3&        p,
+          const Vec3&        n,
+          const std::size_t  light) noexcept
+{
+    const real light_area = lucid::visit(
+        lights.pids[light], [](const auto& prim) noexcept { return area(prim); }, scene);
+    return lights.bvh.pmf(p, n, light) / light_area;
+}
+} // namespace lucid
@@ -0,0 +1,191 @@
+// -*- C++ -*-
+// photon_map.hpp
+//
+
+/// @file
+/// Photon storage with nearest neighbors search.
+
+#pragma once
+
+#include <base/types.hpp>
+#include <base/vector.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace lucid
+{
+/// @brief Power carried by a light path to a surface.
+struct Photon
+{
+    Vec3 pos;
+    Vec3 wi; // direction the photon came from
+    RGB  power;
+};
+
+/// @brief Balanced kd-tree of photons.
+///
+/// The tree is implicit: the node of a range of photons is its median, with subtrees
+/// in the halves to either side of it. Subtrees are thus stored contiguously and
+/// no child pointers are needed.
+class PhotonMap
+{
+  public:
+    struct Neighbor
+    {
+        real          dist2;
+        std::uint32_t idx;
+    };
+
+  private:
+    std::vector<Photon>       photons;
+    std::vector<std::uint8_t> axes; // split axis of the node at the median of each range
+
+    static constexpr std::size_t
+    median(const std::size_t b, const std::size_t e) noexcept
+    {
+        return b + (e - b) / 2ul;
+    }
+
+    void
+    build(const std::size_t b, const std::size_t e, const unsigned threads)
+    {
+        if(e - b < 2ul) return;
+
+        Vec3 vmin(std::numeric_limits<real>::max());
+        Vec3 vmax(std::numeric_limits<real>::lowest());
+        for(std::size_t i = b; i < e; ++i)
+        {
+            vmin = lucid::min(vmin, photons[i].pos);
+            vmax = lucid::max(vmax, photons[i].pos);
+        }
+        const Vec3         extent = vmax - vmin;
+        const std::uint8_t axis   = extent[0] > extent[1] ? (extent[0] > extent[2] ? 0 : 2)
+                                                          : (extent[1] > extent[2] ? 1 : 2);
+
+        const std::size_t m = median(b, e);
+        std::nth_element(photons.begin() + b,
+                         photons.begin() + m,
+                         photons.begin() + e,
+                         [axis](const Photon& p1, const Photon& p2) noexcept {
+                             return p1.pos[axis] < p2.pos[axis];
+                         });
+        axes[m] = axis;
+
+        // subtrees are disjoint, so halves of the threads build them independently
+        if(threads > 1u)
+        {
+            std::thread left([&]() { build(b, m, threads / 2u); });
+            build(m + 1ul, e, threads - threads / 2u);
+            left.join();
+        }
+        else
+        {
+            build(b, m, 1u);
+            build(m + 1ul, e, 1u);
+        }
+    }
+
+  public:
+    PhotonMap() = default;
+
+    /// @param threads Number of threads to build the tree with, including the calling one.
+    explicit PhotonMap(std::vector<Photon> _photons, const unsigned threads = 1u)
+        : photons(std::move(_photons)), axes(photons.size(), 0u)
+    {
+        build(0ul, photons.size(), std::max(threads, 1u));
+    }
+
+    /// @brief Find up to @p heap.size() photons nearest to @p p closer than @f$\sqrt{dist2}@f$.
+    ///
+    /// Neighbors are written to @p heap, which is kept a max heap on distance.
+    /// @p dist2 is shrunk to the squared distance of the farthest neighbor when the heap is full.
+    /// @return number of found neighbors.
+    std::size_t
+    nearest(const Vec3& p, real& dist2, std::span<Neighbor> heap) const noexcept
+    {
+        struct Range
+        {
+            std::uint32_t b;
+            std::uint32_t e;
+            real          plane_dist2;
+        };
+        // one deferred subtree per tree level
+        std::array<Range, 64> stack;
+        std::size_t           sp    = 0ul;
+        std::size_t           found = 0ul;
+        const std::size_t     k     = heap.size();
+        auto less = [](const Neighbor& a, const Neighbor& b) noexcept { return a.dist2 < b.dist2; };
+
+        if(photons.empty() || k == 0ul) return 0ul;
+        stack[sp++] = Range{0u, static_cast<std::uint32_t>(photons.size()), 0_r};
+        while(sp)
+        {
+            const auto [b, e, plane_dist2] = stack[--sp];
+            if(b == e || plane_dist2 >= dist2) continue;
+
+            const auto    m      = static_cast<std::uint32_t>(median(b, e));
+            const Photon& photon = photons[m];
+            const real    d2     = length2(photon.pos - p);
+            if(d2 < dist2)
+            {
+                if(found < k)
+                {
+                    heap[found++] = Neighbor{d2, m};
+                    std::push_heap(heap.begin(), heap.begin() + found, less);
+                    if(found == k) dist2 = heap.front().dist2;
+                }
+                else
+                {
+                    std::pop_heap(heap.begin(), heap.end(), less);
+                    heap.back() = Neighbor{d2, m};
+                    std::push_heap(heap.begin(), heap.end(), less);
+                    dist2 = heap.front().dist2;
+                }
+            }
+
+            if(e - b == 1u) continue;
+            const real delta = p[axes[m]] - photon.pos[axes[m]];
+            const bool below = delta < 0_r;
+            // the near side is visited first
+            stack[sp++] = below ? Range{m + 1u, e, delta * delta} : Range{b, m, delta * delta};
+            stack[sp++] = below ? Range{b, m, 0_r} : Range{m + 1u, e, 0_r};
+        }
+        return found;
+    }
+
+    const Photon&
+    operator[](const std::size_t i) const noexcept
+    {
+        return photons[i];
+    }
+
+    std::size_t
+    size() const noexcept
+    {
+        return photons.size();
+    }
+};
+
+/// @brief Squared gather radius of a progressive photon mapping pass.
+///
+/// Each pass is an independent estimate with a radius shrinking as in @cite Knaus2011PPM,
+/// so the average of the passes converges to the correct solution.
+/// @param radius2 Squared radius of the first pass.
+/// @param pass Zero-based pass index.
+/// @param alpha Fraction of photons kept from pass to pass.
+constexpr real
+progressive_radius2(const real radius2, const unsigned pass, const real alpha = 2_r / 3_r) noexcept
+{
+    real ret = radius2;
+    for(unsigned i = 1u; i <= pass; ++i)
+        ret *= (static_cast<real>(i) + alpha) / static_cast<real>(i + 1u);
+    return ret;
+}
+} // namespace lucid
@@ -0,0 +1,187 @@
+// -*- C++ -*-
+// radiance_cache.hpp
+//
+
+/// @file
+/// Spatial hash grid of outgoing radiance.
+
+#pragma once
+
+#include <base/types.hpp>
+#include <base/vector.hpp>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+namespace lucid
+{
+/// @brief Lock-free hash grid caching radiance leaving surfaces.
+///
+/// Cells are keyed by quantized position and normal as in @cite Binder2020PathSpaceFiltering.
+/// Radiance of completed paths is accumulated into cells, and paths may be terminated
+/// by looking up the mean radiance of the cell they reached instead of being traced further.
+/// Estimates are blurred across a cell, so results are biased.
+class RadianceCache
+{
+    struct Slot
+    {
+        std::atomic<std::uint64_t>        key{0ul}; // zero for empty slots
+        std::array<std::atomic<float>, 3> sum{};
+        std::atomic<std::uint32_t>        count{0u};
+    };
+
+    std::vector<Slot> slots;
+
+    // a colliding key is looked up in a few following slots
+    static constexpr const std::size_t max_probes = 8ul;
+    // bits per quantized coordinate
+    static constexpr const unsigned coord_bits = 19u;
+
+  public:
+    struct Params
+    {
+        /// Edge length of a cell.
+        real cell_size = 0.02_r;
+        /// Number of bounces after which paths look the cache up.
+        unsigned depth = 2u;
+        /// Number of recorded samples needed for a cell to be used.
+        std::uint32_t min_samples = 32u;
+        /// Base-2 logarithm of the number of slots.
+        unsigned log2_size = 20u;
+    };
+
+  private:
+    Params params;
+    real   inv_cell_size;
+
+    std::uint64_t
+    key(const Vec3& pos, const Vec3& n) const noexcept
+    {
+        constexpr std::int64_t  offset = std::int64_t{1} << (coord_bits - 1u);
+        constexpr std::uint64_t mask   = (std::uint64_t{1} << coord_bits) - 1ul;
+
+        std::uint64_t ret = 0ul;
+        for(std::size_t i = 0ul; i < 3ul; ++i)
+        {
+            const auto c = static_cast<std::int64_t>(std::floor(pos[i] * inv_cell_size));
+            ret          = (ret << coord_bits) | (static_cast<std::uint64_t>(c + offset) & mask);
+        }
+        // two bits per normal component
+        for(std::size_t i = 0ul; i < 3ul; ++i)
+            ret = (ret << 2u) | static_cast<std::uint64_t>(
+                                    std::clamp((n[i] + 1_r) * 2_r, 0_r, 3_r));
+        return ret + 1ul;
+    }
+
+    // splitmix64 finalizer
+    static constexpr std::size_t
+    mix(std::uint64_t x) noexcept
+    {
+        x = (x ^ (x >> 30u)) * 0xbf58476d1ce4e5b9ul;
+        x = (x ^ (x >> 27u)) * 0x94d049bb133111ebul;
+        return static_cast<std::size_t>(x ^ (x >> 31u));
+    }
+
+    Slot const*
+    find(const std::uint64_t k) const noexcept
+    {
+        const std::size_t mask = slots.size() - 1ul;
+        const std::size_t h    = mix(k);
+        for(std::size_t i = 0ul; i < max_probes; ++i)
+        {
+            const Slot&         slot = slots[(h + i) & mask];
+            const std::uint64_t sk   = slot.key.load(std::memory_order_acquire);
+            if(sk == k) return &slot;
+            if(sk == 0ul) return nullptr;
+        }
+        return nullptr;
+    }
+
+  public:
+    explicit RadianceCache(const Params& _params)
+        : slots(std::size_t{1} << _params.log2_size), params(_params),
+          inv_cell_size(1_r / _params.cell_size)
+    {
+    }
+
+    RadianceCache() : RadianceCache(Params{}) {}
+
+    /// @brief Number of bounces after which paths look the cache up.
+    unsigned
+    depth() const noexcept
+    {
+        return params.depth;
+    }
+
+    /// @brief Mean radiance leaving @p pos, if its cell has enough samples.
+    std::optional<RGB>
+    lookup(const Vec3& pos, const Vec3& n) const noexcept
+    {
+        Slot const* slot = find(key(pos, n));
+        if(!slot) return std::nullopt;
+
+        const std::uint32_t count = slot->count.load(std::memory_order_relaxed);
+        if(count < params.min_samples) return std::nullopt;
+
+        RGB ret;
+        for(std::size_t c = 0ul; c < 3ul; ++c)
+            ret[c] = slot->sum[c].load(std::memory_order_relaxed) / static_cast<float>(count);
+        return ret;
+    }
+
+    /// @brief Add radiance leaving @p pos.
+    ///
+    /// Safe to call concurrently with other records and lookups.
+    /// The sample is dropped when the table is too crowded around its key.
+    void
+    record(const Vec3& pos, const Vec3& n, const RGB& radiance) noexcept
+    {
+        const std::uint64_t k    = key(pos, n);
+        const std::size_t   mask = slots.size() - 1ul;
+        const std::size_t   h    = mix(k);
+        for(std::size_t i = 0ul; i < max_probes; ++i)
+        {
+            Slot&         slot = slots[(h + i) & mask];
+            std::uint64_t sk   = 0ul;
+            // claim an empty slot or find out whose it is
+            slot.key.compare_exchange_strong(
+                sk, k, std::memory_order_acq_rel, std::memory_order_acquire);
+            if(sk != 0ul && sk != k) continue;
+
+            for(std::size_t c = 0ul; c < 3ul; ++c)
+                slot.sum[c].fetch_add(static_cast<float>(radiance[c]), std::memory_order_relaxed);
+            slot.count.fetch_add(1u, std::memory_order_relaxed);
+            return;
+        }
+    }
+
+    /// @brief Number of occupied slots.
+    std::size_t
+    num_cells() const noexcept
+    {
+        return static_cast<std::size_t>(
+            std::count_if(slots.begin(), slots.end(), [](const Slot& slot) noexcept {
+                return slot.key.load(std::memory_order_relaxed) != 0ul;
+            }));
+    }
+
+    /// @brief Forget recorded radiance.
+    ///
+    /// Must not overlap with recording or lookups.
+    void
+    clear() noexcept
+    {
+        for(Slot& slot: slots)
+        {
+            slot.key.store(0ul, std::memory_order_relaxed);
+            for(auto& s: slot.sum) s.store(0.f, std::memory_order_relaxed);
+            slot.count.store(0u, std::memory_order_relaxed);
+        }
+    }
+};
+} // namespace lucid
@@ -0,0 +1,83 @@
+// -*- C++ -*-
+// reservoir.hpp
+//
+
+/// @file
+/// Weighted reservoir sampling.
+
+#pragma once
+
+#include <base/types.hpp>
+
+#include <cstdint>
+
+namespace lucid
+{
+/// @brief Single sample reservoir for resampled importance sampling @cite Bitterli2020ReSTIR.
+///
+/// Candidates are streamed in with resampling weights, and one of them is kept
+/// with probability proportional to its weight.
+/// The kept sample, weighted by @ref contribution_weight, estimates an integral
+/// as if it was drawn from the target density.
+template <typename T>
+struct Reservoir
+{
+    T             sample{};
+    real          weight_sum = 0_r;
+    real          target     = 0_r; // target density of the kept sample
+    std::uint32_t count      = 0u;  // number of candidates seen
+
+    /// @brief Stream in a candidate.
+    /// @param weight Resampling weight: target over source density of the candidate.
+    /// @param candidate_target Target density of the candidate.
+    /// @param u Uniform random number in [0, 1).
+    /// @return whether the candidate was kept.
+    constexpr bool
+    update(const T&   candidate,
+           const real weight,
+           const real candidate_target,
+           const real u) noexcept
+    {
+        weight_sum += weight;
+        ++count;
+        const bool keep = weight > 0_r && u * weight_sum < weight;
+        if(keep)
+        {
+            sample = candidate;
+            target = candidate_target;
+        }
+        return keep;
+    }
+
+    /// @brief Combine with a reservoir of another pixel or pass.
+    /// @param other_target Target density of the sample of @p other here.
+    constexpr bool
+    merge(const Reservoir& other, const real other_target, const real u) noexcept
+    {
+        const std::uint32_t total  = count + other.count;
+        const real          weight = other_target * other.contribution_weight() *
+                                     static_cast<real>(other.count);
+        const bool          keep   = update(other.sample, weight, other_target, u);
+        count                      = total;
+        return keep;
+    }
+
+    /// @brief Limit the number of accounted candidates, keeping the mean weight.
+    ///
+    /// Bounds the influence of old samples when reservoirs are reused across passes.
+    constexpr void
+    clamp(const std::uint32_t max_count) noexcept
+    {
+        if(count <= max_count) return;
+        weight_sum *= static_cast<real>(max_count) / static_cast<real>(count);
+        count = max_count;
+    }
+
+    /// @brief Weight of the kept sample in place of the reciprocal of its density.
+    constexpr real
+    contribution_weight() const noexcept
+    {
+        return target > 0_r ? weight_sum / (static_cast<real>(count) * target) : 0_r;
+    }
+};
+} // namespace lucid
@@ -0,0 +1,408 @@
+// -*- C++ -*-
+// sd_tree.hpp
+//
+
+/// @file
+/// Spatial-directional tree for path guiding.
+
+#pragma once
+
+#include <primitives/primitives.hpp>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <tuple>
+#include <vector>
+
+namespace lucid
+{
+/// @brief Map direction to the unit square with area preserving cylindrical mapping.
+constexpr Vec2
+dir_to_square(const Vec3& d) noexcept
+{
+    const auto& [x, y, z] = d;
+    const real phi        = std::atan2(y, x);
+    return Vec2(std::clamp((z + 1_r) * 0.5_r, 0_r, 1_r),
+                (phi < 0_r ? phi + 2_r * Pi : phi) / (2_r * Pi));
+}
+
+/// @brief Inverse of @ref dir_to_square.
+constexpr Vec3
+square_to_dir(const Vec2& p) noexcept
+{
+    const auto& [u, v] = p;
+    const real cos_t   = 2_r * u - 1_r;
+    const real sin_t   = std::sqrt(std::max(1_r - cos_t * cos_t, 0_r));
+    const real phi     = 2_r * Pi * v;
+    return Vec3(std::cos(phi) * sin_t, std::sin(phi) * sin_t, cos_t);
+}
+
+/// @brief Distribution of incident radiance over directions.
+///
+/// Piecewise constant quadtree over @ref dir_to_square parameterization
+/// as in @cite Muller2017PPG. Radiance is recorded into the building tree,
+/// while directions are sampled from the sampling tree learned in the previous iteration.
+class DTree
+{
+    struct Node
+    {
+        std::array<float, 4>         sum{};
+        std::array<std::uint32_t, 4> children{}; // zero for leaves, root is never a child
+    };
+
+    std::vector<Node> sampling = std::vector<Node>(1ul);
+    std::vector<Node> building = std::vector<Node>(1ul);
+    std::uint64_t     count = 0ul;
+
+    static constexpr std::uint32_t
+    quadrant(Vec2& p) noexcept
+    {
+        const std::uint32_t x = p[0] >= 0.5_r;
+        const std::uint32_t y = p[1] >= 0.5_r;
+        p[0]                  = std::min(p[0] * 2_r - static_cast<real>(x), 1_r);
+        p[1]                  = std::min(p[1] * 2_r - static_cast<real>(y), 1_r);
+        return x + 2u * y;
+    }
+
+    static float
+    total(const Node& node) noexcept
+    {
+        return node.sum[0] + node.sum[1] + node.sum[2] + node.sum[3];
+    }
+
+    // subdivide cells holding more than threshold of the total energy
+    void
+    refine(std::vector<Node>&  next,
+           const std::uint32_t next_idx,
+           const std::uint32_t idx,
+           const bool          has_node,
+           const float         energy,
+           const float         threshold,
+           const unsigned      depth,
+           const unsigned      max_depth,
+           const std::size_t   max_nodes) const
+    {
+        for(std::uint32_t c = 0u; c < 4u; ++c)
+        {
+            const float child_energy = has_node ? building[idx].sum[c] : energy * 0.25f;
+            if(child_energy <= threshold || depth >= max_depth || next.size() >= max_nodes)
+                continue;
+
+            const auto child   = static_cast<std::uint32_t>(next.size());
+            const bool has_old = has_node && building[idx].children[c];
+            next.emplace_back();
+            next[next_idx].children[c] = child;
+            refine(next,
+                   child,
+                   has_old ? building[idx].children[c] : 0u,
+                   has_old,
+                   child_energy,
+                   threshold,
+                   depth + 1u,
+                   max_depth,
+                   max_nodes);
+        }
+    }
+
+  public:
+    /// @brief Sample direction proportionally to the learned radiance.
+    Vec3
+    sample(Vec2 u) const noexcept
+    {
+        Vec2          origin(0_r);
+        real          size = 1_r;
+        std::uint32_t idx  = 0u;
+        while(true)
+        {
+            const auto& sum = sampling[idx].sum;
+            const float t   = total(sampling[idx]);
+            if(t <= 0.f) break;
+
+            // choose column by the marginal and then row in it
+            const real          p_left = (sum[0] + sum[2]) / t;
+            const std::uint32_t x      = u[0] >= p_left;
+            u[0] = x ? (u[0] - p_left) / (1_r - p_left) : u[0] / p_left;
+            const real          p_low  = sum[x] / (sum[x] + sum[x + 2u]);
+            const std::uint32_t y      = u[1] >= p_low;
+            u[1] = y ? (u[1] - p_low) / (1_r - p_low) : u[1] / p_low;
+
+            size *= 0.5_r;
+            origin += Vec2(static_cast<real>(x), static_cast<real>(y)) * size;
+            const std::uint32_t child = sampling[idx].children[x + 2u * y];
+            if(!child) break;
+            idx = child;
+        }
+        return square_to_dir(origin + Vec2(std::clamp(u[0], 0_r, 1_r),
+                                           std::clamp(u[1], 0_r, 1_r)) * size);
+    }
+
+    /// @brief Solid angle density of sampling direction @p d.
+    real
+    pdf(const Vec3& d) const noexcept
+    {
+        Vec2          p   = dir_to_square(d);
+        real          ret = 1_r / (4_r * Pi);
+        std::uint32_t idx = 0u;
+        while(true)
+        {
+            const float t = total(sampling[idx]);
+            if(t <= 0.f) return ret;
+
+            const std::uint32_t c = quadrant(p);
+            ret *= 4_r * sampling[idx].sum[c] / t;
+            if(ret == 0_r || !sampling[idx].children[c]) return ret;
+            idx = sampling[idx].children[c];
+        }
+    }
+
+    /// @brief Add radiance estimate in direction @p d.
+    ///
+    /// Safe to call concurrently.
+    void
+    record(const Vec3& d, const float radiance) noexcept
+    {
+        std::atomic_ref<std::uint64_t>(count).fetch_add(1ul, std::memory_order_relaxed);
+        if(radiance <= 0.f) return;
+
+        Vec2          p   = dir_to_square(d);
+        std::uint32_t idx = 0u;
+        while(true)
+        {
+            const std::uint32_t c = quadrant(p);
+            std::atomic_ref<float>(building[idx].sum[c])
+                .fetch_add(radiance, std::memory_order_relaxed);
+            if(!building[idx].children[c]) return;
+            idx = building[idx].children[c];
+        }
+    }
+
+    /// @brief Make recorded radiance the sampling distribution and refine the building tree.
+    /// @param threshold fraction of energy above which cells are subdivided.
+    void
+    refine(const float threshold, const unsigned max_depth, const std::size_t max_nodes)
+    {
+        std::vector<Node> next(1ul);
+        const float       t = total(building[0]);
+        if(t > 0.f)
+            refine(next, 0u, 0u, true, t, threshold * t, 0u, max_depth, std::max(max_nodes, 1ul));
+        sampling = std::move(building);
+        building = std::move(next);
+        count    = 0ul;
+    }
+
+    /// @brief Number of recorded samples in the current iteration.
+    std::uint64_t
+    num_samples() const noexcept
+    {
+        return count;
+    }
+
+    void
+    set_num_samples(const std::uint64_t n) noexcept
+    {
+        count = n;
+    }
+
+    /// @brief Number of nodes in both trees.
+    std::size_t
+    num_nodes() const noexcept
+    {
+        return sampling.size() + building.size();
+    }
+
+    /// @brief Number of nodes in the building tree, which becomes the sampling one on refinement.
+    std::size_t
+    num_building_nodes() const noexcept
+    {
+        return building.size();
+    }
+
+    static constexpr std::size_t node_size = sizeof(Node);
+};
+
+/// @brief Spatial binary tree of directional distributions.
+///
+/// Recording is thread-safe, while refinement must not overlap with
+/// recording or sampling and is meant to be done between rendering passes.
+class SDTree
+{
+  public:
+    struct Params
+    {
+        /// Fraction of directions sampled with BSDF.
+        real bsdf_fraction = 0.5_r;
+        /// Spatial leaves are split when they get more than
+        /// @f$c \sqrt{2^k}@f$ samples in the k-th iteration.
+        float spatial_threshold = 4000.f;
+        /// Directional cells are split when they hold more than this fraction of energy.
+        float directional_threshold = 0.01f;
+        /// Maximal depth of directional quadtrees.
+        unsigned max_depth = 20u;
+        /// Memory budget in bytes.
+        std::size_t memory = 64ul << 20u;
+    };
+
+  private:
+    struct Node
+    {
+        std::uint32_t child = 0u; // first of two children, zero for leaves
+        std::uint32_t dtree = 0u;
+        std::uint8_t  axis  = 0u;
+    };
+
+    std::vector<Node>  nodes  = std::vector<Node>(1ul);
+    std::vector<DTree> dtrees = std::vector<DTree>(1ul);
+    Vec3               origin;
+    Vec3               size;
+    Params             params;
+    unsigned           iteration = 0u;
+    bool               training  = true;
+
+    std::uint32_t
+    leaf(const Vec3& pos) const noexcept
+    {
+        Vec3          p   = (pos - origin) / size;
+        std::uint32_t idx = 0u;
+        while(nodes[idx].child)
+        {
+            const std::uint8_t  axis = nodes[idx].axis;
+            const std::uint32_t side = p[axis] >= 0.5_r;
+            p[axis]                  = p[axis] * 2_r - static_cast<real>(side);
+            idx                      = nodes[idx].child + side;
+        }
+        return nodes[idx].dtree;
+    }
+
+  public:
+    /// @param bounds Scene bounds. The tree covers their bounding cube.
+    SDTree(const AABB& bounds, const Params& _params) : params(_params)
+    {
+        const Vec3 extent = bounds.vmax - bounds.vmin;
+        size              = Vec3(std::max({extent[0], extent[1], extent[2]}) * 1.001_r);
+        origin            = (bounds.vmin + bounds.vmax - size) * 0.5_r;
+    }
+
+    explicit SDTree(const AABB& bounds) : SDTree(bounds, Params{}) {}
+
+    /// @brief Whether the sampling distribution has been learned.
+    bool
+    trained() const noexcept
+    {
+        return iteration > 0u;
+    }
+
+    /// @brief Whether radiance should be recorded.
+    bool
+    is_training() const noexcept
+    {
+        return training;
+    }
+
+    void
+    stop_training() noexcept
+    {
+        training = false;
+    }
+
+    real
+    bsdf_fraction() const noexcept
+    {
+        return params.bsdf_fraction;
+    }
+
+    Vec3
+    sample(const Vec3& pos, const Vec2& u) const noexcept
+    {
+        return dtrees[leaf(pos)].sample(u);
+    }
+
+    real
+    pdf(const Vec3& pos, const Vec3& d) const noexcept
+    {
+        return dtrees[leaf(pos)].pdf(d);
+    }
+
+    /// @brief Record radiance estimate incident at @p pos from direction @p d.
+    void
+    record(const Vec3& pos, const Vec3& d, const float radiance) noexcept
+    {
+        dtrees[leaf(pos)].record(d, radiance);
+    }
+
+    /// @brief Finish training iteration.
+    ///
+    /// Spatial leaves with many samples are split, then directional distributions
+    /// are refined to use the rest of the memory budget.
+    void
+    refine()
+    {
+        const float threshold =
+            params.spatial_threshold * std::sqrt(std::exp2(static_cast<float>(iteration)));
+        for(std::size_t i = 0ul; i < nodes.size(); ++i)
+        {
+            if(nodes[i].child) continue;
+            DTree& dtree = dtrees[nodes[i].dtree];
+            if(static_cast<float>(dtree.num_samples()) <= threshold) continue;
+            if(memory() + 2ul * sizeof(Node) + sizeof(DTree) +
+                   (dtree.num_nodes() + dtrees.size() + 1ul) * DTree::node_size >
+               params.memory)
+                continue;
+
+            // children inherit the distribution and are split later in the loop if needed
+            dtree.set_num_samples(dtree.num_samples() / 2ul);
+            const auto child   = static_cast<std::uint32_t>(nodes.size());
+            const auto axis    = static_cast<std::uint8_t>((nodes[i].axis + 1u) % 3u);
+            nodes[i].child     = child;
+            nodes.push_back(Node{0u, nodes[i].dtree, axis});
+            nodes.push_back(Node{0u, static_cast<std::uint32_t>(dtrees.size()), axis});
+            dtrees.push_back(dtrees[nodes[i].dtree]);
+        }
+
+        // building trees become sampling ones and new building trees share the rest of the budget
+        std::size_t used = nodes.size() * sizeof(Node) + dtrees.size() * sizeof(DTree);
+        for(const DTree& dtree: dtrees) used += dtree.num_building_nodes() * DTree::node_size;
+        const std::size_t available = params.memory > used ? params.memory - used : 0ul;
+        const std::size_t max_nodes = available / (DTree::node_size * dtrees.size());
+        for(DTree& dtree: dtrees)
+            dtree.refine(params.directional_threshold, params.max_depth, max_nodes);
+        ++iteration;
+    }
+
+    /// @brief Memory used by the tree in bytes.
+    std::size_t
+    memory() const noexcept
+    {
+        std::size_t ret = nodes.size() * sizeof(Node) + dtrees.size() * sizeof(DTree);
+        for(const DTree& dtree: dtrees) ret += dtree.num_nodes() * DTree::node_size;
+        return ret;
+    }
+
+    /// @brief Number of spatial leaves.
+    std::size_t
+    num_leaves() const noexcept
+    {
+        return dtrees.size();
+    }
+};
+
+/// @brief Bounds of all primitives of a scene.
+template <typename Scene>
+constexpr AABB
+scene_bound(const Scene& scene) noexcept
+{
+    return std::apply(
+        [](const auto&... prims) noexcept {
+            AABB ret{Vec3(std::numeric_limits<real>::max()),
+                     Vec3(std::numeric_limits<real>::lowest())};
+            (...,
+             (ret = AABB{lucid::min(ret.vmin, bound(prims).vmin),
+                         lucid::max(ret.vmax, bound(prims).vmax)}));
+            return ret;
+        },
+        scene);
+}
+} // namespace lucid
@@ -0,0 +1,62 @@
+// -*- C++ -*-
+// seeding.hpp
+//
+
+/// @file
+/// Random number streams derived from sample indices.
+
+#pragma once
+
+#include <cstdint>
+
+namespace lucid
+{
+/// @brief Seed of the random number stream of a single sample.
+///
+/// Streams depend only on their indices, not on which thread
+/// or in which order the samples are computed.
+/// Indices are combined with the splitmix64 finalizer,
+/// so nearby indices give unrelated seeds.
+constexpr std::uint64_t
+stream_seed(const std::uint64_t seed,
+            const std::uint64_t pixel,
+            const std::uint64_t sample) noexcept
+{
+    auto mix = [](std::uint64_t x) noexcept {
+        x = (x ^ (x >> 30u)) * 0xbf58476d1ce4e5b9ul;
+        x = (x ^ (x >> 27u)) * 0x94d049bb133111ebul;
+        return x ^ (x >> 31u);
+    };
+    return mix(mix(mix(seed) + pixel) + sample);
+}
+
+/// @brief Random engine starting the stream of @p seed.
+template <typename RandomEngine>
+RandomEngine
+seeded_engine(const std::uint64_t seed) noexcept
+{
+    // 32 bit engines drop the upper half
+    return RandomEngine(static_cast<typename RandomEngine::result_type>(seed ^ (seed >> 32u)));
+}
+
+/// @brief Task drawing random numbers from a stream of its own.
+///
+/// The task's engine is replaced with a copy of @p engine on every run,
+/// so results are reproducible regardless of the thread running the task.
+/// @tparam Task Dispatcher task with pointer to the engine in member @p g.
+template <typename Task, typename RandomEngine>
+struct Seeded
+{
+    Task         task;
+    RandomEngine engine;
+
+    auto
+    operator()() const noexcept
+    {
+        RandomEngine g = engine;
+        Task         t = task;
+        t.g            = &g;
+        return t();
+    }
+};
+} // namespace lucid
@@ -69,6 +69,16 @@ class CornellBox
         return QuadRef{ref(std::get<Pns>(points))...};
     }
 
+    template <typename Prim>
+    static constexpr auto
+    own(const Prim& prim) noexcept
+    {
+        if constexpr(std::is_same_v<Prim, QuadRef>)
+            return Quad{Vec3(prim[0]), Vec3(prim[1]), Vec3(prim[2]), Vec3(prim[3])};
+        else
+            return prim;
+    }
+
   public:
     CornellBox()                  = delete;
     CornellBox(const CornellBox&) = delete;
@@ -104,12 +114,24 @@ class CornellBox
                 }
             };
 
+            // solid angle density of Sample
+            struct Pdf
+            {
+                const Vec3& n;
+
+                real
+                operator()(const Vec3& wi, const Vec3& /* wo */) const noexcept
+                {
+                    return dot(n, wi) > 0_r ? 1_r / (2_r * Pi) : 0_r;
+                }
+            };
+
             const RGB color{0};
 
-            constexpr std::pair<Eval, Sample>
+            constexpr std::tuple<Eval, Sample, Pdf>
             operator()(const Vec3& n) const noexcept
             {
-                return {{n, color}, {n}};
+                return {{n, color}, {n}, {n}};
             }
         };
 
@@ -191,6 +213,45 @@ class CornellBox
             box);
     }
 
+    /// @brief Geometry holding its own vertices.
+    ///
+    /// Quads of geometry() reference static arrays of points, so copies of it share them,
+    /// while copies of this one are independent, e.g. for replicas on NUMA nodes.
+    static constexpr auto
+    owned_geometry() noexcept
+    {
+        return std::apply([](const auto&... prims) noexcept { return std::tuple{own(prims)...}; },
+                          geometry());
+    }
+
+    /// @brief Walls and the sphere of the box lit by a grid of @p K by @p K ceiling lights
+    /// instead of the single one, with the same area and power in total.
+    template <unsigned K>
+    static constexpr auto
+    many_lights_geometry() noexcept
+    {
+        constexpr auto room = []<std::size_t... I>(std::index_sequence<I...>) noexcept {
+            return std::tuple{std::get<I>(geometry())...};
+        }(std::make_index_sequence<6>{});
+
+        constexpr auto lights = []<std::size_t... I>(std::index_sequence<I...>) noexcept {
+            constexpr real cell = 2_r / K;
+            constexpr real half = 0.25_r / K;
+            auto           quad = [](const std::size_t i) noexcept {
+                const real y = 0.99_r;
+                const real x = -1_r + cell * (static_cast<real>(i % K) + 0.5_r);
+                const real z = -1_r + cell * (static_cast<real>(i / K) + 0.5_r);
+                return Quad{Vec3{x - half, y, z - half},
+                            Vec3{x + half, y, z - half},
+                            Vec3{x + half, y, z + half},
+                            Vec3{x - half, y, z + half}};
+            };
+            return std::tuple{quad(I)...};
+        }(std::make_index_sequence<K * K>{});
+
+        return std::tuple_cat(room, lights);
+    }
+
     static constexpr perspective::shoot
     camera(const real fov = radians(60_r)) noexcept
     {
@@ -203,5 +264,28 @@ class CornellBox
     {
         return MatGetter{};
     }
+
+    /// @brief Materials of many_lights_geometry().
+    class ManyLightsMatGetter
+    {
+        using Material = std::decay_t<decltype(MatGetter{}(0ul))>;
+
+        // walls and the sphere
+        static constexpr const std::size_t room_size = 6ul;
+        static constexpr const Material    light{{RGB(0_r)}, {RGB(10_r)}};
+
+      public:
+        constexpr const Material&
+        operator()(const std::size_t pid) const noexcept
+        {
+            return pid < room_size ? MatGetter{}(pid) : light;
+        }
+    };
+
+    static constexpr ManyLightsMatGetter
+    many_lights_mat_getter() noexcept
+    {
+        return ManyLightsMatGetter{};
+    }
 };
 } // namespace lucid
@@ -0,0 +1,115 @@
+// -*- C++ -*-
+// adaptive.cpp
+#include "property_test.hpp"
+
+#include <image_reconstruction/adaptive.hpp>
+#include <utils/tuple.hpp>
+
+#include <random>
+#include <vector>
+
+using namespace lucid;
+
+int
+main()
+{
+    std::random_device                      rd;
+    std::default_random_engine              g(rd());
+    std::uniform_int_distribution<unsigned> count_dist(2u, 200u);
+    std::uniform_real_distribution<float>   val_dist(0.f, 10.f);
+
+    int ret = 0;
+
+    ret += test_property(
+        1000,
+        0.01,
+        "Welford variance matches two-pass variance",
+        [&]() noexcept {
+            std::vector<RGB> samples(count_dist(g));
+            for(RGB& s: samples) s = RGB(generate<3>(val_dist, g));
+            return samples;
+        },
+        [](const std::vector<RGB>& samples) noexcept {
+            PixelStatistics stats(Vec2u(1u));
+            for(const RGB& s: samples) stats.update(Vec2u(0u), s);
+            return std::pair{RGB(stats.mean[Vec2u(0u)]), stats.variance(Vec2u(0u))};
+        },
+        [](const auto& estimates, const std::vector<RGB>& samples) noexcept {
+            const auto& [mean, var] = estimates;
+            const float n           = static_cast<float>(samples.size());
+            RGB         valid_mean(0.f);
+            for(const RGB& s: samples) valid_mean += s;
+            valid_mean /= n;
+            RGB valid_var(0.f);
+            for(const RGB& s: samples) valid_var += (s - valid_mean) * (s - valid_mean);
+            valid_var /= n - 1.f;
+            return any(lucid::abs(mean - valid_mean) > valid_mean * 1e-3f) ||
+                   any(lucid::abs(var - valid_var) > valid_var * 1e-3f);
+        });
+
+    ret += test_property(
+        1000,
+        0.01,
+        "Merged statistics of parts of the samples match statistics of all of them",
+        [&]() noexcept {
+            std::vector<RGB> samples(count_dist(g));
+            for(RGB& s: samples) s = RGB(generate<3>(val_dist, g));
+            return std::pair{samples, std::uniform_int_distribution(0ul, samples.size())(g)};
+        },
+        [](const std::pair<std::vector<RGB>, std::size_t>& input) noexcept {
+            const auto& [samples, split] = input;
+            const Vec2u     pidx(0u);
+            PixelStatistics all(Vec2u(1u));
+            PixelStatistics first(Vec2u(1u));
+            PixelStatistics second(Vec2u(1u));
+            for(std::size_t i = 0ul; i < samples.size(); ++i)
+            {
+                all.update(pidx, samples[i]);
+                (i < split ? first : second).update(pidx, samples[i]);
+            }
+            first.merge(pidx, second);
+            return std::tuple{all, first, second};
+        },
+        [](const auto& estimates, const auto&) noexcept {
+            const auto& [all, merged, emptied] = estimates;
+            const Vec2u pidx(0u);
+            const RGB   mean = RGB(all.mean[pidx]);
+            const RGB   var  = all.variance(pidx);
+            return any(lucid::abs(RGB(merged.mean[pidx]) - mean) > mean * 1e-3f) ||
+                   any(lucid::abs(merged.variance(pidx) - var) > var * 1e-3f) ||
+                   merged.count(pidx) != all.count(pidx) || emptied.count(pidx) != 0ul;
+        });
+
+    ret += test_property(
+        100,
+        0.,
+        "Scheduler skips converged pixels",
+        [&]() noexcept { return Vec2u(generate<2>(count_dist, g)); },
+        [&](const Vec2u& res) noexcept {
+            // the left half of the image is constant, the right half is noisy
+            PixelStatistics   stats(res);
+            AdaptiveScheduler scheduler(res, 1e-4f, 4ul, 32ul);
+            std::size_t       noisy_samples = 0ul;
+            while(const auto pidx = scheduler.next(stats))
+            {
+                const bool noisy = get_x(pidx.value()) >= get_x(res) / 2u;
+                stats.update(pidx.value(), noisy ? RGB(val_dist(g)) : RGB(1.f));
+                noisy_samples += noisy;
+            }
+            return std::pair{std::move(stats), noisy_samples};
+        },
+        [](const auto& result, const Vec2u& res) noexcept {
+            const auto& [stats, noisy_samples] = result;
+            const auto [w, h]                  = res;
+            const std::size_t num_noisy        = (w - w / 2u) * h;
+            bool              fail             = noisy_samples != num_noisy * 32ul;
+            // constant pixels next to noisy ones stay active
+            for(unsigned j = 0u; j < h; ++j)
+                for(unsigned i = 0u; i + 1u < w / 2u; ++i)
+                    fail |= stats.count(Vec2u(i, j)) != 4ul;
+            for(unsigned j = 0u; j < h; ++j) fail |= stats.count(Vec2u(w / 2u - 1u, j)) != 32ul;
+            return fail;
+        });
+
+    return ret;
+}
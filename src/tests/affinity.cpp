@@ -0,0 +1,89 @@
+// -*- C++ -*-
+// affinity.cpp
+#include "property_test.hpp"
+
+#include <scene/cornell_box.hpp>
+#include <utils/affinity.hpp>
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace lucid;
+
+int
+main()
+{
+    std::random_device                      rd;
+    std::default_random_engine              g(rd());
+    std::uniform_int_distribution<unsigned> num_ranges_dist(1u, 8u);
+    std::uniform_int_distribution<unsigned> step_dist(1u, 16u);
+    std::uniform_int_distribution<unsigned> threads_dist(1u, 256u);
+
+    int ret = 0;
+
+    ret += test_property(
+        100,
+        0.,
+        "parse_cpu_list: lists of ranges and single CPUs give all the CPUs in them",
+        [&]() noexcept {
+            std::string           list;
+            std::vector<unsigned> cpus;
+            unsigned              first = step_dist(g) - 1u;
+            for(unsigned r = num_ranges_dist(g); r > 0u; --r)
+            {
+                const unsigned last = first + step_dist(g) - 1u;
+                list += std::to_string(first);
+                if(last > first) list.append("-").append(std::to_string(last));
+                if(r > 1u) list.append(",");
+                for(unsigned cpu = first; cpu <= last; ++cpu) cpus.push_back(cpu);
+                first = last + 1u + step_dist(g);
+            }
+            return std::pair{list, cpus};
+        },
+        [](const std::string& list, const std::vector<unsigned>& cpus) {
+            return parse_cpu_list(list) == cpus;
+        },
+        [](const bool equal, const auto&) noexcept { return !equal; });
+
+    ret += test_property(
+        20,
+        0.,
+        "spread_cpus: every node gets a fair share of threads on CPUs the process may use",
+        [&]() noexcept { return threads_dist(g); },
+        [](const unsigned num_threads) {
+            const auto&           nodes = numa_nodes();
+            const auto            cpus  = spread_cpus(num_threads);
+            std::vector<unsigned> per_node(nodes.size(), 0u);
+            for(const unsigned cpu: cpus)
+                for(std::size_t node = 0ul; node < nodes.size(); ++node)
+                    per_node[node] += std::count(nodes[node].begin(), nodes[node].end(), cpu);
+            const auto [min, max] = std::minmax_element(per_node.begin(), per_node.end());
+            const auto& allowed   = allowed_cpus();
+            const bool  runnable  = std::all_of(cpus.begin(), cpus.end(), [&](unsigned cpu) {
+                return std::binary_search(allowed.begin(), allowed.end(), cpu);
+            });
+            return cpus.size() == num_threads && *max - *min <= 1u && runnable;
+        },
+        [](const bool fair, const auto&) noexcept { return !fair; });
+
+    ret += test_property(
+        1,
+        0.,
+        "NodeLocal: replicas of owned geometry have vertices of their own",
+        []() noexcept { return 0; },
+        [](int) {
+            const auto      scene = CornellBox::owned_geometry();
+            const NodeLocal replicas(scene);
+            const auto&     floor  = std::get<0>(replicas.local());
+            const auto      geo    = CornellBox::geometry();
+            const auto&     shared = std::get<0>(geo);
+            bool            equal  = true;
+            for(std::size_t i = 0ul; i < floor.size(); ++i) equal &= all(shared[i] == floor[i]);
+            return equal && &floor[0] != &std::get<0>(scene)[0];
+        },
+        [](const bool owned, const auto&) noexcept { return !owned; });
+
+    return ret;
+}
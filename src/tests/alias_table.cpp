@@ -0,0 +1,98 @@
+// -*- C++ -*-
+// alias_table.cpp
+#include "property_test.hpp"
+
+#include <sampling/alias_table.hpp>
+#include <scene/cornell_box.hpp>
+#include <utils/tuple.hpp>
+
+#include <random>
+#include <vector>
+
+using namespace lucid;
+
+// compile-time table of Cornell box primitives by area
+static constexpr auto room_areas = std::apply(
+    [](const auto&... prims) noexcept { return std::array{area(prims)...}; },
+    CornellBox::geometry());
+static constexpr StaticAliasTable<room_areas.size()> room_table(room_areas);
+static_assert(room_table.size() == room_areas.size());
+
+int
+main()
+{
+    std::random_device                      rd;
+    std::default_random_engine              g(rd());
+    std::uniform_int_distribution<unsigned> count_dist(1u, 100u);
+    std::uniform_real_distribution<real>    weight_dist(0_r, 10_r);
+    std::bernoulli_distribution             zero_dist(0.2);
+
+    auto weights_gen = [&]() noexcept {
+        std::vector<real> weights(count_dist(g));
+        for(real& w: weights) w = zero_dist(g) ? 0_r : weight_dist(g);
+        weights[0] += 1_r;
+        return weights;
+    };
+
+    // probability of each index computed over a dense grid of random numbers
+    auto frequencies = [](const auto& table, const std::vector<real>& weights) {
+        const std::size_t num_samples = weights.size() * 10000ul;
+        std::vector<real> freqs(weights.size(), 0_r);
+        for(std::size_t i = 0ul; i < num_samples; ++i)
+        {
+            const real u = (static_cast<real>(i) + 0.5_r) / static_cast<real>(num_samples);
+            freqs[table.sample(u)] += 1_r / static_cast<real>(num_samples);
+        }
+        return freqs;
+    };
+
+    auto pmf_property = [](const auto& table, const std::vector<real>& weights) noexcept {
+        real sum = 0_r;
+        for(const real w: weights) sum += w;
+        bool fail = false;
+        for(std::size_t i = 0ul; i < weights.size(); ++i)
+            fail |= !almost_equal(table.pmf(i), weights[i] / sum, 10);
+        return fail;
+    };
+
+    int ret = 0;
+
+    ret += test_property(
+        1000,
+        0.,
+        "AliasTable: pmf is proportional to weights",
+        weights_gen,
+        [](const std::vector<real>& weights) { return AliasTable(weights); },
+        pmf_property);
+
+    ret += test_property(
+        100,
+        0.,
+        "AliasTable: sampling frequencies follow pmf",
+        weights_gen,
+        [&](const std::vector<real>& weights) {
+            return frequencies(AliasTable(weights), weights);
+        },
+        [](const std::vector<real>& freqs, const std::vector<real>& weights) noexcept {
+            const AliasTable table(weights);
+            bool             fail = false;
+            for(std::size_t i = 0ul; i < freqs.size(); ++i)
+                fail |= lucid::abs(freqs[i] - table.pmf(i)) > 1e-3_r;
+            return fail;
+        });
+
+    ret += test_property(
+        1,
+        0.,
+        "StaticAliasTable: compile-time table matches run-time one",
+        [&]() noexcept { return std::vector<real>(room_areas.begin(), room_areas.end()); },
+        [&](const std::vector<real>& weights) {
+            return std::pair{frequencies(room_table, weights),
+                             frequencies(AliasTable(weights), weights)};
+        },
+        [&](const auto& freqs, const std::vector<real>& weights) noexcept {
+            return pmf_property(room_table, weights) || freqs.first != freqs.second;
+        });
+
+    return ret;
+}
@@ -0,0 +1,127 @@
+// -*- C++ -*-
+// aov.cpp
+#include "cornell_box.hpp"
+#include "property_test.hpp"
+
+#include <image_reconstruction/aov.hpp>
+#include <integrators/basic.hpp>
+#include <utils/tuple.hpp>
+
+#include <random>
+#include <vector>
+
+using namespace lucid;
+
+int
+main()
+{
+    std::random_device                      rd;
+    std::default_random_engine              g(rd());
+    std::uniform_real_distribution<real>    pos_dist(-0.5_r, 0.5_r);
+    std::uniform_real_distribution<float>   val_dist(0.f, 10.f);
+    std::uniform_int_distribution<unsigned> count_dist(1u, 100u);
+
+    const perspective::shoot cam = CornellBox::camera();
+
+    int ret = 0;
+
+    ret += test_property(
+        1000,
+        0.01,
+        "Path tracer AOVs match the first hit",
+        [&]() noexcept { return std::pair{Vec2(generate<2>(pos_dist, g)), g()}; },
+        [&](const Vec2& sample_pos, const unsigned seed) noexcept {
+            std::default_random_engine g1(seed);
+            std::default_random_engine g2(seed);
+            const auto                 plain =
+                PathTracer_<std::default_random_engine, Scene, MaterialGetter>{
+                    &g1, &room_geo, &mat_getter, cam(sample_pos), 4u, 0.001_r, sample_pos}();
+            const auto with_aov =
+                PathTracer_<std::default_random_engine, Scene, MaterialGetter, true>{
+                    &g2, &room_geo, &mat_getter, cam(sample_pos), 4u, 0.001_r, sample_pos}();
+            return std::pair{plain, with_aov};
+        },
+        [&](const auto& results, const auto& feed) noexcept {
+            const auto& [plain, with_aov]            = results;
+            const auto& [depth, sample]              = plain;
+            const auto& [aov_depth, aov_sample, aov] = with_aov;
+            const auto [pid, isect]                  = hider(cam(feed.first), room_geo);
+            // AOVs must not change the traced path
+            bool fail = depth != aov_depth || any(sample.second != aov_sample.second);
+            // the hit is computed separately, so it can differ in last digits or at edges
+            if(isect)
+                fail |= aov.primitive_id != pid || !almost_equal(aov.depth, isect.t, 10) ||
+                        !almost_equal(length(aov.normal), 1_r, 10);
+            else
+                fail |= aov.primitive_id != AOV::miss_id;
+            return fail;
+        });
+
+    ret += test_property(
+        1000,
+        0.01,
+        "AOV buffers average albedo and keep the nearest hit",
+        [&]() noexcept {
+            std::vector<AOV> aovs(count_dist(g));
+            for(std::size_t i = 0ul; i < aovs.size(); ++i)
+                aovs[i] = AOV{RGB(generate<3>(val_dist, g)), Vec3(0, 0, 1), val_dist(g), i};
+            return aovs;
+        },
+        [](const std::vector<AOV>& aovs) noexcept {
+            AOVBuffers buffers(Vec2u(1u));
+            for(const AOV& aov: aovs) buffers.update(Vec2u(0u), aov);
+            return buffers;
+        },
+        [](const AOVBuffers& buffers, const std::vector<AOV>& aovs) noexcept {
+            RGB mean(0.f);
+            for(const AOV& aov: aovs) mean += aov.albedo;
+            mean /= static_cast<float>(aovs.size());
+            const auto nearest = std::min_element(
+                aovs.begin(), aovs.end(), [](const AOV& a, const AOV& b) noexcept {
+                    return a.depth < b.depth;
+                });
+            return any(lucid::abs(RGB(buffers.albedo[Vec2u(0u)]) - mean) > mean * 1e-3f) ||
+                   get_w(buffers.albedo[Vec2u(0u)]) != static_cast<float>(aovs.size()) ||
+                   any(Vec3(buffers.normal[Vec2u(0u)]) != Vec3(0, 0, 1)) ||
+                   buffers.depth[Vec2u(0u)][0] != nearest->depth ||
+                   buffers.primitive_id[Vec2u(0u)][0] != static_cast<float>(nearest->primitive_id);
+        });
+
+    ret += test_property(
+        1000,
+        0.01,
+        "Merged AOV buffers match buffers of all the samples",
+        [&]() noexcept {
+            std::vector<AOV> aovs(count_dist(g));
+            for(std::size_t i = 0ul; i < aovs.size(); ++i)
+                aovs[i] = AOV{RGB(generate<3>(val_dist, g)), Vec3(0, 0, 1), val_dist(g), i};
+            return std::pair{aovs, std::uniform_int_distribution(0ul, aovs.size())(g)};
+        },
+        [](const std::pair<std::vector<AOV>, std::size_t>& input) noexcept {
+            const auto& [aovs, split] = input;
+            const Vec2u pidx(0u);
+            AOVBuffers  all(Vec2u(1u));
+            AOVBuffers  first(Vec2u(1u));
+            AOVBuffers  second(Vec2u(1u));
+            for(std::size_t i = 0ul; i < aovs.size(); ++i)
+            {
+                all.update(pidx, aovs[i]);
+                (i < split ? first : second).update(pidx, aovs[i]);
+            }
+            first.merge(pidx, second);
+            return std::tuple{all, first, second};
+        },
+        [](const auto& buffers, const auto&) noexcept {
+            const auto& [all, merged, emptied] = buffers;
+            const Vec2u pidx(0u);
+            const RGB   mean = RGB(all.albedo[pidx]);
+            return any(lucid::abs(RGB(merged.albedo[pidx]) - mean) > mean * 1e-3f) ||
+                   get_w(merged.albedo[pidx]) != get_w(all.albedo[pidx]) ||
+                   any(lucid::abs(Vec3(merged.normal[pidx]) - Vec3(0, 0, 1)) > 1e-3f) ||
+                   merged.depth[pidx][0] != all.depth[pidx][0] ||
+                   merged.primitive_id[pidx][0] != all.primitive_id[pidx][0] ||
+                   get_w(emptied.albedo[pidx]) != 0.f || emptied.primitive_id[pidx][0] != -1.f;
+        });
+
+    return ret;
+}
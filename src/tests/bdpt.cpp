@@ -0,0 +1,139 @@
+// -*- C++ -*-
+// bdpt.cpp
+#include "cornell_box.hpp"
+#include "property_test.hpp"
+
+#include <integrators/basic.hpp>
+#include <integrators/bdpt.hpp>
+#include <utils/arena.hpp>
+#include <utils/tuple.hpp>
+
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <utility>
+
+using namespace lucid;
+
+struct Estimate
+{
+    double mean;
+    double variance; // of the mean
+};
+
+// mean luminance of n samples of a point on the film
+template <typename MakeTask>
+Estimate
+estimate(const std::size_t n, MakeTask&& make_task)
+{
+    double sum  = 0.;
+    double sum2 = 0.;
+    for(std::size_t i = 0ul; i < n; ++i)
+    {
+        const double v = avg(make_task()().second.second);
+        sum += v;
+        sum2 += v * v;
+    }
+    const double mean = sum / static_cast<double>(n);
+    return {mean, (sum2 / static_cast<double>(n) - mean * mean) / static_cast<double>(n)};
+}
+
+// estimates of path tracing and BDPT of film position pos
+template <typename Scene, typename MaterialGetter>
+std::pair<Estimate, Estimate>
+estimates(const Scene&                scene,
+          const MaterialGetter&       mat_getter,
+          const SceneLights&          lights,
+          const AliasTable&           table,
+          const Vec2&                 pos,
+          const std::uint8_t          max_depth,
+          std::default_random_engine& g)
+{
+    using PathTracer = PathTracer_<std::default_random_engine, Scene, MaterialGetter>;
+    using BDPT = BidirectionalPathTracer_<std::default_random_engine, Scene, MaterialGetter>;
+
+    const perspective::shoot cam  = CornellBox::camera();
+    const real               bias = 0.001_r;
+
+    const Estimate pt = estimate(20000ul, [&]() noexcept {
+        return PathTracer{&g, &scene, &mat_getter, cam(pos), max_depth, bias, pos};
+    });
+    const Estimate bdpt = estimate(20000ul, [&]() noexcept {
+        return BDPT{&g, &scene, &mat_getter, &lights, &table, cam(pos), max_depth, bias, pos};
+    });
+    return {pt, bdpt};
+}
+
+int
+main()
+{
+    std::random_device                         rd;
+    std::default_random_engine                 g(rd());
+    std::uniform_int_distribution<std::size_t> size_dist(0ul, 1ul << 14u);
+    std::uniform_real_distribution<real>       film_dist(-0.5_r, 0.5_r);
+    std::uniform_int_distribution<unsigned>    depth_dist(1u, 6u);
+
+    int ret = 0;
+
+    ret += test_property(
+        100,
+        0.,
+        "Arena: arrays are aligned, disjoint and reuse memory after reset",
+        [&]() noexcept { return std::pair{size_dist(g), size_dist(g)}; },
+        [](const std::size_t n1, const std::size_t n2) {
+            Arena      arena(1ul << 10u);
+            const auto a = arena.allocate<char>(n1);
+            const auto b = arena.allocate<double>(n2);
+            const bool aligned =
+                reinterpret_cast<std::uintptr_t>(b.data()) % alignof(double) == 0ul;
+            const bool disjoint = reinterpret_cast<char*>(b.data()) >= a.data() + n1 ||
+                                  reinterpret_cast<char*>(b.data() + n2) <= a.data();
+            const std::size_t capacity = arena.capacity();
+            arena.reset();
+            arena.allocate<char>(n1);
+            arena.allocate<double>(n2);
+            return aligned && disjoint && capacity == arena.capacity();
+        },
+        [](const bool passed, const auto&) noexcept { return !passed; });
+
+    const SceneLights room_lights = collect_lights(room_geo, mat_getter);
+    const AliasTable  room_table  = power_table(room_lights);
+    const SceneLights many_lights = collect_lights(many_lights_geo, many_lights_mat_getter);
+    const AliasTable  many_table  = power_table(many_lights);
+
+    auto feed = [&]() noexcept {
+        return std::pair{Vec2(generate<2>(film_dist, g)), static_cast<std::uint8_t>(depth_dist(g))};
+    };
+    auto disagree = [](const std::pair<Estimate, Estimate>& estimates, const auto&) noexcept {
+        const auto& [pt, bdpt] = estimates;
+        return std::abs(pt.mean - bdpt.mean) > 4. * std::sqrt(pt.variance + bdpt.variance);
+    };
+
+    ret += test_property(
+        20,
+        0.1,
+        "BDPT: pixel estimates agree with path tracing",
+        feed,
+        [&](const Vec2& pos, const std::uint8_t max_depth) {
+            return estimates(room_geo, mat_getter, room_lights, room_table, pos, max_depth, g);
+        },
+        disagree);
+
+    ret += test_property(
+        20,
+        0.1,
+        "BDPT: connections to lights chosen from the hierarchy agree with path tracing",
+        feed,
+        [&](const Vec2& pos, const std::uint8_t max_depth) {
+            return estimates(many_lights_geo,
+                             many_lights_mat_getter,
+                             many_lights,
+                             many_table,
+                             pos,
+                             max_depth,
+                             g);
+        },
+        disagree);
+
+    return ret;
+}
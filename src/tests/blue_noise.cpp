@@ -0,0 +1,139 @@
+// -*- C++ -*-
+// blue_noise.cpp
+#include "property_test.hpp"
+
+#include <sampling/blue_noise.hpp>
+#include <sampling/seeding.hpp>
+#include <utils/tuple.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+using namespace lucid;
+
+using RandomEngine = std::default_random_engine;
+
+// squared error of a 3x3 box filtered image of one sample per pixel estimates of a step function
+double
+blurred_error(const std::uint64_t seed, BlueNoiseMask const* mask, const real step) noexcept
+{
+    const unsigned      n = 64u;
+    std::vector<double> err(n * n);
+    for(unsigned j = 0u; j < n; ++j)
+        for(unsigned i = 0u; i < n; ++i)
+        {
+            // dithered pixels share the stream
+            const std::uint64_t pixel = mask ? 0ul : j * n + i;
+            DitheredEngine<RandomEngine> g(
+                seeded_engine<RandomEngine>(stream_seed(seed, pixel, 0ul)), mask, Vec2u(i, j));
+            const real u    = std::generate_canonical<real, 8>(g);
+            err[j * n + i] = (u < step ? 1. : 0.) - step;
+        }
+
+    double ret = 0.;
+    for(unsigned j = 1u; j + 1u < n; ++j)
+        for(unsigned i = 1u; i + 1u < n; ++i)
+        {
+            double blurred = 0.;
+            for(unsigned y = j - 1u; y <= j + 1u; ++y)
+                for(unsigned x = i - 1u; x <= i + 1u; ++x) blurred += err[y * n + x] / 9.;
+            ret += blurred * blurred;
+        }
+    return ret;
+}
+
+int
+main()
+{
+    std::random_device                           rd;
+    std::default_random_engine                   g(rd());
+    std::uniform_int_distribution<unsigned>      log2_size_dist(2u, 6u);
+    std::uniform_int_distribution<unsigned>      pixel_dist(0u, 1000u);
+    std::uniform_int_distribution<std::size_t>   dim_dist(0ul, 100ul);
+    std::uniform_int_distribution<std::uint64_t> seed_dist;
+    std::uniform_real_distribution<real>         step_dist(0.2_r, 0.8_r);
+
+    int ret = 0;
+
+    ret += test_property(
+        10,
+        0.,
+        "BlueNoiseMask: every rank appears exactly once",
+        [&]() noexcept { return log2_size_dist(g); },
+        [](const unsigned log2_size) {
+            const BlueNoiseMask mask(log2_size);
+            std::vector<real>   values;
+            for(unsigned j = 0u; j < mask.size(); ++j)
+                for(unsigned i = 0u; i < mask.size(); ++i) values.push_back(mask(Vec2u(i, j), 0ul));
+            std::sort(values.begin(), values.end());
+            return values;
+        },
+        [](const std::vector<real>& values, const auto&) noexcept {
+            const real n = static_cast<real>(values.size());
+            for(std::size_t k = 0ul; k < values.size(); ++k)
+                if(values[k] != (static_cast<real>(k) + 0.5_r) / n) return true;
+            return false;
+        });
+
+    const BlueNoiseMask mask;
+
+    ret += test_property(
+        100,
+        0.,
+        "BlueNoiseMask: neighbouring values are negatively correlated in every dimension",
+        [&]() noexcept { return dim_dist(g); },
+        [&](const std::size_t dim) noexcept {
+            double covariance = 0.;
+            for(unsigned j = 0u; j < mask.size(); ++j)
+                for(unsigned i = 0u; i < mask.size(); ++i)
+                    covariance += (mask(Vec2u(i, j), dim) - 0.5_r) *
+                                  (mask(Vec2u(i + 1u, j), dim) - 0.5_r);
+            return covariance / static_cast<double>(mask.size() * mask.size());
+        },
+        // variance of the values is 1/12
+        [](const double covariance, const auto&) noexcept { return covariance > -0.1 / 12.; });
+
+    ret += test_property(
+        100,
+        0.,
+        "DitheredEngine: numbers of a pixel are uniformly distributed",
+        [&]() noexcept { return Vec2u(generate<2>(pixel_dist, g)); },
+        [&](const Vec2u& pixel) {
+            const std::size_t n = 10000ul;
+            double            sum = 0.;
+            bool              in_range = true;
+            for(std::size_t s = 0ul; s < n; ++s)
+            {
+                DitheredEngine<RandomEngine> engine(
+                    seeded_engine<RandomEngine>(stream_seed(seed_dist(g), 0ul, s)), &mask, pixel);
+                for(std::size_t dim = 0ul; dim < 4ul; ++dim)
+                {
+                    const auto x = engine();
+                    in_range &= x >= RandomEngine::min() && x <= RandomEngine::max();
+                    sum += std::generate_canonical<double, 8>(engine);
+                }
+            }
+            return std::pair{sum / static_cast<double>(4ul * n), in_range};
+        },
+        [](const std::pair<double, bool>& result, const auto&) noexcept {
+            const auto& [mean, in_range] = result;
+            // within 4 standard deviations
+            return !in_range || std::abs(mean - 0.5) > 4. * std::sqrt(1. / 12. / 40000.);
+        });
+
+    ret += test_property(
+        20,
+        0.1,
+        "DitheredEngine: dithering lowers error seen through a low pass filter",
+        [&]() noexcept { return std::pair{seed_dist(g), step_dist(g)}; },
+        [&](const std::uint64_t seed, const real step) noexcept {
+            return std::pair{blurred_error(seed, nullptr, step), blurred_error(seed, &mask, step)};
+        },
+        [](const std::pair<double, double>& errors, const auto&) noexcept {
+            return errors.second >= errors.first;
+        });
+
+    return ret;
+}
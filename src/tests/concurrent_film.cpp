@@ -0,0 +1,61 @@
+// -*- C++ -*-
+// concurrent_film.cpp
+#include "films.hpp"
+#include "property_test.hpp"
+
+#include <image_reconstruction/concurrent_film.hpp>
+
+#include <random>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+using namespace lucid;
+
+int
+main()
+{
+    std::random_device                      rd;
+    std::default_random_engine              g(rd());
+    std::uniform_int_distribution<unsigned> res_dist(1u, 64u);
+    std::uniform_int_distribution<unsigned> threads_dist(1u, 8u);
+    std::uniform_real_distribution<real>    radius_dist(0.5_r, 4_r);
+
+    int ret = 0;
+
+    ret += test_property(
+        20,
+        0.,
+        "ConcurrentFilm: concurrent splats match samples accumulated into a single film",
+        [&]() noexcept {
+            const Vec2u res(res_dist(g), res_dist(g));
+            return std::tuple{res, random_samples(g, res), threads_dist(g), radius_dist(g)};
+        },
+        [](const Vec2u&               res,
+           const std::vector<Sample>& samples,
+           const unsigned             threads,
+           const real                 radius) {
+            FilmRGBA          serial{res};
+            FilmRGBA          resolved{res};
+            ConcurrentFilm    film{res};
+            const PixelUpdate updater{TriangleFilter(radius * serial._pixel_width)};
+
+            for(const auto& sample: samples)
+                sample_based_region_update(serial, updater, sample);
+
+            std::vector<std::thread> workers;
+            for(unsigned t = 0u; t < threads; ++t)
+                workers.emplace_back([&, t]() {
+                    for(std::size_t k = t; k < samples.size(); k += threads)
+                        sample_based_region_update(film, updater, samples[k]);
+                });
+            for(auto& worker: workers) worker.join();
+            resolve(film, resolved);
+
+            return max_difference(serial, resolved);
+        },
+        // rounding differs with the order of samples
+        [](const real max_diff, const auto&) noexcept { return max_diff > 1e-3_r; });
+
+    return ret;
+}
@@ -0,0 +1,22 @@
+// -*- C++ -*-
+// cornell_box.hpp
+//
+
+/// @file
+/// Cornell box scenes the tests of integrators render.
+
+#pragma once
+
+#include <scene/cornell_box.hpp>
+
+#include <type_traits>
+
+static constexpr auto room_geo   = lucid::CornellBox::geometry();
+static constexpr auto mat_getter = lucid::CornellBox::mat_getter();
+
+using Scene          = std::decay_t<decltype(room_geo)>;
+using MaterialGetter = std::decay_t<decltype(mat_getter)>;
+
+// the box lit by 16 lights
+static constexpr auto many_lights_geo        = lucid::CornellBox::many_lights_geometry<4>();
+static constexpr auto many_lights_mat_getter = lucid::CornellBox::many_lights_mat_getter();
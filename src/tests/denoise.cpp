@@ -0,0 +1,110 @@
+// -*- C++ -*-
+// denoise.cpp
+#include "property_test.hpp"
+
+#include <image_reconstruction/denoise.hpp>
+#include <utils/tuple.hpp>
+
+#include <random>
+
+using namespace lucid;
+
+struct Input
+{
+    ScanlineImage<float, 4> img;
+    PixelStatistics         stats;
+    AOVBuffers              aovs;
+    RGB                     color;
+};
+
+int
+main()
+{
+    std::random_device                      rd;
+    std::default_random_engine              g(rd());
+    std::uniform_int_distribution<unsigned> res_dist(1u, 64u);
+    std::uniform_int_distribution<unsigned> spp_dist(1u, 8u);
+    std::uniform_real_distribution<float>   val_dist(0.1f, 10.f);
+    std::uniform_real_distribution<float>   noise_dist(0.5f, 1.5f);
+
+    // noisy image of a plane with constant radiance
+    auto generate_input = [&]() {
+        const Vec2u    res(generate<2>(res_dist, g));
+        const unsigned spp = spp_dist(g);
+        Input          input{ScanlineImage<float, 4>(res),
+                    PixelStatistics(res),
+                    AOVBuffers(res),
+                    RGB(generate<3>(val_dist, g))};
+        for(auto it = input.img.begin(); it != input.img.end(); ++it)
+        {
+            const Vec2u pidx = it.pos();
+            for(unsigned i = 0u; i < spp; ++i)
+            {
+                input.stats.update(pidx, input.color * noise_dist(g));
+                input.aovs.update(pidx, AOV{RGB(0.5f), Vec3(0, 0, 1), 1_r, 0ul});
+            }
+            *it = RGBA(RGB(input.stats.mean[pidx]), 1.f);
+        }
+        return input;
+    };
+
+    auto rel_error = [](const ScanlineImage<float, 4>& img, const RGB& color) noexcept {
+        float sum = 0.f;
+        for(const auto pix: img) sum += avg(lucid::abs(RGB(pix) - color) / color);
+        return sum / static_cast<float>(img.num_pixels());
+    };
+
+    int ret = 0;
+
+    ret += test_property(
+        100,
+        0.,
+        "Denoiser keeps constant image",
+        [&]() noexcept {
+            Input input = generate_input();
+            for(auto pix: input.img) pix = RGBA(input.color, 1.f);
+            return input;
+        },
+        [](const Input& input) noexcept {
+            ATrousDenoiser denoiser(input.img.res());
+            return ScanlineImage<float, 4>(denoiser(input.img, input.stats, input.aovs));
+        },
+        [&](const ScanlineImage<float, 4>& denoised, const Input& input) noexcept {
+            return rel_error(denoised, input.color) > 1e-5f;
+        });
+
+    ret += test_property(
+        100,
+        0.05,
+        "Denoiser reduces noise",
+        generate_input,
+        [](const Input& input) noexcept {
+            ATrousDenoiser denoiser(input.img.res());
+            return ScanlineImage<float, 4>(denoiser(input.img, input.stats, input.aovs));
+        },
+        [&](const ScanlineImage<float, 4>& denoised, const Input& input) noexcept {
+            return product(input.img.res()) > 16u &&
+                   rel_error(denoised, input.color) > rel_error(input.img, input.color) * 0.5f;
+        });
+
+    ret += test_property(
+        100,
+        0.,
+        "Multithreaded denoiser matches single-threaded one",
+        generate_input,
+        [](const Input& input) noexcept {
+            ATrousDenoiser single(input.img.res(), ATrousDenoiser::Params{}, 1u);
+            ATrousDenoiser multi(input.img.res(), ATrousDenoiser::Params{}, 4u);
+            return std::pair{ScanlineImage<float, 4>(single(input.img, input.stats, input.aovs)),
+                             ScanlineImage<float, 4>(multi(input.img, input.stats, input.aovs))};
+        },
+        [](const auto& images, const Input&) noexcept {
+            const auto& [single, multi] = images;
+            bool fail                   = false;
+            for(auto it = single.begin(); it != single.end(); ++it)
+                fail |= any(*it != multi[it.pos()]);
+            return fail;
+        });
+
+    return ret;
+}
@@ -3,7 +3,11 @@
 #include <utils/dispatcher.hpp>
 #include <utils/timer.hpp>
 
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <numeric>
+#include <vector>
 
 #include <fmt/format.h>
 
@@ -31,6 +35,49 @@ struct TimerTask
 
 using TestTimerTask = TimerTask<std::chrono::milliseconds, int>;
 
+struct EpochTimerTask : TestTimerTask
+{
+    std::uint64_t epoch = 0;
+};
+
+static std::atomic_int run_count{0};
+
+// returns the order it ran in
+struct OrderedTask
+{
+    std::chrono::milliseconds pause{0};
+
+    int
+    operator()() const noexcept
+    {
+        std::this_thread::sleep_for(pause);
+        return run_count.fetch_add(1);
+    }
+};
+
+using UrgentTask = Prioritized<OrderedTask, 1u>;
+using AsyncDispatcher = Dispatcher<Awaited<TestTimerTask>>;
+
+// tasks awaited one after another and in bulk, resuming on workers
+Async<int>
+pipeline(AsyncDispatcher& dispatcher, const int n)
+{
+    int sum = 0;
+    for(int i = 0; i < n; ++i) sum += co_await dispatcher.submit(TestTimerTask{0ms, 1});
+
+    const auto results =
+        co_await dispatcher.when_all(std::vector<TestTimerTask>(n, TestTimerTask{1ms, 1}));
+    co_return std::accumulate(results.begin(), results.end(), sum);
+}
+
+Async<int>
+nested_pipelines(AsyncDispatcher& dispatcher, const int n)
+{
+    const int a = co_await pipeline(dispatcher, n);
+    const int b = co_await pipeline(dispatcher, n);
+    co_return a + b;
+}
+
 
 int main()
 {
@@ -73,6 +120,97 @@ int main()
                N,
                std::chrono::duration_cast<std::chrono::milliseconds>(timer.elapsed()).count());
 
+    Dispatcher<TestTimerTask> bulk_dispatcher(1000, 4, 8);
+    auto producer_token = bulk_dispatcher.producer_token<TestTimerTask>();
+    auto consumer_token = bulk_dispatcher.consumer_token<TestTimerTask>();
+
+    const std::vector<TestTimerTask> tasks(N, TestTimerTask{0ms, 1});
+    while (!bulk_dispatcher.try_submit_bulk(producer_token, tasks.begin(), tasks.size()))
+    {
+        fmt::print("Failed to submit tasks\n");
+    }
+
+    std::vector<int> results(N);
+    std::size_t      fetched = 0;
+    while (fetched < results.size())
+        fetched += bulk_dispatcher.fetch_results<TestTimerTask>(
+            consumer_token, results.begin() + fetched, results.size() - fetched);
+
+    const int sum = std::accumulate(results.begin(), results.end(), 0);
+    fmt::print("{} results fetched in bulk; Sum: {}\n", fetched, sum);
+
+    AsyncDispatcher async_dispatcher(1000, 4);
+    const int       async_sum = sync_wait(nested_pipelines(async_dispatcher, N));
+    fmt::print("{} results awaited; Sum: {}\n", 4 * N, async_sum);
+
+    // a worker resuming the coroutine can't wait for room in a queue only it drains
+    AsyncDispatcher single_worker(4, 1);
+    const int       deferred_sum = sync_wait(nested_pipelines(single_worker, 4 * N));
+    fmt::print("{} results awaited through a small queue; Sum: {}\n", 16 * N, deferred_sum);
+
+    // tasks queued before a new epoch are skipped and their results dropped
+    Dispatcher<EpochTimerTask> epoch_dispatcher(1000, 1);
+    for (int i = 0; i < N; ++i)
+        while (!epoch_dispatcher.try_submit(EpochTimerTask{{10ms, 1}, epoch_dispatcher.epoch()}));
+
+    const std::uint64_t epoch = epoch_dispatcher.next_epoch();
+    ElapsedTimer<>      epoch_timer;
+    for (int i = 0; i < N; ++i)
+        while (!epoch_dispatcher.try_submit(EpochTimerTask{{0ms, 2}, epoch}));
+
+    int epoch_sum = 0;
+    for (int fetched_results = 0; fetched_results < N;)
+        if (const auto result = epoch_dispatcher.fetch_result<EpochTimerTask>())
+        {
+            epoch_sum += result.value();
+            ++fetched_results;
+        }
+    const auto epoch_time =
+        std::chrono::duration_cast<std::chrono::milliseconds>(epoch_timer.elapsed());
+    fmt::print("{} results of the new epoch in {} ms; Sum: {}\n", N, epoch_time.count(), epoch_sum);
+
+    const bool cancelled = epoch_sum == 2 * N && epoch_time < 10ms * N / 2;
+
+    // urgent tasks run before the others queued ahead of them
+    Dispatcher<OrderedTask, UrgentTask> priority_dispatcher(1000, 1);
+    while (!priority_dispatcher.try_submit(OrderedTask{10ms}));
+    for (int i = 0; i < N; ++i)
+        while (!priority_dispatcher.try_submit(OrderedTask{}));
+    for (int i = 0; i < N; ++i)
+        while (!priority_dispatcher.try_submit(UrgentTask{{}}));
+
+    int last_urgent = -1;
+    int first_other = 2 * N + 1;
+    for (int urgent = 0, other = 0; urgent < N || other <= N;)
+    {
+        if (const auto result = priority_dispatcher.fetch_result<UrgentTask>())
+        {
+            last_urgent = std::max(last_urgent, result.value());
+            ++urgent;
+        }
+        // the first task may have started before urgent ones were queued
+        if (const auto result = priority_dispatcher.fetch_result<OrderedTask>())
+            if (other++ > 0) first_other = std::min(first_other, result.value());
+    }
+    fmt::print("Urgent tasks ran until {}, others from {}\n", last_urgent, first_other);
+
+    // a queue smaller than the bulk size, with more workers enqueueing results than it has
+    // room for, still gets every task through
+    Dispatcher<TestTimerTask> small_dispatcher(8, 8, 32);
+    int                       small_sum = 0;
+    for (int submitted = 0, fetched_results = 0; fetched_results < 4 * N;)
+    {
+        if (submitted < 4 * N && small_dispatcher.try_submit(TestTimerTask{0ms, 1})) ++submitted;
+        if (const auto result = small_dispatcher.fetch_result<TestTimerTask>())
+        {
+            small_sum += result.value();
+            ++fetched_results;
+        }
+    }
+    fmt::print("{} results through a small queue; Sum: {}\n", 4 * N, small_sum);
 
-    return 0;
+    return sum == N && async_sum == 4 * N && deferred_sum == 16 * N && cancelled &&
+                   last_urgent < first_other && small_sum == 4 * N
+               ? 0
+               : 1;
 }
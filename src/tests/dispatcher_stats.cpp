@@ -0,0 +1,120 @@
+// -*- C++ -*-
+// dispatcher_stats.cpp
+// built with _DISPATCHER_STATS, see CMakeLists.txt
+#include <utils/dispatcher.hpp>
+
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include <fmt/format.h>
+
+static_assert(lucid::dispatcher_stats, "dispatcher statistics are not compiled in");
+
+using namespace std::chrono_literals;
+using namespace lucid;
+
+struct SleepTask
+{
+    std::chrono::microseconds pause{100};
+
+    int
+    operator()() const noexcept
+    {
+        std::this_thread::sleep_for(pause);
+        return 1;
+    }
+};
+
+struct OtherTask : SleepTask
+{
+};
+
+struct VectorTask
+{
+    std::vector<int> values;
+
+    int
+    operator()() const noexcept
+    {
+        return static_cast<int>(values.size());
+    }
+};
+
+int main()
+{
+    constexpr int N = 200;
+
+    // only the last samples of the depths are kept
+    DispatcherStats<2> ring(1, 4);
+    for(std::size_t i = 0ul; i < 10ul; ++i) ring.add_depths({i, 0ul}, {0ul, i});
+    const auto kept = ring.queue_depths();
+    bool       ordered = kept.size() == 4ul;
+    for(std::size_t i = 0ul; ordered && i < kept.size(); ++i)
+        ordered = kept[i].tasks[0] == 6ul + i && kept[i].results[1] == 6ul + i;
+    fmt::print("Kept {} samples of the depths\n", kept.size());
+
+    // tasks are stamped on submission, but the ones that don't fit are left to the caller
+    Dispatcher<VectorTask> full(1, 0);
+    VectorTask             task{std::vector<int>(3, 1)};
+    while(full.try_submit(VectorTask(task)));
+    const bool left = !full.try_submit(std::move(task)) && task.values.size() == 3ul;
+
+    Dispatcher<SleepTask, OtherTask> dispatcher(1000, 2);
+    for(int i = 0; i < N; ++i)
+    {
+        while(!dispatcher.try_submit(SleepTask{}));
+        while(!dispatcher.try_submit(OtherTask{}));
+    }
+
+    int sum = 0;
+    for(int fetched = 0; fetched < 2 * N;)
+    {
+        if(const auto result = dispatcher.fetch_result<SleepTask>())
+        {
+            sum += result.value();
+            ++fetched;
+        }
+        if(const auto result = dispatcher.fetch_result<OtherTask>())
+        {
+            sum += result.value();
+            ++fetched;
+        }
+    }
+
+    const auto&   stats     = dispatcher.stats();
+    const auto    elapsed   = static_cast<std::uint64_t>(stats.elapsed().count());
+    std::uint64_t num_tasks = 0ul;
+    std::uint64_t busy      = 0ul;
+    // every worker is busy, spinning or parked, except for the interval it's in now
+    bool accounted = true;
+    for(std::size_t w = 0ul; w < stats.workers(); ++w)
+    {
+        const WorkerStats&  worker = stats.worker(w);
+        const std::uint64_t total  =
+            worker.busy.load() + worker.spinning.load() + worker.parked.load();
+        num_tasks += worker.num_tasks.load();
+        busy += worker.busy.load();
+        accounted = accounted && total <= elapsed && total >= elapsed / 2ul;
+    }
+    const auto sleep_count = stats.run_time(0).count();
+    const auto other_count = stats.run_time(1).count();
+    fmt::print("{} tasks run, {} and {} of each type, busy for {} ns; p50 {} ns, latency {} ns\n",
+               num_tasks,
+               sleep_count,
+               other_count,
+               busy,
+               stats.run_time(0).quantile(0.5).count(),
+               stats.latency(0).quantile(0.5).count());
+
+    const bool counted = num_tasks == 2ul * N && sleep_count == N && other_count == N &&
+                         stats.latency(0).count() == N && stats.latency(1).count() == N;
+    const bool timed   = busy >= 2ul * N * 100'000ul && stats.run_time(0).quantile(0.5) >= 100us;
+    // tasks wait in the queue for the ones submitted before them
+    const bool waited  = stats.latency(0).quantile(0.9) > stats.run_time(0).quantile(0.9);
+    const bool bounded = stats.queue_depths().size() <= DispatcherStats<2>::default_max_depths;
+
+    return sum == 2 * N && ordered && left && counted && timed && waited && accounted && bounded
+               ? 0
+               : 1;
+}
@@ -0,0 +1,98 @@
+// -*- C++ -*-
+// environment_map.cpp
+#include "property_test.hpp"
+
+#include <sampling/environment_map.hpp>
+#include <utils/tuple.hpp>
+
+#include <cmath>
+#include <random>
+
+using namespace lucid;
+
+// uniformly distributed direction
+Vec3
+sphere_dir(const Vec2& u) noexcept
+{
+    const real z   = 1_r - 2_r * u[0];
+    const real r   = std::sqrt(std::max(1_r - z * z, 0_r));
+    const real phi = 2_r * Pi * u[1];
+    return Vec3(r * std::cos(phi), z, r * std::sin(phi));
+}
+
+int
+main()
+{
+    std::random_device                      rd;
+    std::default_random_engine              g(rd());
+    std::uniform_int_distribution<unsigned> res_dist(1u, 64u);
+    std::uniform_real_distribution<real>    u_dist(0_r, 1_r);
+    std::exponential_distribution<float>    rad_dist(1.f);
+
+    auto env_gen = [&]() {
+        ScanlineImage<float, 3> img(Vec2u(res_dist(g), res_dist(g)));
+        for(auto pix: img)
+            for(std::size_t c = 0ul; c < 3ul; ++c) pix[c] = rad_dist(g);
+        return EnvironmentMap(std::move(img));
+    };
+
+    int ret = 0;
+
+    ret += test_property(
+        100,
+        0.,
+        "EnvironmentMap: pdf integrates to one over the sphere",
+        env_gen,
+        [&](const EnvironmentMap& env) {
+            constexpr std::size_t n   = 100000ul;
+            real                  sum = 0_r;
+            for(std::size_t i = 0ul; i < n; ++i)
+                sum += env.pdf(sphere_dir(Vec2(generate<2>(u_dist, g))));
+            return sum * 4_r * Pi / static_cast<real>(n);
+        },
+        [](const real integral, const auto&) noexcept {
+            return lucid::abs(integral - 1_r) > 0.05_r;
+        });
+
+    ret += test_property(
+        100,
+        0.01,
+        "EnvironmentMap: sampled pdf and radiance match lookups",
+        [&]() {
+            return std::tuple{env_gen(), u_dist(g), Vec2(generate<2>(u_dist, g))};
+        },
+        [](const EnvironmentMap& env, const real u_pixel, const Vec2& u) noexcept {
+            return env.sample(u_pixel, u);
+        },
+        [](const EnvironmentSample& es, const auto& feed) noexcept {
+            const EnvironmentMap& env = std::get<0>(feed);
+            return !almost_equal(length(es.dir), 1_r, 10) ||
+                   !almost_equal(es.pdf, env.pdf(es.dir), 100) ||
+                   !all(almost_equal(es.radiance, env.radiance(es.dir), 10));
+        });
+
+    ret += test_property(
+        100,
+        0.,
+        "EnvironmentMap: importance sampling estimates incident power",
+        env_gen,
+        [&](const EnvironmentMap& env) {
+            constexpr std::size_t n       = 10000ul;
+            real                  sampled = 0_r;
+            real                  uniform = 0_r;
+            for(std::size_t i = 0ul; i < n; ++i)
+            {
+                const EnvironmentSample es = env.sample(u_dist(g), Vec2(generate<2>(u_dist, g)));
+                sampled += avg(es.radiance) / es.pdf;
+            }
+            // reference estimate with uniformly distributed directions
+            for(std::size_t i = 0ul; i < n * 10ul; ++i)
+                uniform += avg(env.radiance(sphere_dir(Vec2(generate<2>(u_dist, g))))) * 4_r * Pi;
+            return std::pair{sampled / static_cast<real>(n), uniform / static_cast<real>(n * 10ul)};
+        },
+        [](const std::pair<real, real>& estimates, const auto&) noexcept {
+            return lucid::abs(estimates.first - estimates.second) > 0.05_r * estimates.second;
+        });
+
+    return ret;
+}
@@ -0,0 +1,59 @@
+// -*- C++ -*-
+// film_pool.cpp
+#include "films.hpp"
+#include "property_test.hpp"
+
+#include <image_reconstruction/film_pool.hpp>
+
+#include <random>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+using namespace lucid;
+
+int
+main()
+{
+    std::random_device                      rd;
+    std::default_random_engine              g(rd());
+    std::uniform_int_distribution<unsigned> res_dist(1u, 64u);
+    std::uniform_int_distribution<unsigned> threads_dist(1u, 8u);
+
+    int ret = 0;
+
+    ret += test_property(
+        20,
+        0.,
+        "FilmPool: merged films match samples accumulated into a single film",
+        [&]() noexcept {
+            const Vec2u res(res_dist(g), res_dist(g));
+            return std::tuple{res, random_samples(g, res), threads_dist(g)};
+        },
+        [](const Vec2u& res, const std::vector<Sample>& samples, const unsigned threads) {
+            FilmRGBA          serial{res};
+            FilmRGBA          merged{res};
+            const PixelUpdate updater{TriangleFilter(serial._pixel_radius)};
+            FilmPool<Image>   pool(res, threads);
+
+            for(const auto& sample: samples)
+                sample_based_region_update(serial, updater, sample);
+
+            std::vector<std::thread> workers;
+            for(unsigned t = 0u; t < threads; ++t)
+                workers.emplace_back([&, t]() {
+                    for(std::size_t k = t; k < samples.size(); k += threads)
+                        pool.with_film([&](FilmRGBA& film) {
+                            sample_based_region_update(film, updater, samples[k]);
+                        });
+                });
+            for(auto& worker: workers) worker.join();
+            pool.reduce(merged, threads);
+
+            return max_difference(serial, merged);
+        },
+        // rounding differs with the order of samples
+        [](const real max_diff, const auto&) noexcept { return max_diff > 1e-3_r; });
+
+    return ret;
+}
@@ -0,0 +1,54 @@
+// -*- C++ -*-
+// films.hpp
+//
+
+/// @file
+/// Samples and comparison of films the tests of concurrent accumulation share.
+
+#pragma once
+
+#include <image_reconstruction/filtering.hpp>
+#include <utils/tuple.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+using Image    = lucid::ScanlineImage<float, 4>;
+using FilmRGBA = lucid::Film<Image>;
+
+// 4 samples per pixel on average at random positions of a film of resolution res
+template <typename Generator>
+std::vector<lucid::Sample>
+random_samples(Generator& g, const lucid::Vec2u& res)
+{
+    using namespace lucid;
+    std::uniform_real_distribution<real> val_dist(0_r, 1_r);
+    const FilmRGBA                       film{res};
+    std::vector<Sample>                  samples;
+    for(std::size_t k = 0ul; k < 4ul * product(res); ++k)
+    {
+        const Vec2 pos(val_dist(g) - 0.5_r, val_dist(g) - 0.5_r);
+        samples.push_back(
+            {Vec2(get_x(pos) * film._ratio, get_y(pos)), RGB(generate<3>(val_dist, g))});
+    }
+    return samples;
+}
+
+// maximum difference of colors and weights of pixels of films of the same resolution,
+// relative to weights above one, since their rounding grows with the number of samples
+inline lucid::real
+max_difference(const FilmRGBA& a, const FilmRGBA& b) noexcept
+{
+    using namespace lucid;
+    real max_diff = 0_r;
+    for(auto it = a.img.begin(); it != a.img.end(); ++it)
+    {
+        const RGBA x(*it);
+        const RGBA y(b.img[it.pos()]);
+        for(std::size_t c = 0ul; c < 4ul; ++c)
+            max_diff = std::max(max_diff, std::abs(x[c] - y[c]) / std::max(std::abs(x[c]), 1_r));
+    }
+    return max_diff;
+}
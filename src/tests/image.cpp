@@ -71,6 +71,34 @@ ppm_write_test(const Img& img) noexcept
     return !(fs::exists(filename) || (fs::file_size(filename) > 0));
 }
 
+template <typename Img>
+bool
+pfm_write_test(const Img& img) noexcept
+{
+    fs::path          filename("img.pfm");
+    const auto [w, h] = img.res();
+    write_pfm(img, filename);
+    // three header lines are followed by RGB floats
+    const std::string header = fmt::format("PF\n{} {}\n-1.0\n", w, h);
+    return !fs::exists(filename) ||
+           fs::file_size(filename) != header.size() + w * h * 3ul * sizeof(float);
+}
+
+template <typename Img>
+bool
+pfm_read_test(const Img& img) noexcept
+{
+    fs::path filename("img.pfm");
+    write_pfm(img, filename);
+    const auto read = read_pfm(filename);
+    if(!read || any(read->res() != img.res())) return true;
+
+    bool errors = false;
+    for(auto it = img.begin(); it != img.end(); ++it)
+        for(std::size_t c = 0ul; c < 3ul; ++c) errors |= (*read)[it.pos()][c] != (*it)[c];
+    return errors;
+}
+
 int
 main()
 {
@@ -81,6 +109,8 @@ main()
     int                           errors = iter_test(img) + iter_test(cimg);
     errors += iter_write_test(img);
     errors += ppm_write_test(img);
+    errors += pfm_write_test(img);
+    errors += pfm_read_test(img);
 
     if(errors)
         logger.error("Image test fails with {} errors", errors);
@@ -0,0 +1,143 @@
+// -*- C++ -*-
+// light_bvh.cpp
+#include "property_test.hpp"
+
+#include <sampling/light_bvh.hpp>
+#include <scene/cornell_box.hpp>
+#include <utils/tuple.hpp>
+
+#include <random>
+#include <vector>
+
+using namespace lucid;
+
+struct Input
+{
+    std::vector<LightBounds> lights;
+    Vec3                     p;
+    Vec3                     n;
+};
+
+int
+main()
+{
+    std::random_device                      rd;
+    std::default_random_engine              g(rd());
+    std::uniform_int_distribution<unsigned> count_dist(1u, 300u);
+    std::uniform_real_distribution<real>    pos_dist(-10_r, 10_r);
+    std::uniform_real_distribution<real>    size_dist(0.01_r, 1_r);
+    std::uniform_real_distribution<float>   val_dist(0.f, 10.f);
+    std::uniform_real_distribution<real>    u_dist(0_r, 1_r);
+    std::bernoulli_distribution             bern_dist(0.8);
+
+    auto normgen = [&]() noexcept { return make_normal(generate<3>(pos_dist, g)); };
+
+    // scattered emissive quads and spheres
+    auto light_gen = [&]() noexcept {
+        const Vec3 p = Vec3(generate<3>(pos_dist, g));
+        const RGB  e = RGB(generate<3>(val_dist, g));
+        if(bern_dist(g))
+        {
+            const auto [x, y] = basis(normgen());
+            const real s      = size_dist(g);
+            return light_bounds(Quad{p, p + y * s, p + (x + y) * s, p + x * s}, e);
+        }
+        return light_bounds(Sphere(p, size_dist(g)), e);
+    };
+
+    auto input_gen = [&](const unsigned count) noexcept {
+        Input input{std::vector<LightBounds>(count), Vec3(generate<3>(pos_dist, g)), normgen()};
+        for(auto& lb: input.lights) lb = light_gen();
+        return input;
+    };
+
+    int ret = 0;
+
+    ret += test_property(
+        1000,
+        0.,
+        "LightBVH: pmf sums to one",
+        [&]() noexcept { return input_gen(count_dist(g)); },
+        [](const Input& input) noexcept {
+            const LightBVH bvh(input.lights);
+            real           sum = 0_r;
+            for(std::size_t i = 0ul; i < input.lights.size(); ++i)
+                sum += bvh.pmf(input.p, input.n, i);
+            return sum;
+        },
+        [](const real sum, const Input&) noexcept {
+            // no light may contribute to the shading point
+            return sum != 0_r && !almost_equal(sum, 1_r, 1000);
+        });
+
+    ret += test_property(
+        1000,
+        0.,
+        "LightBVH: sampled pmf matches pmf",
+        [&]() noexcept { return std::pair{input_gen(count_dist(g)), u_dist(g)}; },
+        [](const Input& input, const real u) noexcept {
+            const LightBVH bvh(input.lights);
+            const auto     sampled = bvh.sample(input.p, input.n, u);
+            return sampled ? std::pair{sampled->second, bvh.pmf(input.p, input.n, sampled->first)}
+                           : std::pair{0_r, 0_r};
+        },
+        [](const std::pair<real, real>& pmfs, const auto&) noexcept {
+            return !almost_equal(pmfs.first, pmfs.second, 100);
+        });
+
+    ret += test_property(
+        100,
+        0.02,
+        "LightBVH: sampling frequencies follow pmf",
+        [&]() noexcept { return input_gen(8u); },
+        [&](const Input& input) noexcept {
+            const LightBVH            bvh(input.lights);
+            const std::size_t         num_samples = 100000ul;
+            std::vector<real>         freqs(input.lights.size(), 0_r);
+            std::default_random_engine g1(g());
+            for(std::size_t i = 0ul; i < num_samples; ++i)
+                if(const auto sampled = bvh.sample(input.p, input.n, u_dist(g1)))
+                    freqs[sampled->first] += 1_r / static_cast<real>(num_samples);
+            return freqs;
+        },
+        [](const std::vector<real>& freqs, const Input& input) noexcept {
+            const LightBVH bvh(input.lights);
+            bool           fail = false;
+            for(std::size_t i = 0ul; i < freqs.size(); ++i)
+                fail |= lucid::abs(freqs[i] - bvh.pmf(input.p, input.n, i)) > 0.01_r;
+            return fail;
+        });
+
+    ret += test_property(
+        1000,
+        0.,
+        "LightBVH: lights without power are never sampled",
+        [&]() noexcept {
+            Input input = input_gen(count_dist(g));
+            for(auto& lb: input.lights)
+                if(bern_dist(g)) lb.power = 0_r;
+            return std::pair{input, u_dist(g)};
+        },
+        [](const Input& input, const real u) noexcept {
+            return LightBVH(input.lights).sample(input.p, input.n, u);
+        },
+        [](const auto& sampled, const auto& feed) noexcept {
+            return sampled && feed.first.lights[sampled->first].power == 0_r;
+        });
+
+    ret += test_property(
+        1,
+        0.,
+        "LightBVH: Cornell box has a single light",
+        []() noexcept { return 0; },
+        [](const int) {
+            return collect_lights(CornellBox::geometry(), CornellBox::mat_getter());
+        },
+        [](const SceneLights& lights, const int) noexcept {
+            return lights.pids != std::vector<std::size_t>{6ul} || lights.bounds.size() != 1ul ||
+                   !lights.bounds[0].two_sided || lights.indices[6] != 0ul ||
+                   lights.indices[0] != SceneLights::no_light;
+        });
+
+    return ret;
+}
@@ -0,0 +1,137 @@
+// -*- C++ -*-
+// photon_map.cpp
+#include "cornell_box.hpp"
+#include "property_test.hpp"
+
+#include <integrators/photon_mapping.hpp>
+#include <utils/tuple.hpp>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+using namespace lucid;
+
+using PhotonTracer = PhotonTracer_<std::default_random_engine, Scene, MaterialGetter>;
+
+struct Query
+{
+    std::vector<Photon> photons;
+    Vec3                p;
+    real                radius2;
+    std::size_t         k;
+};
+
+// sorted squared distances of the nearest photons
+std::vector<real>
+nearest(const PhotonMap& map, const Query& query)
+{
+    std::vector<PhotonMap::Neighbor> heap(query.k);
+    real                             r2    = query.radius2;
+    const std::size_t                found = map.nearest(query.p, r2, std::span(heap));
+    std::vector<real>                ret;
+    for(std::size_t i = 0ul; i < found; ++i) ret.push_back(heap[i].dist2);
+    std::sort(ret.begin(), ret.end());
+    return ret;
+}
+
+int
+main()
+{
+    std::random_device                      rd;
+    std::default_random_engine              g(rd());
+    std::uniform_int_distribution<unsigned> count_dist(0u, 2000u);
+    std::uniform_int_distribution<unsigned> k_dist(1u, 64u);
+    std::uniform_real_distribution<real>    pos_dist(-1_r, 1_r);
+    std::uniform_real_distribution<real>    radius_dist(0_r, 1_r);
+
+    auto query_gen = [&]() noexcept {
+        Query query{std::vector<Photon>(count_dist(g)),
+                    Vec3(generate<3>(pos_dist, g)),
+                    radius_dist(g),
+                    k_dist(g)};
+        for(auto& photon: query.photons)
+            photon = Photon{Vec3(generate<3>(pos_dist, g)), Vec3(0, 0, 1), RGB(1)};
+        // coincident photons
+        if(!query.photons.empty()) query.photons.push_back(query.photons.front());
+        return query;
+    };
+
+    int ret = 0;
+
+    ret += test_property(
+        1000,
+        0.,
+        "PhotonMap: nearest neighbors match exhaustive search",
+        query_gen,
+        [](const Query& query) { return nearest(PhotonMap(query.photons), query); },
+        [](const std::vector<real>& found, const Query& query) {
+            std::vector<real> expected;
+            for(const auto& photon: query.photons)
+            {
+                const real d2 = length2(photon.pos - query.p);
+                if(d2 < query.radius2) expected.push_back(d2);
+            }
+            std::sort(expected.begin(), expected.end());
+            expected.resize(std::min(expected.size(), query.k));
+            return found != expected;
+        });
+
+    ret += test_property(
+        100,
+        0.,
+        "PhotonMap: parallel build matches sequential",
+        query_gen,
+        [](const Query& query) { return nearest(PhotonMap(query.photons, 4u), query); },
+        [](const std::vector<real>& found, const Query& query) {
+            return found != nearest(PhotonMap(query.photons), query);
+        });
+
+    ret += test_property(
+        100,
+        0.,
+        "Progressive radius shrinks by the fraction of kept photons",
+        [&]() noexcept { return std::pair{count_dist(g), radius_dist(g)}; },
+        [](const unsigned pass, const real radius2) noexcept {
+            return std::pair{progressive_radius2(radius2, pass),
+                             progressive_radius2(radius2, pass + 1u)};
+        },
+        [](const std::pair<real, real>& r2s, const auto& feed) noexcept {
+            const real alpha = 2_r / 3_r;
+            const real i     = static_cast<real>(feed.first + 1u);
+            return !almost_equal(r2s.second, r2s.first * (i + alpha) / (i + 1_r), 10);
+        });
+
+    ret += test_property(
+        10,
+        0.,
+        "PhotonTracer: photons carry emitted power to first hits",
+        [&]() noexcept { return g(); },
+        [](const unsigned seed) {
+            const SceneLights lights = collect_lights(room_geo, mat_getter);
+            std::vector<real> powers;
+            for(const auto& lb: lights.bounds) powers.push_back(lb.power);
+            const AliasTable           table(powers);
+            std::default_random_engine g1(seed);
+            // first hits only
+            return PhotonTracer{&g1,
+                                &room_geo,
+                                &mat_getter,
+                                &lights,
+                                &table,
+                                1000ul,
+                                1_r / 1000_r,
+                                1u,
+                                0.001_r}();
+        },
+        [](const std::vector<Photon>& photons, const unsigned) noexcept {
+            // the light emits 10 from both sides of a quad of area 0.25,
+            // and photons escaping through the open front of the box are lost
+            const RGB expected(10_r * Pi * 0.25_r * 2_r / 1000_r);
+            bool      fail = photons.size() < 500ul || photons.size() > 1000ul;
+            for(const auto& photon: photons) fail |= !all(almost_equal(photon.power, expected, 10));
+            return fail;
+        });
+
+    return ret;
+}
@@ -165,6 +165,17 @@ main(int argc, char* argv[])
     ret += bound_test_prim("Quad: bound", quad_gen);
     ret += bound_test_prim("GenericPrimitive: bound", rand_prim_gen);
 
+    ret += test_prim(
+        "Quad: area",
+        quad_gen,
+        [](const Quad& prim) noexcept {
+            const auto& [v00, v01, v11, v10] = prim;
+            return area(Triangle{v00, v01, v11}) + area(Triangle{v00, v11, v10});
+        },
+        [](const real triangles_area, const Quad& prim) noexcept {
+            return !almost_equal(area(prim), triangles_area, 100);
+        });
+
     ret += test_property(
         num_tests,
         0.05,
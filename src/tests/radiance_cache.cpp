@@ -0,0 +1,130 @@
+// -*- C++ -*-
+// radiance_cache.cpp
+#include "property_test.hpp"
+
+#include <sampling/radiance_cache.hpp>
+#include <utils/tuple.hpp>
+
+#include <random>
+#include <thread>
+#include <vector>
+
+using namespace lucid;
+
+struct Record
+{
+    Vec3 pos;
+    Vec3 n;
+    RGB  radiance;
+};
+
+int
+main()
+{
+    std::random_device                      rd;
+    std::default_random_engine              g(rd());
+    std::uniform_int_distribution<unsigned> count_dist(1u, 100u);
+    std::uniform_int_distribution<int>      radiance_dist(0, 10);
+    std::uniform_real_distribution<real>    pos_dist(-10_r, 10_r);
+    std::uniform_real_distribution<real>    offset_dist(0.1_r, 0.9_r);
+
+    const RadianceCache::Params params{.cell_size = 0.5_r, .min_samples = 4u, .log2_size = 12u};
+
+    // radiance with integral values, so sums don't depend on the order of addition
+    auto radiance_gen = [&]() noexcept {
+        return RGB(static_cast<float>(radiance_dist(g)),
+                   static_cast<float>(radiance_dist(g)),
+                   static_cast<float>(radiance_dist(g)));
+    };
+    auto normal_gen = [&]() noexcept { return normalize(Vec3(generate<3>(pos_dist, g))); };
+
+    // records falling into the same cell
+    auto cell_gen = [&]() noexcept {
+        const Vec3          corner = Vec3(generate<3>(pos_dist, g));
+        const Vec3          cell   = lucid::floor(corner / params.cell_size) * params.cell_size;
+        const Vec3          n      = normal_gen();
+        std::vector<Record> records(count_dist(g));
+        for(auto& record: records)
+            record = {cell + Vec3(generate<3>(offset_dist, g)) * params.cell_size,
+                      n,
+                      radiance_gen()};
+        return records;
+    };
+
+    int ret = 0;
+
+    ret += test_property(
+        1000,
+        0.,
+        "RadianceCache: cell estimate is the mean of its records",
+        cell_gen,
+        [&](const std::vector<Record>& records) {
+            RadianceCache cache(params);
+            for(const auto& [pos, n, radiance]: records) cache.record(pos, n, radiance);
+            return cache.lookup(records[0].pos, records[0].n);
+        },
+        [&](const std::optional<RGB>& estimate, const std::vector<Record>& records) noexcept {
+            if(records.size() < params.min_samples) return estimate.has_value();
+            RGB mean(0);
+            for(const auto& record: records) mean += record.radiance;
+            mean /= static_cast<float>(records.size());
+            return !estimate || !all(almost_equal(estimate.value(), mean, 10));
+        });
+
+    ret += test_property(
+        1000,
+        0.,
+        "RadianceCache: opposite normals don't share a cell",
+        cell_gen,
+        [&](const std::vector<Record>& records) {
+            RadianceCache cache(params);
+            for(const auto& [pos, n, radiance]: records) cache.record(pos, n, radiance);
+            return cache.lookup(records[0].pos, -records[0].n);
+        },
+        [](const std::optional<RGB>& estimate, const std::vector<Record>&) noexcept {
+            return estimate.has_value();
+        });
+
+    ret += test_property(
+        20,
+        0.,
+        "RadianceCache: concurrent recording matches sequential",
+        [&]() noexcept {
+            std::vector<Record> records;
+            for(unsigned i = 0u; i < 100u; ++i)
+            {
+                const auto cell = cell_gen();
+                records.insert(records.end(), cell.begin(), cell.end());
+            }
+            return records;
+        },
+        [&](const std::vector<Record>& records) {
+            RadianceCache            cache(params);
+            std::vector<std::thread> threads;
+            for(unsigned t = 0u; t < 4u; ++t)
+                threads.emplace_back([&]() noexcept {
+                    for(const auto& [pos, n, radiance]: records) cache.record(pos, n, radiance);
+                });
+            for(auto& thread: threads) thread.join();
+
+            std::vector<std::optional<RGB>> ret;
+            for(const auto& record: records) ret.push_back(cache.lookup(record.pos, record.n));
+            return ret;
+        },
+        [&](const std::vector<std::optional<RGB>>& estimates, const std::vector<Record>& records) {
+            RadianceCache expected(params);
+            for(unsigned t = 0u; t < 4u; ++t)
+                for(const auto& [pos, n, radiance]: records) expected.record(pos, n, radiance);
+
+            bool fail = false;
+            for(std::size_t i = 0ul; i < records.size(); ++i)
+            {
+                const auto e = expected.lookup(records[i].pos, records[i].n);
+                fail |= e.has_value() != estimates[i].has_value() ||
+                        (e && any(e.value() != estimates[i].value()));
+            }
+            return fail;
+        });
+
+    return ret;
+}
@@ -0,0 +1,153 @@
+// -*- C++ -*-
+// restir.cpp
+#include "cornell_box.hpp"
+#include "property_test.hpp"
+
+#include <integrators/basic.hpp>
+#include <integrators/restir.hpp>
+#include <utils/tuple.hpp>
+
+#include <cmath>
+#include <numeric>
+#include <random>
+#include <vector>
+
+using namespace lucid;
+
+// Whether resampled direct lighting without reuse of film position pos
+// differs from the path traced one significantly.
+template <typename Scene, typename MaterialGetter>
+bool
+differs(const Scene&                scene,
+        const MaterialGetter&       mat_getter,
+        const SceneLights&          lights,
+        const Vec2&                 pos,
+        std::default_random_engine& g)
+{
+    using PathTracer       = PathTracer_<std::default_random_engine, Scene, MaterialGetter>;
+    using ReservoirSampler = ReservoirSampler_<std::default_random_engine, Scene, MaterialGetter>;
+    using ReservoirShader  = ReservoirShader_<std::default_random_engine, Scene, MaterialGetter>;
+
+    const perspective::shoot cam  = CornellBox::camera();
+    const real               bias = 0.001_r;
+    ReservoirBuffers         buffers(Vec2u(1u));
+
+    // direct lighting only
+    auto pt = [&]() noexcept {
+        return PathTracer{&g, &scene, &mat_getter, cam(pos), 2u, bias, pos}();
+    };
+    auto ris = [&]() noexcept {
+        ReservoirSampler{
+            &g, &scene, &mat_getter, &lights, &buffers, cam(pos), Vec2u(0u), pos, 4u, 0u}();
+        return ReservoirShader{
+            &g, &scene, &mat_getter, &lights, &buffers, Vec2u(0u), 0u, 0_r, bias}();
+    };
+
+    constexpr std::size_t n    = 20000ul;
+    double                sum  = 0.;
+    double                sum2 = 0.;
+    for(std::size_t i = 0ul; i < n; ++i)
+    {
+        const double diff = avg(pt().second.second) - avg(ris().second.second);
+        sum += diff;
+        sum2 += diff * diff;
+    }
+    const double nd   = static_cast<double>(n);
+    const double mean = sum / nd;
+    const double var  = (sum2 / nd - mean * mean) / nd;
+    return std::abs(mean) > 4. * std::sqrt(var);
+}
+
+int
+main()
+{
+    std::random_device                         rd;
+    std::default_random_engine                 g(rd());
+    std::uniform_int_distribution<std::size_t> size_dist(1ul, 16ul);
+    std::uniform_real_distribution<real>       u_dist(0_r, 1_r);
+    std::uniform_real_distribution<real>       film_dist(-0.5_r, 0.5_r);
+
+    auto weights_gen = [&]() {
+        std::vector<real> weights(size_dist(g));
+        for(real& w: weights) w = u_dist(g);
+        return weights;
+    };
+
+    int ret = 0;
+
+    ret += test_property(
+        100,
+        0.,
+        "Reservoir: candidates are kept proportionally to their weights",
+        weights_gen,
+        [&](const std::vector<real>& weights) {
+            constexpr std::size_t    n = 10000ul;
+            std::vector<std::size_t> counts(weights.size(), 0ul);
+            for(std::size_t i = 0ul; i < n; ++i)
+            {
+                Reservoir<std::size_t> r;
+                for(std::size_t j = 0ul; j < weights.size(); ++j)
+                    r.update(j, weights[j], weights[j], u_dist(g));
+                ++counts[r.sample];
+            }
+            return counts;
+        },
+        [](const std::vector<std::size_t>& counts, const std::vector<real>& weights) noexcept {
+            const real sum   = std::accumulate(weights.begin(), weights.end(), 0_r);
+            const auto n     = std::accumulate(counts.begin(), counts.end(), 0ul);
+            const real total = static_cast<real>(n);
+            bool       fail  = false;
+            for(std::size_t j = 0ul; j < weights.size(); ++j)
+            {
+                const real p = weights[j] / sum;
+                // five standard deviations of the binomial count
+                fail |= lucid::abs(static_cast<real>(counts[j]) - p * total) >
+                        5_r * std::sqrt(total * p * (1_r - p)) + 1_r;
+            }
+            return fail;
+        });
+
+    ret += test_property(
+        100,
+        0.,
+        "Reservoir: merging accounts all candidates of both reservoirs",
+        [&]() { return std::pair{weights_gen(), weights_gen()}; },
+        [&](const std::vector<real>& w1, const std::vector<real>& w2) {
+            // candidates are their own target densities, drawn with unit density
+            Reservoir<real> r1;
+            Reservoir<real> r2;
+            for(const real w: w1) r1.update(w, w, w, u_dist(g));
+            for(const real w: w2) r2.update(w, w, w, u_dist(g));
+            r1.merge(r2, r2.sample, u_dist(g));
+            return r1;
+        },
+        [](const Reservoir<real>& r, const auto& feed) noexcept {
+            const auto& [w1, w2] = feed;
+            const real sum       = std::accumulate(w1.begin(), w1.end(), 0_r) +
+                             std::accumulate(w2.begin(), w2.end(), 0_r);
+            return r.count != w1.size() + w2.size() || !almost_equal(r.weight_sum, sum, 100);
+        });
+
+    const SceneLights room_lights = collect_lights(room_geo, mat_getter);
+    const SceneLights many_lights = collect_lights(many_lights_geo, many_lights_mat_getter);
+
+    ret += test_property(
+        20,
+        0.1,
+        "ReSTIR: resampled direct lighting without reuse agrees with path tracing",
+        [&]() noexcept { return Vec2(generate<2>(film_dist, g)); },
+        [&](const Vec2& pos) { return differs(room_geo, mat_getter, room_lights, pos, g); },
+        [](const bool fail, const Vec2&) noexcept { return fail; });
+
+    ret += test_property(
+        20,
+        0.1,
+        "ReSTIR: lights chosen from the hierarchy of many lights agree with path tracing",
+        [&]() noexcept { return Vec2(generate<2>(film_dist, g)); },
+        [&](const Vec2& pos) {
+            return differs(many_lights_geo, many_lights_mat_getter, many_lights, pos, g);
+        },
+        [](const bool fail, const Vec2&) noexcept { return fail; });
+
+    return ret;
+}
@@ -0,0 +1,171 @@
+// -*- C++ -*-
+// sd_tree.cpp
+#include "property_test.hpp"
+
+#include <sampling/sd_tree.hpp>
+#include <scene/cornell_box.hpp>
+#include <utils/tuple.hpp>
+
+#include <random>
+#include <thread>
+#include <vector>
+
+using namespace lucid;
+
+// radiance samples with integral values, so sums don't depend on the order of addition
+using Records = std::vector<std::pair<Vec3, float>>;
+
+static constexpr unsigned grid_size = 256u;
+
+// integral of the sampling density over cells of the direction square
+template <typename Density>
+std::vector<real>
+cell_integrals(const Density& pdf, const unsigned cells)
+{
+    std::vector<real> ret(cells * cells, 0_r);
+    const real        cell = 1_r / static_cast<real>(grid_size);
+    for(unsigned j = 0u; j < grid_size; ++j)
+        for(unsigned i = 0u; i < grid_size; ++i)
+        {
+            const Vec2 p((static_cast<real>(i) + 0.5_r) * cell,
+                         (static_cast<real>(j) + 0.5_r) * cell);
+            ret[(j * cells / grid_size) * cells + i * cells / grid_size] +=
+                pdf(square_to_dir(p)) * 4_r * Pi * cell * cell;
+        }
+    return ret;
+}
+
+int
+main()
+{
+    std::random_device                      rd;
+    std::default_random_engine              g(rd());
+    std::uniform_int_distribution<unsigned> count_dist(1u, 1000u);
+    std::uniform_int_distribution<int>      radiance_dist(0, 10);
+    std::uniform_real_distribution<real>    dir_dist(-1_r, 1_r);
+    std::uniform_real_distribution<real>    u_dist(0_r, 1_r);
+
+    auto dir_gen = [&]() noexcept { return make_normal(generate<3>(dir_dist, g)); };
+
+    // radiance concentrated around a random direction
+    auto records_gen = [&]() noexcept {
+        Records    records(count_dist(g));
+        const Vec3 peak = dir_gen();
+        for(auto& [d, radiance]: records)
+        {
+            d        = make_normal(peak + dir_gen() * u_dist(g));
+            radiance = static_cast<float>(radiance_dist(g));
+        }
+        return records;
+    };
+
+    // trained twice, so the sampling tree gets subdivided
+    auto train = [](const Records& records) {
+        DTree dtree;
+        for(unsigned i = 0u; i < 2u; ++i)
+        {
+            for(const auto& [d, radiance]: records) dtree.record(d, radiance);
+            dtree.refine(0.01f, 8u, 1ul << 16u);
+        }
+        return dtree;
+    };
+
+    int ret = 0;
+
+    ret += test_property(
+        100,
+        0.,
+        "DTree: pdf integrates to one",
+        records_gen,
+        [&](const Records& records) {
+            const DTree dtree = train(records);
+            real        sum   = 0_r;
+            for(const real c: cell_integrals([&](const Vec3& d) { return dtree.pdf(d); }, 1u))
+                sum += c;
+            return sum;
+        },
+        [](const real sum, const Records&) noexcept { return !almost_equal(sum, 1_r, 100000); });
+
+    ret += test_property(
+        20,
+        0.,
+        "DTree: sampling frequencies follow pdf",
+        records_gen,
+        [&](const Records& records) {
+            const DTree                dtree       = train(records);
+            const std::size_t          num_samples = 100000ul;
+            const unsigned             cells       = 4u;
+            std::vector<real>          freqs(cells * cells, 0_r);
+            std::default_random_engine g1(records.size());
+            std::uniform_real_distribution<real> u1(0_r, 1_r);
+            for(std::size_t i = 0ul; i < num_samples; ++i)
+            {
+                const Vec2 p = dir_to_square(dtree.sample(Vec2(u1(g1), u1(g1))));
+                const auto x = std::min(static_cast<unsigned>(p[0] * cells), cells - 1u);
+                const auto y = std::min(static_cast<unsigned>(p[1] * cells), cells - 1u);
+                freqs[y * cells + x] += 1_r / static_cast<real>(num_samples);
+            }
+            return std::pair{freqs,
+                             cell_integrals([&](const Vec3& d) { return dtree.pdf(d); }, cells)};
+        },
+        [](const auto& res, const Records&) noexcept {
+            bool fail = false;
+            for(std::size_t i = 0ul; i < res.first.size(); ++i)
+                fail |= lucid::abs(res.first[i] - res.second[i]) > 0.01_r;
+            return fail;
+        });
+
+    ret += test_property(
+        20,
+        0.,
+        "DTree: concurrent recording matches sequential",
+        records_gen,
+        [&](const Records& records) {
+            DTree dtree;
+            dtree.refine(0.f, 4u, 1ul << 10u); // builds a uniform tree to record into
+            std::vector<std::thread> threads;
+            for(unsigned t = 0u; t < 4u; ++t)
+                threads.emplace_back([&]() noexcept {
+                    for(const auto& [d, radiance]: records) dtree.record(d, radiance);
+                });
+            for(auto& thread: threads) thread.join();
+            return dtree;
+        },
+        [](DTree dtree, const Records& records) {
+            DTree expected;
+            expected.refine(0.f, 4u, 1ul << 10u);
+            for(unsigned t = 0u; t < 4u; ++t)
+                for(const auto& [d, radiance]: records) expected.record(d, radiance);
+
+            bool fail = dtree.num_samples() != expected.num_samples();
+            dtree.refine(0.01f, 8u, 1ul << 16u);
+            expected.refine(0.01f, 8u, 1ul << 16u);
+            for(const auto& rec: records) fail |= dtree.pdf(rec.first) != expected.pdf(rec.first);
+            return fail;
+        });
+
+    ret += test_property(
+        10,
+        0.,
+        "SDTree: memory stays within budget",
+        [&]() noexcept { return std::pair{records_gen(), 1ul << (count_dist(g) % 8u + 12u)}; },
+        [](const Records& records, const std::size_t budget) {
+            SDTree tree(scene_bound(CornellBox::geometry()),
+                        SDTree::Params{.spatial_threshold = 10.f, .memory = budget});
+            std::default_random_engine           g1(records.size());
+            std::uniform_real_distribution<real> pos_dist(-1_r, 1_r);
+            for(unsigned i = 0u; i < 4u; ++i)
+            {
+                for(unsigned s = 0u; s < (1u << i); ++s)
+                    for(const auto& [d, radiance]: records)
+                        tree.record(Vec3(pos_dist(g1), pos_dist(g1), pos_dist(g1)), d, radiance);
+                tree.refine();
+            }
+            return tree.memory();
+        },
+        [](const std::size_t memory, const auto& feed) noexcept {
+            return memory > feed.second;
+        });
+
+    return ret;
+}
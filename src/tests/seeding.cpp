@@ -0,0 +1,104 @@
+// -*- C++ -*-
+// seeding.cpp
+#include "property_test.hpp"
+
+#include <renderer.hpp>
+#include <sampling/seeding.hpp>
+#include <utils/tuple.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+using namespace lucid;
+
+// rendering modes of lucid with a seed
+enum class Mode
+{
+    dispatched,
+    dithered,
+    restir,
+    work_stealing
+};
+
+// render passes with a seed like lucid -S does
+Image
+render(const std::uint64_t seed, const Mode mode, const unsigned num_threads)
+{
+    const RenderSettings settings{.res           = Vec2u(16u, 12u),
+                                  .max_depth     = 4u,
+                                  .batch_size    = 16u,
+                                  .queue_size    = 1000u,
+                                  .filter_width  = 2_r,
+                                  .threshold     = 0.1_r,
+                                  .max_spp       = 8ul,
+                                  .need_aov      = false,
+                                  .restir        = mode == Mode::restir,
+                                  .deterministic = true,
+                                  .base_seed     = seed,
+                                  .work_stealing = mode == Mode::work_stealing,
+                                  .num_threads   = num_threads};
+    const BlueNoiseMask mask(3u);
+    Renderer            renderer(
+        settings, nullptr, nullptr, nullptr, mode == Mode::dithered ? &mask : nullptr);
+    while(renderer.advance().second)
+        ;
+    renderer.finish();
+    return renderer.image();
+}
+
+int
+main()
+{
+    std::random_device                           rd;
+    std::default_random_engine                   g(rd());
+    std::uniform_int_distribution<std::uint64_t> seed_dist;
+    std::uniform_int_distribution<std::uint64_t> index_dist(0ul, 1ul << 20u);
+
+    int ret = 0;
+
+    ret += test_property(
+        100,
+        0.,
+        "stream_seed: consecutive samples and pixels get distinct streams",
+        [&]() noexcept { return std::pair{seed_dist(g), index_dist(g)}; },
+        [](const std::uint64_t seed, const std::uint64_t pixel) {
+            std::vector<std::uint64_t> seeds;
+            for(std::uint64_t i = 0ul; i < 256ul; ++i)
+            {
+                seeds.push_back(stream_seed(seed, pixel, i));
+                seeds.push_back(stream_seed(seed, pixel + i, 0ul));
+            }
+            std::sort(seeds.begin(), seeds.end());
+            // the sample 0 of the pixel is in both halves
+            return std::unique(seeds.begin(), seeds.end()) - seeds.begin();
+        },
+        [](const auto num_unique, const auto&) noexcept { return num_unique != 511; });
+
+    for(const auto& [mode, name]:
+        {std::pair{Mode::dispatched, "dispatched samples"},
+         std::pair{Mode::dithered, "dithered samples"},
+         std::pair{Mode::restir, "reservoir resampling"},
+         std::pair{Mode::work_stealing, "work-stealing passes"}})
+        ret += test_property(
+            5,
+            0.,
+            fmt::format("Renderer: images of {} with the same seed don't depend on "
+                        "the number of threads",
+                        name),
+            [&]() noexcept { return seed_dist(g); },
+            [mode](const std::uint64_t seed) {
+                return std::pair{render(seed, mode, 1u), render(seed, mode, 4u)};
+            },
+            [](const std::pair<Image, Image>& images, const auto&) noexcept {
+                const auto& [a, b] = images;
+                return !std::equal(a.begin(), a.end(), b.begin(), [](auto x, auto y) {
+                    return all(x == y);
+                });
+            });
+
+    return ret;
+}
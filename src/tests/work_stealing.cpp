@@ -0,0 +1,49 @@
+// -*- C++ -*-
+// work_stealing.cpp
+#include "property_test.hpp"
+
+#include <image_reconstruction/tiles.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <random>
+#include <tuple>
+#include <vector>
+
+using namespace lucid;
+
+int
+main()
+{
+    std::random_device                         rd;
+    std::default_random_engine                 g(rd());
+    std::uniform_int_distribution<unsigned>    res_dist(1u, 300u);
+    std::uniform_int_distribution<unsigned>    threads_dist(1u, 8u);
+    std::uniform_int_distribution<std::size_t> tile_dist(0ul, 1000ul);
+
+    int ret = 0;
+
+    ret += test_property(
+        20,
+        0.,
+        "render_tiles: every pixel is rendered exactly once",
+        [&]() noexcept {
+            return std::tuple{Vec2u(res_dist(g), res_dist(g)), tile_dist(g), threads_dist(g)};
+        },
+        [](const Vec2u& res, const std::size_t tile_size, const unsigned threads) {
+            std::vector<std::atomic_uint> visits(product(res));
+            std::atomic_bool              fits = true;
+            render_tiles(res, tile_size, threads, [&](const Tile& tile, const unsigned idx) {
+                fits = fits && idx < threads && tile.num_pixels() <= std::max(tile_size, 1ul);
+                for(unsigned j = get_y(tile.min); j < get_y(tile.max); ++j)
+                    for(unsigned i = get_x(tile.min); i < get_x(tile.max); ++i)
+                        visits[j * get_x(res) + i].fetch_add(1u);
+            });
+            return fits && std::all_of(visits.begin(), visits.end(), [](const auto& n) {
+                       return n.load() == 1u;
+                   });
+        },
+        [](const bool once, const auto&) noexcept { return !once; });
+
+    return ret;
+}
@@ -0,0 +1,186 @@
+// -*- C++ -*-
+// affinity.hpp
+//
+
+/// @file
+/// Placement of threads and data on CPUs and NUMA nodes.
+
+#pragma once
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace lucid
+{
+// parse a sysfs CPU list like "0-3,8-11"
+inline std::vector<unsigned>
+parse_cpu_list(const std::string& list)
+{
+    std::vector<unsigned> cpus;
+    std::size_t           pos = 0ul;
+    while(pos < list.size())
+    {
+        std::size_t    next  = 0ul;
+        const unsigned first = std::stoul(list.substr(pos), &next);
+        unsigned       last  = first;
+        pos += next;
+        if(pos < list.size() && list[pos] == '-')
+        {
+            last = std::stoul(list.substr(pos + 1ul), &next);
+            pos += next + 1ul;
+        }
+        for(unsigned cpu = first; cpu <= last; ++cpu) cpus.push_back(cpu);
+        // skip the comma
+        ++pos;
+    }
+    return cpus;
+}
+
+/// @brief Sorted CPUs the process may run on, as restricted by taskset or cpusets.
+inline const std::vector<unsigned>&
+allowed_cpus()
+{
+    static const std::vector<unsigned> cpus = []() {
+        std::vector<unsigned> ret;
+#ifdef __linux__
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        if(sched_getaffinity(0, sizeof(set), &set) == 0)
+            for(unsigned cpu = 0u; cpu < CPU_SETSIZE; ++cpu)
+                if(CPU_ISSET(cpu, &set)) ret.push_back(cpu);
+#endif
+        if(ret.empty())
+            for(unsigned cpu = 0u; cpu < std::max(std::thread::hardware_concurrency(), 1u); ++cpu)
+                ret.push_back(cpu);
+        return ret;
+    }();
+    return cpus;
+}
+
+/// @brief Allowed CPUs of every NUMA node, see allowed_cpus().
+///
+/// Machines without NUMA information are a single node of all the allowed CPUs.
+/// Nodes without allowed CPUs are left out.
+inline const std::vector<std::vector<unsigned>>&
+numa_nodes()
+{
+    static const std::vector<std::vector<unsigned>> nodes = []() {
+        const auto&                        allowed = allowed_cpus();
+        std::vector<std::vector<unsigned>> ret;
+        const std::filesystem::path        sysfs("/sys/devices/system/node");
+        for(unsigned node = 0u;; ++node)
+        {
+            const auto dir = sysfs / ("node" + std::to_string(node));
+            if(!std::filesystem::exists(dir)) break;
+            std::ifstream file(dir / "cpulist");
+            std::string   list;
+            // nodes of memory only don't run threads
+            if(!(file >> list)) continue;
+            std::vector<unsigned> cpus;
+            for(const unsigned cpu: parse_cpu_list(list))
+                if(std::binary_search(allowed.begin(), allowed.end(), cpu)) cpus.push_back(cpu);
+            if(!cpus.empty()) ret.push_back(std::move(cpus));
+        }
+
+        if(ret.empty()) ret.push_back(allowed);
+        return ret;
+    }();
+    return nodes;
+}
+
+/// @brief CPUs for @p num_threads threads, alternating between NUMA nodes.
+///
+/// Threads are spread evenly, so every node's memory bandwidth and caches are used.
+/// CPUs are reused if there are more threads than CPUs.
+inline std::vector<unsigned>
+spread_cpus(const unsigned num_threads)
+{
+    const auto&           nodes = numa_nodes();
+    std::vector<unsigned> cpus;
+    for(std::size_t i = 0ul; cpus.size() < num_threads; ++i)
+    {
+        const auto& node = nodes[i % nodes.size()];
+        cpus.push_back(node[(i / nodes.size()) % node.size()]);
+    }
+    return cpus;
+}
+
+/// @brief Keep the calling thread on @p cpu. Returns false if that's not possible.
+inline bool
+pin_this_thread([[maybe_unused]] const unsigned cpu) noexcept
+{
+#ifdef __linux__
+    if(cpu >= CPU_SETSIZE) return false;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    return false;
+#endif
+}
+
+/// @brief NUMA node of the CPU the calling thread runs on.
+inline unsigned
+current_numa_node() noexcept
+{
+#ifdef __linux__
+    static const std::vector<unsigned> cpu_nodes = []() {
+        std::vector<unsigned> ret;
+        const auto&           nodes = numa_nodes();
+        for(unsigned node = 0u; node < nodes.size(); ++node)
+            for(const unsigned cpu: nodes[node])
+            {
+                if(cpu >= ret.size()) ret.resize(cpu + 1u, 0u);
+                ret[cpu] = node;
+            }
+        return ret;
+    }();
+
+    const int cpu = sched_getcpu();
+    return cpu >= 0 && static_cast<unsigned>(cpu) < cpu_nodes.size() ? cpu_nodes[cpu] : 0u;
+#else
+    return 0u;
+#endif
+}
+
+/// @brief Copies of read-only data, one on every NUMA node.
+///
+/// Every copy is made by a thread running on its node, so memory allocated
+/// by the copy is placed on that node by the first touch policy of the OS.
+/// @tparam T Copy-constructible type, whose copies own their memory.
+template <typename T>
+class NodeLocal
+{
+    std::vector<std::unique_ptr<const T>> replicas;
+
+  public:
+    explicit NodeLocal(const T& value)
+    {
+        const auto& nodes = numa_nodes();
+        replicas.resize(nodes.size());
+        for(std::size_t node = 0ul; node < nodes.size(); ++node)
+            std::thread([&]() {
+                pin_this_thread(nodes[node].front());
+                replicas[node] = std::make_unique<const T>(value);
+            }).join();
+    }
+
+    /// @brief Copy on the node of the calling thread.
+    const T&
+    local() const noexcept
+    {
+        return *replicas[std::min<std::size_t>(current_numa_node(), replicas.size() - 1ul)];
+    }
+};
+} // namespace lucid
@@ -0,0 +1,86 @@
+// -*- C++ -*-
+// arena.hpp
+//
+
+/// @file
+/// Bump allocator for short-lived buffers.
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+namespace lucid
+{
+/// @brief Allocates arrays from large blocks and frees them all at once.
+///
+/// Meant to be kept per thread and reset after every task,
+/// so that no heap allocation happens once the blocks have grown to the needed size.
+class Arena
+{
+    std::vector<std::unique_ptr<std::byte[]>> blocks;
+    std::vector<std::size_t>                  sizes;
+    std::size_t                               block  = 0ul;
+    std::size_t                               offset = 0ul;
+
+  public:
+    /// @param block_size Size of the first block in bytes.
+    explicit Arena(const std::size_t block_size = 1ul << 16u)
+    {
+        blocks.push_back(std::make_unique<std::byte[]>(block_size));
+        sizes.push_back(block_size);
+    }
+
+    /// @brief Allocate default initialized array of @p n elements.
+    ///
+    /// The array is valid until the next @ref reset.
+    template <typename T>
+    std::span<T>
+    allocate(const std::size_t n)
+    {
+        static_assert(std::is_trivially_destructible_v<T>, "Arena never calls destructors");
+        static_assert(alignof(T) <= __STDCPP_DEFAULT_NEW_ALIGNMENT__, "Blocks are not aligned");
+
+        const std::size_t bytes = n * sizeof(T);
+        std::size_t       start = (offset + alignof(T) - 1ul) / alignof(T) * alignof(T);
+        // move on to the next block, which must be large enough for the array
+        while(start + bytes > sizes[block])
+        {
+            ++block;
+            if(block == blocks.size())
+            {
+                const std::size_t size = std::max(sizes.back() * 2ul, bytes);
+                blocks.push_back(std::make_unique<std::byte[]>(size));
+                sizes.push_back(size);
+            }
+            start = 0ul;
+        }
+        offset = start + bytes;
+
+        T* const ptr = reinterpret_cast<T*>(blocks[block].get() + start);
+        std::uninitialized_default_construct_n(ptr, n);
+        return std::span<T>(ptr, n);
+    }
+
+    /// @brief Free all allocated arrays, keeping the memory for reuse.
+    void
+    reset() noexcept
+    {
+        block  = 0ul;
+        offset = 0ul;
+    }
+
+    /// @brief Total memory owned by the arena in bytes.
+    std::size_t
+    capacity() const noexcept
+    {
+        std::size_t ret = 0ul;
+        for(const std::size_t size: sizes) ret += size;
+        return ret;
+    }
+};
+} // namespace lucid
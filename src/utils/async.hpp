@@ -0,0 +1,347 @@
+// -*- C++ -*-
+// async.hpp
+//
+
+/// @file
+/// Coroutines awaiting results of dispatcher tasks.
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+namespace lucid
+{
+template <typename T>
+class Async;
+
+namespace detail
+{
+template <typename T>
+struct AsyncResult
+{
+    std::optional<T> value;
+
+    void
+    return_value(T val) noexcept
+    {
+        value = std::move(val);
+    }
+
+    T
+    result() noexcept
+    {
+        return std::move(value.value());
+    }
+};
+
+template <>
+struct AsyncResult<void>
+{
+    void
+    return_void() noexcept
+    {
+    }
+
+    void
+    result() noexcept
+    {
+    }
+};
+
+// coroutine running from its call to its end without anybody waiting for it
+struct Detached
+{
+    struct promise_type
+    {
+        Detached
+        get_return_object() noexcept
+        {
+            return {};
+        }
+
+        std::suspend_never
+        initial_suspend() noexcept
+        {
+            return {};
+        }
+
+        std::suspend_never
+        final_suspend() noexcept
+        {
+            return {};
+        }
+
+        void
+        return_void() noexcept
+        {
+        }
+
+        void
+        unhandled_exception() noexcept
+        {
+            std::terminate();
+        }
+    };
+};
+
+// signalled under the lock, so the waiting thread can't destroy it while it's being notified
+struct Completion
+{
+    std::mutex              mutex;
+    std::condition_variable cv;
+    bool                    done = false;
+
+    void
+    signal() noexcept
+    {
+        std::lock_guard lock(mutex);
+        done = true;
+        cv.notify_one();
+    }
+
+    void
+    wait() noexcept
+    {
+        std::unique_lock lock(mutex);
+        cv.wait(lock, [this]() noexcept { return done; });
+    }
+};
+
+template <typename T, typename Value>
+Detached
+complete(Async<T>& async, std::optional<Value>& result, Completion& completion) noexcept
+{
+    if constexpr(std::is_void_v<T>)
+        co_await async;
+    else
+        result = co_await async;
+    completion.signal();
+}
+} // namespace detail
+
+/// @brief Coroutine returning a value of type @p T.
+///
+/// The coroutine starts when it's awaited and resumes its awaiter when it returns,
+/// on whichever thread it ends on.
+/// Awaiting dispatcher tasks moves the coroutine to the worker that ran the last of them,
+/// so no thread polls or blocks for results.
+template <typename T = void>
+class [[nodiscard]] Async
+{
+  public:
+    struct promise_type : detail::AsyncResult<T>
+    {
+        std::coroutine_handle<> continuation = std::noop_coroutine();
+
+        Async
+        get_return_object() noexcept
+        {
+            return Async(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+
+        std::suspend_always
+        initial_suspend() noexcept
+        {
+            return {};
+        }
+
+        auto
+        final_suspend() noexcept
+        {
+            struct Resume
+            {
+                bool
+                await_ready() const noexcept
+                {
+                    return false;
+                }
+
+                std::coroutine_handle<>
+                await_suspend(std::coroutine_handle<promise_type> handle) noexcept
+                {
+                    return handle.promise().continuation;
+                }
+
+                void
+                await_resume() const noexcept
+                {
+                }
+            };
+            return Resume{};
+        }
+
+        void
+        unhandled_exception() noexcept
+        {
+            std::terminate();
+        }
+    };
+
+    Async(Async&& rhs) noexcept : handle(std::exchange(rhs.handle, nullptr)) {}
+
+    Async(const Async&) = delete;
+    Async&
+    operator=(const Async&) = delete;
+    Async&
+    operator=(Async&&) = delete;
+
+    ~Async() noexcept
+    {
+        if(handle) handle.destroy();
+    }
+
+    bool
+    await_ready() const noexcept
+    {
+        return false;
+    }
+
+    std::coroutine_handle<>
+    await_suspend(std::coroutine_handle<> awaiting) noexcept
+    {
+        handle.promise().continuation = awaiting;
+        return handle;
+    }
+
+    T
+    await_resume() noexcept
+    {
+        return handle.promise().result();
+    }
+
+  private:
+    std::coroutine_handle<promise_type> handle;
+
+    explicit Async(std::coroutine_handle<promise_type> h) noexcept : handle(h) {}
+};
+
+/// @brief Run @p async to its end, blocking the calling thread until then.
+template <typename T>
+T
+sync_wait(Async<T> async) noexcept
+{
+    using Value = std::conditional_t<std::is_void_v<T>, std::monostate, T>;
+    std::optional<Value> result;
+    detail::Completion   completion;
+    detail::complete(async, result, completion);
+    completion.wait();
+    if constexpr(!std::is_void_v<T>) return std::move(result.value());
+}
+
+// tasks of a single co_await counting down to the resumption of the awaiting coroutine
+struct AwaitCounter
+{
+    std::atomic_size_t      remaining{0ul};
+    std::coroutine_handle<> handle;
+
+    void
+    count_down() noexcept
+    {
+        if(remaining.fetch_sub(1ul, std::memory_order_acq_rel) == 1ul) handle.resume();
+    }
+};
+
+/// @brief Dispatcher task storing the result of @p task for a coroutine awaiting it.
+///
+/// The worker running the last task of a co_await resumes the coroutine.
+/// Dispatchers of awaited tasks have to list Awaited<Task> among their tasks.
+template <typename Task>
+struct Awaited
+{
+    using Result = std::invoke_result_t<Task&>;
+
+    Task          task;
+    Result*       result  = nullptr;
+    AwaitCounter* counter = nullptr;
+
+    void
+    operator()() noexcept
+    {
+        *result = task();
+        counter->count_down();
+    }
+};
+
+/// @brief Awaitable result of a single dispatcher task.
+template <typename Dispatcher, typename Task>
+struct SubmitAwaiter
+{
+    using Result = std::invoke_result_t<Task&>;
+
+    Dispatcher&  dispatcher;
+    Task         task;
+    Result       result{};
+    AwaitCounter counter{};
+
+    bool
+    await_ready() const noexcept
+    {
+        return false;
+    }
+
+    void
+    await_suspend(std::coroutine_handle<> handle) noexcept
+    {
+        counter.remaining.store(1ul, std::memory_order_relaxed);
+        counter.handle = handle;
+        // the coroutine may be resumed before the submission returns,
+        // so the awaiter isn't touched after it. Coroutines resumed on workers submit
+        // from them, so a full queue defers the task instead of waiting for room
+        dispatcher.submit_eventually(Awaited<Task>{std::move(task), &result, &counter});
+    }
+
+    Result
+    await_resume() noexcept
+    {
+        return std::move(result);
+    }
+};
+
+/// @brief Awaitable results of dispatcher tasks, resuming once all of them are done.
+template <typename Dispatcher, typename Task>
+struct WhenAllAwaiter
+{
+    using Result = std::invoke_result_t<Task&>;
+
+    Dispatcher&         dispatcher;
+    std::vector<Task>   tasks;
+    std::vector<Result> results{};
+    AwaitCounter        counter{};
+
+    bool
+    await_ready() const noexcept
+    {
+        return tasks.empty();
+    }
+
+    bool
+    await_suspend(std::coroutine_handle<> handle) noexcept
+    {
+        results.resize(tasks.size());
+        // the extra count keeps the coroutine suspended while tasks are submitted
+        counter.remaining.store(tasks.size() + 1ul, std::memory_order_relaxed);
+        counter.handle = handle;
+        for(std::size_t i = 0ul; i < tasks.size(); ++i)
+            dispatcher.submit_eventually(
+                Awaited<Task>{std::move(tasks[i]), &results[i], &counter});
+        // all the tasks may be done already
+        return counter.remaining.fetch_sub(1ul, std::memory_order_acq_rel) != 1ul;
+    }
+
+    std::vector<Result>
+    await_resume() noexcept
+    {
+        return std::move(results);
+    }
+};
+} // namespace lucid
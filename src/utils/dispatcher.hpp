@@ -1,31 +1,153 @@
+// -*- C++ -*-
+// dispatcher.hpp
+//
+
+#pragma once
+
+#include <utils/affinity.hpp>
+#include <utils/async.hpp>
+#include <utils/dispatcher_stats.hpp>
 #include <utils/steady_tuple.hpp>
 #include <utils/tuple.hpp>
 #include <utils/typelist.hpp>
 
+#include <algorithm>
 #include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <iterator>
+#include <memory>
+#include <mutex>
 #include <optional>
 #include <thread>
+#include <tuple>
+#include <type_traits>
+#include <variant>
 #include <vector>
 
 #include <concurrentqueue.h>
+#include <fmt/format.h>
 
 namespace lucid
 {
 template <typename T>
 using cqueue = moodycamel::ConcurrentQueue<T>;
 
+/// @brief Place where threads sleep until an event happens.
+///
+/// A thread calls prepare(), checks its condition once more and waits
+/// if it still doesn't hold. Events that happen after prepare() wake it up.
+/// Signalling is a single atomic increment unless somebody is parked.
+class ParkingLot
+{
+    std::atomic_uint32_t epoch{0u};
+    std::atomic_uint32_t num_parked{0u};
+
+  public:
+    std::uint32_t
+    prepare() noexcept
+    {
+        num_parked.fetch_add(1u);
+        return epoch.load();
+    }
+
+    void
+    cancel() noexcept
+    {
+        num_parked.fetch_sub(1u);
+    }
+
+    void
+    wait(const std::uint32_t prepared_epoch) noexcept
+    {
+        epoch.wait(prepared_epoch);
+        num_parked.fetch_sub(1u);
+    }
+
+    void
+    notify() noexcept
+    {
+        epoch.fetch_add(1u);
+        if(num_parked.load() > 0u) epoch.notify_all();
+    }
+};
+
 /// @brief Lock-free typefull multi-threaded task dispatcher.
 /// @tparam Tasks Default-constructible, copy-assignable callables
-/// that don't take arguments and return non-void default-constructible
-/// copy-assignable values.
+/// that don't take arguments and return default-constructible
+/// copy-assignable values or void. Results of void tasks aren't fetched.
+///
+/// Tasks with an unsigned integer epoch member belong to that epoch of the dispatcher.
+/// next_epoch() cancels them: workers skip queued tasks of past epochs
+/// and results computed meanwhile are dropped instead of being fetched.
+///
+/// Tasks with a static priority member, e.g. Prioritized ones, run before tasks
+/// of lower levels, which default to zero. Lower levels run only while
+/// queues of the higher ones are empty.
+///
+/// Built with _DISPATCHER_STATS, the dispatcher records utilization of its workers,
+/// run times and latencies of tasks and depths of its queues, see stats().
+/// The statistics are written at destruction to the file named by
+/// the LUCID_DISPATCHER_STATS environment variable, if it's set.
 template <typename... Tasks>
 class Dispatcher
 {
     using TaskTypeList = typelist<Tasks...>;
+    // void tasks get a queue of empty values that nothing is put into
+    template <typename T>
+    using no_args = std::conditional_t<std::is_void_v<std::invoke_result_t<T>>,
+                                       std::monostate,
+                                       std::invoke_result_t<T>>;
+    // tasks that next_epoch() cancels
+    template <typename T>
+    static constexpr bool has_epoch = requires(const T& task) { task.epoch; };
+
+    template <typename T>
+    struct Stamped
+    {
+        std::uint64_t epoch = 0ul;
+        T             value{};
+    };
+
     template <typename T>
-    using no_args         = std::invoke_result_t<T>;
-    using ResultTypeList  = typename TaskTypeList::template map<no_args, typelist>;
-    using TaskQueuePool   = typename TaskTypeList::template map<cqueue, steady_tuple>;
+    static constexpr unsigned
+    priority() noexcept
+    {
+        if constexpr(requires { T::priority; })
+            return T::priority;
+        else
+            return 0u;
+    }
+
+    static constexpr unsigned max_priority = std::max({0u, priority<Tasks>()...});
+
+    using Stats = DispatcherStats<sizeof...(Tasks)>;
+    // depends on the tasks, so members of the disabled statistics are never instantiated
+    static constexpr bool with_stats = dispatcher_stats && sizeof...(Tasks) > 0ul;
+
+    template <typename T>
+    struct Timed
+    {
+        typename Stats::Clock::time_point submitted{};
+        T                                 task{};
+    };
+
+    // tasks are queued with the time of their submission, with _DISPATCHER_STATS only
+    template <typename T>
+    using queued_task = std::conditional_t<with_stats, Timed<T>, T>;
+
+    template <typename T>
+    using task_cqueue = cqueue<queued_task<T>>;
+
+    // results of cancellable tasks are queued with their epochs
+    template <typename T>
+    using queued_result = std::conditional_t<has_epoch<T>, Stamped<no_args<T>>, no_args<T>>;
+
+    using ResultTypeList  = typename TaskTypeList::template map<queued_result, typelist>;
+    using TaskQueuePool   = typename TaskTypeList::template map<task_cqueue, steady_tuple>;
     using ResultQueuePool = typename ResultTypeList::template map<cqueue, steady_tuple>;
 
     template <typename Task>
@@ -38,91 +160,645 @@ class Dispatcher
     template <typename Task>
     using ResultQueue = cqueue<typename ResultTypeList::template at<result_index<Task>()>>;
 
+    // the task of a queued one
     template <typename T>
-    struct result_helper;
+    static T&
+    unqueued(queued_task<T>& task) noexcept
+    {
+        if constexpr(with_stats)
+            return task.task;
+        else
+            return task;
+    }
+
+    // queue task with enqueue(task), stamped with the time of its submission;
+    // a task that isn't queued is left to the caller
+    template <typename T, typename Enqueue>
+    static bool
+    enqueue_task(T& task, Enqueue&& enqueue) noexcept
+    {
+        if constexpr(with_stats)
+        {
+            Timed<T> queued{Stats::now(), std::move(task)};
+            if(enqueue(std::move(queued))) return true;
+            task = std::move(queued.task);
+            return false;
+        }
+        else
+            return enqueue(std::move(task));
+    }
 
-    template <typename ResultType>
-    struct result_helper<cqueue<ResultType>>
+    // task stamped with the time of its submission
+    template <typename T>
+    static queued_task<T>
+    queued(T task) noexcept
     {
-        using type = ResultType;
+        if constexpr(with_stats)
+            return {Stats::now(), std::move(task)};
+        else
+            return task;
+    }
+
+    // iterator stamping tasks of a bulk with the time of their submission
+    template <typename It>
+    struct QueuedIterator
+    {
+        using T = std::iter_value_t<It>;
+
+        It                                it;
+        typename Stats::Clock::time_point submitted;
+
+        Timed<T>
+        operator*() const
+        {
+            return {submitted, *it};
+        }
+
+        QueuedIterator&
+        operator++() noexcept
+        {
+            ++it;
+            return *this;
+        }
+
+        QueuedIterator
+        operator++(int) noexcept
+        {
+            return {it++, submitted};
+        }
     };
 
+    template <typename It>
+    static auto
+    queued_bulk(It first) noexcept
+    {
+        if constexpr(with_stats)
+            return QueuedIterator<It>{first, Stats::now()};
+        else
+            return first;
+    }
+
+    // tasks waiting for room in their queue, see submit_eventually()
+    template <typename T>
+    struct Deferred
+    {
+        std::mutex                 mutex;
+        std::deque<queued_task<T>> tasks;
+    };
+
+    // deferred tasks of every type, queued by workers as they make room dequeuing tasks
+    struct Deferrals
+    {
+        std::tuple<Deferred<Tasks>...> pool;
+        std::atomic_size_t             count{0ul};
+
+        template <typename Task>
+        std::size_t
+        resubmit(task_cqueue<Task>& queue) noexcept
+        {
+            Deferred<Task>& deferred = std::get<Deferred<Task>>(pool);
+            std::lock_guard lock(deferred.mutex);
+            std::size_t     num_submitted = 0ul;
+            // a task that doesn't fit is kept, as the queue moves from it on success only
+            for(; !deferred.tasks.empty() && queue.try_enqueue(std::move(deferred.tasks.front()));
+                ++num_submitted)
+                deferred.tasks.pop_front();
+            count.fetch_sub(num_submitted, std::memory_order_relaxed);
+            return num_submitted;
+        }
+
+        // queue deferred tasks of every type while they fit
+        bool
+        resubmit(TaskQueuePool& task_queue_pool) noexcept
+        {
+            if(count.load(std::memory_order_relaxed) == 0ul) return false;
+            return (... + resubmit<Tasks>(task_queue_pool.template get<task_cqueue<Tasks>>())) >
+                   0ul;
+        }
+    };
+
+    // empty polls of the queues before a thread parks
+    static constexpr unsigned spin_count = 1024u;
+
+    // where a worker records its statistics; nothing unless they're compiled in
+    struct StatsSlot
+    {
+        Stats*   stats;
+        unsigned worker;
+    };
+    using WorkerStatsSlot = std::conditional_t<with_stats, StatsSlot, std::monostate>;
+
+    // start of a measured interval
+    static auto
+    stats_clock() noexcept
+    {
+        if constexpr(with_stats)
+            return Stats::now();
+        else
+            return std::monostate{};
+    }
+
     struct ThreadWorker
     {
-        std::atomic_bool& active_flag;
+        std::atomic_bool&           active_flag;
+        const std::atomic_uint64_t& current_epoch;
         TaskQueuePool&    task_queue_pool;
         ResultQueuePool&  result_queue_pool;
+        Deferrals&        deferrals;
+        ParkingLot&       task_parking;
+        ParkingLot&       result_parking;
+        std::size_t       bulk_size;
+        // CPU to pin the worker to, if any
+        std::optional<unsigned> cpu;
+        [[no_unique_address]] WorkerStatsSlot stats_slot;
 
+        // buffers of the tasks dequeued at once and their results
         template <typename Task>
-        void
-        run_task(cqueue<Task>& task_queue) noexcept
+        struct Bulk
+        {
+            moodycamel::ConsumerToken        token;
+            std::vector<queued_task<Task>>   tasks;
+            std::vector<queued_result<Task>> results;
+        };
+
+        template <typename Task>
+        bool
+        run_tasks(Bulk<Task>& bulk) noexcept
         {
+            auto& task_queue   = task_queue_pool.template get<task_cqueue<Task>>();
             auto& result_queue = result_queue_pool.template get<result_index<Task>()>();
 
-            Task task;
-            if(task_queue.try_dequeue(task))
+            const std::size_t num_tasks =
+                task_queue.try_dequeue_bulk(bulk.token, bulk.tasks.begin(), bulk_size);
+            if(num_tasks == 0ul) return false;
+
+            constexpr bool has_results = !std::is_void_v<std::invoke_result_t<Task>>;
+            std::size_t    num_results = 0ul;
+            for(std::size_t i = 0ul; i < num_tasks; ++i)
+            {
+                Task& task = unqueued<Task>(bulk.tasks[i]);
+                // cancelled tasks are skipped without results
+                if constexpr(has_epoch<Task>)
+                    if(task.epoch != current_epoch.load(std::memory_order_relaxed)) continue;
+
+                [[maybe_unused]] const auto begin = stats_clock();
+                if constexpr(!has_results)
+                    task();
+                else if constexpr(has_epoch<Task>)
+                    bulk.results[num_results++] = {task.epoch, task()};
+                else
+                    bulk.results[num_results++] = task();
+                if constexpr(with_stats)
+                    stats_slot.stats->add_task(
+                        stats_slot.worker, result_index<Task>(), bulk.tasks[i].submitted, begin);
+            }
+            if(num_results == 0ul) return true;
+
+            // results go through the implicit producer of the thread:
+            // unlike explicit ones, it returns emptied blocks to the queue,
+            // so workers don't starve small queues of blocks
+            auto enqueue = [&]() noexcept {
+                return result_queue.try_enqueue_bulk(
+                    std::make_move_iterator(bulk.results.begin()), num_results);
+            };
+            if(enqueue()) return true;
+
+            // a full queue parks the worker until results are fetched
+            [[maybe_unused]] auto spin_begin = stats_clock();
+            for(unsigned spins = 0u; !enqueue() && active_flag.load(std::memory_order_relaxed);)
             {
-                const auto result = task();
-                while(!result_queue.try_enqueue(std::move(result)) &&
-                      active_flag.load(std::memory_order_relaxed))
-                {}
+                if(++spins < spin_count) continue;
+                const std::uint32_t epoch = result_parking.prepare();
+                if(enqueue())
+                {
+                    result_parking.cancel();
+                    break;
+                }
+                if constexpr(with_stats)
+                    stats_slot.stats->add_spinning(stats_slot.worker, spin_begin);
+                [[maybe_unused]] const auto begin = stats_clock();
+                result_parking.wait(epoch);
+                if constexpr(with_stats)
+                {
+                    stats_slot.stats->add_parked(stats_slot.worker, begin);
+                    spin_begin = Stats::now();
+                }
+                spins = 0u;
             }
+            if constexpr(with_stats) stats_slot.stats->add_spinning(stats_slot.worker, spin_begin);
+            return true;
         }
 
         void
         operator()() noexcept
         {
-            while(active_flag.load(std::memory_order_relaxed))
+            // pinned before the buffers are allocated, so they are local to its NUMA node
+            if(cpu && !pin_this_thread(cpu.value()))
+                fmt::print(stderr, "Failed to pin a dispatcher worker to CPU {}\n", cpu.value());
+            // tokens are bound to the thread that uses them
+            std::tuple bulks{Bulk<Tasks>{
+                moodycamel::ConsumerToken(task_queue_pool.template get<task_cqueue<Tasks>>()),
+                std::vector<queued_task<Tasks>>(bulk_size),
+                std::vector<queued_result<Tasks>>(bulk_size)}...};
+            // tasks of the highest priority level available, a single level if there's no other
+            auto run = [&]() noexcept {
+                return std::apply(
+                    [&](auto&... bulk) noexcept {
+                        for(unsigned level = max_priority + 1u; level-- > 0u;)
+                            if((... | (priority<Tasks>() == level && run_tasks(bulk))))
+                                return true;
+                        return false;
+                    },
+                    bulks);
+            };
+            // idle workers spin for a while and then park until tasks are submitted
+            [[maybe_unused]] auto spin_begin = stats_clock();
+            for(unsigned spins = 0u; active_flag.load(std::memory_order_relaxed);)
             {
-                lucid::apply([&](auto&... task_queue) { (..., run_task(task_queue)); },
-                             task_queue_pool);
+                // room made by the tasks dequeued last goes to the deferred ones
+                if(deferrals.resubmit(task_queue_pool)) task_parking.notify();
+                if(run())
+                {
+                    if constexpr(with_stats)
+                        if(spins > 0u)
+                            stats_slot.stats->add_spinning(stats_slot.worker, spin_begin);
+                    spins = 0u;
+                    continue;
+                }
+                if constexpr(with_stats)
+                    if(spins == 0u) spin_begin = Stats::now();
+                if(++spins < spin_count) continue;
+                if constexpr(with_stats)
+                    stats_slot.stats->add_spinning(stats_slot.worker, spin_begin);
+
+                const std::uint32_t epoch = task_parking.prepare();
+                if(run() || deferrals.count.load(std::memory_order_relaxed) > 0ul ||
+                   !active_flag.load(std::memory_order_relaxed))
+                    task_parking.cancel();
+                else
+                {
+                    [[maybe_unused]] const auto begin = stats_clock();
+                    task_parking.wait(epoch);
+                    if constexpr(with_stats)
+                        stats_slot.stats->add_parked(stats_slot.worker, begin);
+                }
+                spins = 0u;
             }
         }
     };
 
     TaskQueuePool   task_queue_pool;
     ResultQueuePool result_queue_pool;
+    Deferrals       deferrals;
+
+    ParkingLot task_parking;
+    ParkingLot result_parking;
 
     std::atomic_bool         active_flag{true};
+    std::atomic_uint64_t     current_epoch{0ul};
     std::vector<std::thread> threads;
     std::atomic_size_t       count{0};
 
+    // statistics and the thread sampling depths of the queues, with _DISPATCHER_STATS only
+    template <typename T>
+    using if_stats = std::conditional_t<with_stats, T, std::monostate>;
+
+    [[no_unique_address]] if_stats<std::unique_ptr<Stats>> stats_ptr;
+    [[no_unique_address]] if_stats<std::thread>            sampler;
+    static constexpr std::chrono::milliseconds sampling_period{1};
+
+    template <typename Task>
+    task_cqueue<Task>&
+    task_queue() noexcept
+    {
+        return task_queue_pool.template get<task_cqueue<Task>>();
+    }
+
+    template <typename Task>
+    ResultQueue<Task>&
+    result_queue() noexcept
+    {
+        return result_queue_pool.template get<result_index<Task>()>();
+    }
+
+    // wake up workers waiting for tasks
+    bool
+    submitted(const bool success) noexcept
+    {
+        if(success) task_parking.notify();
+        return success;
+    }
+
+    // dequeue a result with dequeue(result), dropping results of cancelled tasks
+    template <typename Task, typename Dequeue>
+    std::optional<no_args<Task>>
+    fetch_current(Dequeue&& dequeue) noexcept
+    {
+        queued_result<Task> result;
+        if constexpr(has_epoch<Task>)
+        {
+            std::size_t num_fetched = 0ul;
+            for(; dequeue(result); ++num_fetched)
+                if(result.epoch == current_epoch.load(std::memory_order_relaxed))
+                {
+                    fetched(num_fetched + 1ul);
+                    return std::move(result.value);
+                }
+            fetched(num_fetched);
+        }
+        else if(fetched(dequeue(result)))
+            return result;
+
+        return std::nullopt;
+    }
+
+    // fetch up to max results one by one, as results of cancelled tasks are filtered out
+    template <typename Fetch, typename It>
+    static std::size_t
+    fetch_each(Fetch&& fetch, It out, const std::size_t max) noexcept
+    {
+        std::size_t num_results = 0ul;
+        for(; num_results < max; ++num_results, ++out)
+        {
+            auto result = fetch();
+            if(!result) break;
+            *out = std::move(result.value());
+        }
+        return num_results;
+    }
+
+    // wake up workers waiting for room for their results
+    template <typename T>
+    T
+    fetched(const T num_results) noexcept
+    {
+        if(num_results) result_parking.notify();
+        return num_results;
+    }
+
   public:
+    /// @param bulk_size Maximum number of tasks a worker dequeues at once.
+    /// Their results are queued all at once, so it is clamped to @p queue_size.
+    /// @param pin_threads Keep every worker on a CPU of its own, spread over NUMA nodes,
+    /// so workers don't migrate away from their caches and memory.
     Dispatcher(const std::size_t queue_size  = 10000,
-               const unsigned    num_threads = std::thread::hardware_concurrency()) noexcept :
-        task_queue_pool(uniform_init{}, queue_size),
-        result_queue_pool(uniform_init{}, queue_size)
+               const unsigned    num_threads = std::thread::hardware_concurrency(),
+               const std::size_t bulk_size   = 1,
+               const bool        pin_threads = false) noexcept :
+        // Every thread enqueueing without a token holds blocks of its own, so the queues
+        // reserve them for the workers and the main thread on top of the queue size.
+        // Otherwise blocks held by some workers could leave others unable to enqueue.
+        task_queue_pool(uniform_init{}, queue_size, 1ul, num_threads + 1ul),
+        result_queue_pool(uniform_init{}, queue_size, 0ul, num_threads)
     {
+        const std::vector<unsigned> cpus = pin_threads ? spread_cpus(num_threads)
+                                                       : std::vector<unsigned>{};
+        if constexpr(with_stats)
+        {
+            stats_ptr = std::make_unique<Stats>(num_threads);
+            sampler   = std::thread([this]() {
+                while(active_flag.load(std::memory_order_relaxed))
+                {
+                    stats_ptr->add_depths({task_queue<Tasks>().size_approx()...},
+                                          {result_queue<Tasks>().size_approx()...});
+                    std::this_thread::sleep_for(sampling_period);
+                }
+            });
+        }
+
         threads.reserve(num_threads);
         for(unsigned t_idx = 0; t_idx < num_threads; ++t_idx)
-            threads.emplace_back(ThreadWorker{active_flag, task_queue_pool, result_queue_pool});
+        {
+            WorkerStatsSlot stats_slot{};
+            if constexpr(with_stats) stats_slot = {stats_ptr.get(), t_idx};
+            threads.emplace_back(
+                ThreadWorker{active_flag,
+                             current_epoch,
+                             task_queue_pool,
+                             result_queue_pool,
+                             deferrals,
+                             task_parking,
+                             result_parking,
+                             std::clamp(bulk_size, 1ul, std::max(queue_size, 1ul)),
+                             pin_threads ? std::optional(cpus[t_idx]) : std::nullopt,
+                             stats_slot});
+        }
+    }
+
+    /// @brief Statistics of the workers and queues, recorded with _DISPATCHER_STATS.
+    const Stats&
+    stats() const noexcept
+        requires with_stats
+    {
+        return *stats_ptr;
+    }
+
+    /// @brief Token speeding up submission of tasks from a single thread.
+    ///
+    /// Tasks submitted with the token are kept in a queue of their own,
+    /// which holds on to its memory for the lifetime of the token.
+    template <typename Task>
+    moodycamel::ProducerToken
+    producer_token() noexcept
+    {
+        return moodycamel::ProducerToken(task_queue<Task>());
+    }
+
+    /// @brief Token speeding up fetching of results from a single thread.
+    template <typename Task>
+    moodycamel::ConsumerToken
+    consumer_token() noexcept
+    {
+        return moodycamel::ConsumerToken(result_queue<Task>());
     }
 
     template <typename Task>
     bool
     try_submit(Task&& task) noexcept
     {
-        cqueue<std::decay_t<Task>>& task_queue =
-            task_queue_pool.template get<cqueue<std::decay_t<Task>>>();
-        return task_queue.try_enqueue(std::move(task));
+        return submitted(enqueue_task(task, [this](auto&& queued) noexcept {
+            return task_queue<std::decay_t<Task>>().try_enqueue(std::move(queued));
+        }));
     }
 
     template <typename Task>
-    std::optional<typename result_helper<ResultQueue<Task>>::type>
+    bool
+    try_submit(moodycamel::ProducerToken& token, Task&& task) noexcept
+    {
+        return submitted(enqueue_task(task, [this, &token](auto&& queued) noexcept {
+            return task_queue<std::decay_t<Task>>().try_enqueue(token, std::move(queued));
+        }));
+    }
+
+    /// @brief Submit @p task, or have workers submit it once its queue has room.
+    ///
+    /// Unlike retrying try_submit(), this never waits for room,
+    /// so workers may submit tasks that have to be queued, e.g. from coroutines they resume.
+    /// Tasks don't overtake the ones deferred before them.
+    template <typename Task>
+    void
+    submit_eventually(Task&& task) noexcept
+    {
+        using T               = std::decay_t<Task>;
+        Deferred<T>& deferred = std::get<Deferred<T>>(deferrals.pool);
+        {
+            std::lock_guard lock(deferred.mutex);
+            if(deferred.tasks.empty() && try_submit(std::move(task))) return;
+            deferred.tasks.push_back(queued(std::move(task)));
+            deferrals.count.fetch_add(1ul, std::memory_order_relaxed);
+        }
+        // workers may have made room before the task was deferred
+        submitted(deferrals.template resubmit<T>(task_queue<T>()) > 0ul);
+    }
+
+    /// @brief Submit all the @p count tasks starting at @p first or none of them.
+    ///
+    /// Tasks are copied, unless @p first is a move iterator.
+    template <typename It>
+    bool
+    try_submit_bulk(It first, const std::size_t count) noexcept
+    {
+        return submitted(
+            task_queue<std::iter_value_t<It>>().try_enqueue_bulk(queued_bulk(first), count));
+    }
+
+    template <typename It>
+    bool
+    try_submit_bulk(moodycamel::ProducerToken& token, It first, const std::size_t count) noexcept
+    {
+        return submitted(
+            task_queue<std::iter_value_t<It>>().try_enqueue_bulk(token, queued_bulk(first), count));
+    }
+
+    /// @brief Awaitable result of @p task, computed on a worker.
+    ///
+    /// The awaiting coroutine is resumed by the worker, see Async.
+    /// Awaited<Task> has to be one of the tasks of the dispatcher.
+    template <typename Task>
+    SubmitAwaiter<Dispatcher, Task>
+    submit(Task task) noexcept
+    {
+        return {*this, std::move(task)};
+    }
+
+    /// @brief Awaitable results of @p tasks in their order, available once all are computed.
+    template <typename Task>
+    WhenAllAwaiter<Dispatcher, Task>
+    when_all(std::vector<Task> tasks) noexcept
+    {
+        return {*this, std::move(tasks)};
+    }
+
+    /// @brief Epoch that tasks made now belong to.
+    std::uint64_t
+    epoch() const noexcept
+    {
+        return current_epoch.load(std::memory_order_relaxed);
+    }
+
+    /// @brief Cancel tasks of the current epoch, e.g. when their input changes.
+    ///
+    /// Queued tasks are skipped rather than removed, which costs a comparison each,
+    /// so tasks of the new epoch start as soon as workers get through the queue.
+    /// The caller must not count on results of the cancelled tasks.
+    /// @return The new epoch.
+    std::uint64_t
+    next_epoch() noexcept
+    {
+        return current_epoch.fetch_add(1ul, std::memory_order_relaxed) + 1ul;
+    }
+
+    template <typename Task>
+    std::optional<no_args<Task>>
     fetch_result() noexcept
     {
-        using ResultType        = typename result_helper<ResultQueue<Task>>::type;
-        auto&      result_queue = result_queue_pool.template get<result_index<Task>()>();
-        ResultType result;
-        if(result_queue.try_dequeue(result)) return result;
+        return fetch_current<Task>(
+            [this](auto& result) noexcept { return result_queue<Task>().try_dequeue(result); });
+    }
+
+    template <typename Task>
+    std::optional<no_args<Task>>
+    fetch_result(moodycamel::ConsumerToken& token) noexcept
+    {
+        return fetch_current<Task>([this, &token](auto& result) noexcept {
+            return result_queue<Task>().try_dequeue(token, result);
+        });
+    }
+
+    /// @brief Fetch up to @p max results of tasks of type @p Task to @p out.
+    /// @return Number of fetched results.
+    template <typename Task, typename It>
+    std::size_t
+    fetch_results(It out, const std::size_t max) noexcept
+    {
+        if constexpr(has_epoch<Task>)
+            return fetch_each([this]() noexcept { return fetch_result<Task>(); }, out, max);
+        else
+            return fetched(result_queue<Task>().try_dequeue_bulk(out, max));
+    }
 
-        return std::optional<ResultType>{};
+    template <typename Task, typename It>
+    std::size_t
+    fetch_results(moodycamel::ConsumerToken& token, It out, const std::size_t max) noexcept
+    {
+        if constexpr(has_epoch<Task>)
+            return fetch_each(
+                [this, &token]() noexcept { return fetch_result<Task>(token); }, out, max);
+        else
+            return fetched(result_queue<Task>().try_dequeue_bulk(token, out, max));
     }
 
     ~Dispatcher() noexcept
     {
         active_flag.store(false, std::memory_order_relaxed);
+        task_parking.notify();
+        result_parking.notify();
         for(std::thread& t: threads) t.join();
+
+        if constexpr(with_stats)
+        {
+            sampler.join();
+            if(const char* path = std::getenv("LUCID_DISPATCHER_STATS"))
+                if(std::FILE* file = std::fopen(path, "a"))
+                {
+                    stats_ptr->dump(file);
+                    std::fclose(file);
+                }
+        }
+    }
+};
+
+/// @brief @p Task that dispatcher workers run before tasks of lower priority levels.
+///
+/// It's a task type of its own, with queues of its own,
+/// so its results are fetched as results of Prioritized<Task, Level>.
+template <typename Task, unsigned Level>
+struct Prioritized : Task
+{
+    static constexpr unsigned priority = Level;
+};
+
+/// @brief Group of tasks executed as a single dispatcher task.
+///
+/// Submitting or fetching a batch costs one queue operation
+/// for all the tasks it holds, which makes queue traffic
+/// negligible compared to the work when tasks are small.
+template <typename Task>
+struct TaskBatch
+{
+    using Result = std::invoke_result_t<Task&>;
+
+    std::vector<Task> tasks;
+    // epoch of the dispatcher the tasks were made in, see Dispatcher::next_epoch()
+    std::uint64_t epoch = 0ul;
+
+    std::vector<Result>
+    operator()() noexcept
+    {
+        std::vector<Result> results;
+        results.reserve(tasks.size());
+        for(Task& task: tasks) results.push_back(task());
+        return results;
     }
 };
 
@@ -0,0 +1,256 @@
+// -*- C++ -*-
+// dispatcher_stats.hpp
+//
+
+/// @file
+/// Statistics of dispatcher workers and queues, compiled in with _DISPATCHER_STATS.
+
+#pragma once
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace lucid
+{
+#ifdef _DISPATCHER_STATS
+constexpr bool dispatcher_stats = true;
+#else
+constexpr bool dispatcher_stats = false;
+#endif
+
+/// @brief Histogram of durations in power of two buckets of nanoseconds.
+class LatencyHistogram
+{
+    static constexpr std::size_t num_buckets = 48ul;
+
+    std::array<std::atomic_uint64_t, num_buckets> buckets{};
+
+  public:
+    void
+    add(const std::chrono::nanoseconds duration) noexcept
+    {
+        const auto ns = static_cast<std::uint64_t>(std::max(duration.count(), 1l));
+        // bucket b counts durations in [2^b, 2^(b + 1))
+        const std::size_t bucket = std::bit_width(ns) - 1u;
+        buckets[std::min(bucket, num_buckets - 1ul)].fetch_add(1ul, std::memory_order_relaxed);
+    }
+
+    std::uint64_t
+    count() const noexcept
+    {
+        std::uint64_t ret = 0ul;
+        for(const auto& bucket: buckets) ret += bucket.load(std::memory_order_relaxed);
+        return ret;
+    }
+
+    /// @brief Upper bound of the duration @p q of the durations are shorter than.
+    std::chrono::nanoseconds
+    quantile(const double q) const noexcept
+    {
+        const auto    total = static_cast<double>(count());
+        std::uint64_t below = 0ul;
+        for(std::size_t b = 0ul; b < num_buckets; ++b)
+        {
+            below += buckets[b].load(std::memory_order_relaxed);
+            if(static_cast<double>(below) >= q * total)
+                return std::chrono::nanoseconds(std::int64_t{2} << b);
+        }
+        return std::chrono::nanoseconds::max();
+    }
+};
+
+/// @brief Time a worker spent running tasks, polling empty or full queues and parked,
+/// in nanoseconds.
+struct alignas(64) WorkerStats
+{
+    std::atomic_uint64_t busy{0ul};
+    std::atomic_uint64_t spinning{0ul};
+    std::atomic_uint64_t parked{0ul};
+    std::atomic_uint64_t num_tasks{0ul};
+};
+
+/// @brief Approximate numbers of tasks and results waiting in the queues of each task type.
+template <std::size_t NumTaskTypes>
+struct QueueDepths
+{
+    std::chrono::nanoseconds              time{0};
+    std::array<std::size_t, NumTaskTypes> tasks{};
+    std::array<std::size_t, NumTaskTypes> results{};
+};
+
+/// @brief Statistics of a dispatcher of @p NumTaskTypes task types.
+///
+/// Workers record their own times, the run times of tasks and their latencies
+/// from submission to completion, a sampling thread records depths of the queues.
+/// Only the last samples of the depths are kept, older ones are overwritten.
+template <std::size_t NumTaskTypes>
+class DispatcherStats
+{
+  public:
+    using Clock = std::chrono::steady_clock;
+
+  private:
+    using Depths = QueueDepths<NumTaskTypes>;
+
+    const Clock::time_point                    start = Clock::now();
+    std::unique_ptr<WorkerStats[]>             worker_stats;
+    std::size_t                                num_workers;
+    std::array<LatencyHistogram, NumTaskTypes> run_times{};
+    std::array<LatencyHistogram, NumTaskTypes> latencies{};
+    mutable std::mutex                         depths_mutex;
+    // ring buffer of the last samples of depths
+    std::vector<Depths> depths;
+    std::size_t         num_depths = 0ul;
+
+  public:
+    /// @brief About a minute of depths sampled every millisecond.
+    static constexpr std::size_t default_max_depths = 1ul << 16;
+
+    explicit DispatcherStats(const std::size_t workers,
+                             const std::size_t max_depths = default_max_depths) :
+        worker_stats(std::make_unique<WorkerStats[]>(workers)),
+        num_workers(workers),
+        depths(std::max(max_depths, 1ul))
+    {
+    }
+
+    static Clock::time_point
+    now() noexcept
+    {
+        return Clock::now();
+    }
+
+    /// @brief Record a task of the type with index @p type submitted at @p submitted
+    /// and run by @p worker since @p begin.
+    void
+    add_task(const std::size_t        worker,
+             const std::size_t        type,
+             const Clock::time_point& submitted,
+             const Clock::time_point& begin) noexcept
+    {
+        const Clock::time_point        end      = Clock::now();
+        const std::chrono::nanoseconds duration = end - begin;
+        WorkerStats&                   stats    = worker_stats[worker];
+        stats.busy.fetch_add(duration.count(), std::memory_order_relaxed);
+        stats.num_tasks.fetch_add(1ul, std::memory_order_relaxed);
+        run_times[type].add(duration);
+        latencies[type].add(end - submitted);
+    }
+
+    void
+    add_spinning(const std::size_t worker, const Clock::time_point& begin) noexcept
+    {
+        worker_stats[worker].spinning.fetch_add(
+            std::chrono::nanoseconds(Clock::now() - begin).count(), std::memory_order_relaxed);
+    }
+
+    void
+    add_parked(const std::size_t worker, const Clock::time_point& begin) noexcept
+    {
+        worker_stats[worker].parked.fetch_add(
+            std::chrono::nanoseconds(Clock::now() - begin).count(), std::memory_order_relaxed);
+    }
+
+    void
+    add_depths(const std::array<std::size_t, NumTaskTypes>& tasks,
+               const std::array<std::size_t, NumTaskTypes>& results) noexcept
+    {
+        const std::chrono::nanoseconds time = Clock::now() - start;
+        std::lock_guard                lock(depths_mutex);
+        depths[num_depths++ % depths.size()] = {time, tasks, results};
+    }
+
+    std::chrono::nanoseconds
+    elapsed() const noexcept
+    {
+        return Clock::now() - start;
+    }
+
+    const WorkerStats&
+    worker(const std::size_t idx) const noexcept
+    {
+        return worker_stats[idx];
+    }
+
+    std::size_t
+    workers() const noexcept
+    {
+        return num_workers;
+    }
+
+    /// @brief Histogram of run times of tasks of the type with index @p type.
+    const LatencyHistogram&
+    run_time(const std::size_t type) const noexcept
+    {
+        return run_times[type];
+    }
+
+    /// @brief Histogram of times from submission to completion of tasks
+    /// of the type with index @p type, including the time they waited in the queue.
+    const LatencyHistogram&
+    latency(const std::size_t type) const noexcept
+    {
+        return latencies[type];
+    }
+
+    /// @brief Kept samples of the depths from the oldest to the latest.
+    std::vector<Depths>
+    queue_depths() const
+    {
+        std::lock_guard     lock(depths_mutex);
+        const std::size_t   first = num_depths - std::min(num_depths, depths.size());
+        std::vector<Depths> ret;
+        ret.reserve(num_depths - first);
+        for(std::size_t i = first; i < num_depths; ++i) ret.push_back(depths[i % depths.size()]);
+        return ret;
+    }
+
+    /// @brief Write a summary of the statistics and depths of the queues over time.
+    void
+    dump(std::FILE* file) const
+    {
+        const auto total = static_cast<double>(elapsed().count());
+        fmt::print(file, "worker,tasks,busy,spinning,parked\n");
+        for(std::size_t w = 0ul; w < num_workers; ++w)
+            fmt::print(file,
+                       "{},{},{:.3f},{:.3f},{:.3f}\n",
+                       w,
+                       worker_stats[w].num_tasks.load(),
+                       static_cast<double>(worker_stats[w].busy.load()) / total,
+                       static_cast<double>(worker_stats[w].spinning.load()) / total,
+                       static_cast<double>(worker_stats[w].parked.load()) / total);
+
+        fmt::print(file,
+                   "task type,count,run time p50 ns,p90 ns,p99 ns,latency p50 ns,p90 ns,p99 ns\n");
+        for(std::size_t t = 0ul; t < NumTaskTypes; ++t)
+            fmt::print(file,
+                       "{},{},{},{},{},{},{},{}\n",
+                       t,
+                       run_times[t].count(),
+                       run_times[t].quantile(0.5).count(),
+                       run_times[t].quantile(0.9).count(),
+                       run_times[t].quantile(0.99).count(),
+                       latencies[t].quantile(0.5).count(),
+                       latencies[t].quantile(0.9).count(),
+                       latencies[t].quantile(0.99).count());
+
+        fmt::print(file, "time ns,task queue depths,result queue depths\n");
+        for(const Depths& sample: queue_depths())
+            fmt::print(file,
+                       "{},{},{}\n",
+                       sample.time.count(),
+                       fmt::join(sample.tasks, " "),
+                       fmt::join(sample.results, " "));
+    }
+};
+} // namespace lucid
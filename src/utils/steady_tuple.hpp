@@ -84,12 +84,13 @@ class steady_tuple_impl<std::index_sequence<Idxs...>, Ts...> : public steady_tup
     {
     }
 
-    template <size_t... LeafIdxs, typename... LeafTs, typename Val>
+    // every leaf is constructed from the same values
+    template <size_t... LeafIdxs, typename... LeafTs, typename... Vals>
     constexpr steady_tuple_impl(std::index_sequence<LeafIdxs...>,
                                 typelist<LeafTs...>,
                                 uniform_init,
-                                Val&& val) :
-        steady_tuple_leaf<LeafIdxs, LeafTs>(std::forward<Val>(val))...
+                                Vals&&... vals) :
+        steady_tuple_leaf<LeafIdxs, LeafTs>(vals...)...
     {
     }
 };
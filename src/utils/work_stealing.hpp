@@ -0,0 +1,113 @@
+// -*- C++ -*-
+// work_stealing.hpp
+//
+
+/// @file
+/// Parallel processing of recursively divisible work without a central queue.
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+namespace lucid
+{
+/// @brief Deque of work items owned by a single thread.
+///
+/// The owner pushes and pops at the back, so it keeps working on what it split last.
+/// Thieves take from the front, where the oldest and largest items are.
+template <typename Item>
+class StealingDeque
+{
+    std::deque<Item> items;
+    std::mutex       mutex;
+
+  public:
+    void
+    push(const Item& item)
+    {
+        std::lock_guard lock(mutex);
+        items.push_back(item);
+    }
+
+    std::optional<Item>
+    pop()
+    {
+        std::lock_guard lock(mutex);
+        if(items.empty()) return std::nullopt;
+        Item ret = items.back();
+        items.pop_back();
+        return ret;
+    }
+
+    std::optional<Item>
+    steal()
+    {
+        std::lock_guard lock(mutex);
+        if(items.empty()) return std::nullopt;
+        Item ret = items.front();
+        items.pop_front();
+        return ret;
+    }
+};
+
+/// @brief Process @p root on a pool of threads by work stealing @cite Blumofe1999.
+///
+/// Every thread splits the item it has until it's small enough to run,
+/// keeping one half and pushing the other to its own deque.
+/// Idle threads steal from the deques of others, so work spreads
+/// from the first thread without any thread producing it for the others.
+/// Returns once every item is run.
+/// @param split Callable returning optional pair of halves of an item,
+/// or nothing if the item is small enough to run.
+/// @param run Callable taking an item and index of the thread running it.
+template <typename Item, typename Split, typename Run>
+void
+steal_work(const Item& root, const unsigned num_threads, Split&& split, Run&& run)
+{
+    const unsigned                   n = std::max(num_threads, 1u);
+    std::vector<StealingDeque<Item>> deques(n);
+    // items split off but not run yet
+    std::atomic_size_t pending{1ul};
+    deques[0].push(root);
+
+    auto take = [&](const unsigned idx) -> std::optional<Item> {
+        if(auto item = deques[idx].pop()) return item;
+        for(unsigned k = 1u; k < n; ++k)
+            if(auto item = deques[(idx + k) % n].steal()) return item;
+        return std::nullopt;
+    };
+
+    auto worker = [&](const unsigned idx) {
+        while(pending.load() > 0ul)
+        {
+            auto item = take(idx);
+            if(!item)
+            {
+                std::this_thread::yield();
+                continue;
+            }
+
+            while(const auto halves = split(item.value()))
+            {
+                pending.fetch_add(1ul);
+                deques[idx].push(halves->second);
+                item = halves->first;
+            }
+            run(item.value(), idx);
+            pending.fetch_sub(1ul);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(n - 1u);
+    for(unsigned idx = 1u; idx < n; ++idx) threads.emplace_back(worker, idx);
+    worker(0u);
+    for(auto& thread: threads) thread.join();
+}
+} // namespace lucid